@@ -0,0 +1,956 @@
+#include <Pe/Pe.hpp>
+#include <Corpus/UringReader.h>
+#include <Corpus/SummaryCache.h>
+#include <Corpus/SymbolStore.h>
+#include <Corpus/DownloadPool.h>
+#include <Corpus/HttpSession.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <cstddef>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+namespace tr
+{
+
+template <typename... Args>
+constexpr void unused(const Args&...)
+{
+}
+
+} // namespace tr
+
+
+
+namespace
+{
+
+// Minimal image in the file layout: headers, .rdata with one imported function and .text that nobody reads:
+template <Pe::Arch arch>
+std::vector<unsigned char> makeImage()
+{
+    using NtHeaders = typename Pe::Types<arch>::NtHeaders;
+    using Thunk = decltype(Pe::Types<arch>::ImportAddressTableEntry::raw);
+
+    constexpr unsigned int k_ntOffset = 0x40;
+    constexpr unsigned int k_rdata = 0x1000; // RVA
+    constexpr unsigned int k_rdataRaw = 0x400;
+    constexpr unsigned int k_text = 0x2000;
+    constexpr unsigned int k_textRaw = 0x600;
+
+    std::vector<unsigned char> image(k_textRaw + 0x1000);
+    const auto at = [&image](const unsigned int offset) -> unsigned char*
+    {
+        return image.data() + offset;
+    };
+
+    auto* const dos = reinterpret_cast<IMAGE_DOS_HEADER*>(at(0));
+    dos->e_magic = 0x5A4D;
+    dos->e_lfanew = k_ntOffset;
+
+    auto* const nt = reinterpret_cast<NtHeaders*>(at(k_ntOffset));
+    nt->Signature = 0x00004550;
+    nt->FileHeader.Machine = (arch == Pe::Arch::x64) ? 0x8664 : 0x014C;
+    nt->FileHeader.NumberOfSections = 2;
+    nt->FileHeader.SizeOfOptionalHeader = sizeof(nt->OptionalHeader);
+    nt->OptionalHeader.Magic = Pe::Types<arch>::k_magic;
+    nt->OptionalHeader.SectionAlignment = 0x1000;
+    nt->OptionalHeader.FileAlignment = 0x200;
+    nt->OptionalHeader.SizeOfHeaders = k_rdataRaw;
+    nt->OptionalHeader.SizeOfImage = k_text + 0x1000;
+    nt->OptionalHeader.NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+    nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT] = { k_rdata, 2 * sizeof(IMAGE_IMPORT_DESCRIPTOR) };
+
+    auto* const sections = reinterpret_cast<IMAGE_SECTION_HEADER*>(at(k_ntOffset + offsetof(NtHeaders, OptionalHeader) + sizeof(nt->OptionalHeader)));
+    memcpy(sections[0].Name, ".rdata", 6);
+    sections[0].VirtualAddress = k_rdata;
+    sections[0].Misc.VirtualSize = 0x200;
+    sections[0].SizeOfRawData = 0x200;
+    sections[0].PointerToRawData = k_rdataRaw;
+    sections[0].Characteristics = IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ;
+
+    memcpy(sections[1].Name, ".text", 5);
+    sections[1].VirtualAddress = k_text;
+    sections[1].Misc.VirtualSize = 0x1000;
+    sections[1].SizeOfRawData = 0x1000;
+    sections[1].PointerToRawData = k_textRaw;
+    sections[1].Characteristics = IMAGE_SCN_CNT_CODE | IMAGE_SCN_MEM_EXECUTE | IMAGE_SCN_MEM_READ;
+    memset(at(k_textRaw), 0xCC, 0x1000);
+
+    // Import descriptor, ILT at +0x40, IAT at +0x60, hint/name at +0x80, module name at +0xA0:
+    const auto raw = [](const unsigned int rva) { return rva - k_rdata + k_rdataRaw; };
+    auto* const descriptor = reinterpret_cast<IMAGE_IMPORT_DESCRIPTOR*>(at(k_rdataRaw));
+    descriptor->OriginalFirstThunk = k_rdata + 0x40;
+    descriptor->FirstThunk = k_rdata + 0x60;
+    descriptor->Name = k_rdata + 0xA0;
+
+    const Thunk thunk = k_rdata + 0x80;
+    memcpy(at(raw(k_rdata + 0x40)), &thunk, sizeof(thunk));
+    memcpy(at(raw(k_rdata + 0x60)), &thunk, sizeof(thunk));
+    strcpy(reinterpret_cast<char*>(at(raw(k_rdata + 0x82))), "ReadFile");
+    strcpy(reinterpret_cast<char*>(at(raw(k_rdata + 0xA0))), "KERNEL32.dll");
+
+    return image;
+}
+
+bool writeFile(const std::string& path, const void* const data, const size_t size)
+{
+    FILE* const file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    const bool written = fwrite(data, 1, size, file) == size;
+    return (fclose(file) == 0) && written;
+}
+
+std::string makeTempDir(const char* const name)
+{
+    std::string path = std::string("/tmp/") + name + ".XXXXXX";
+    const bool created = mkdtemp(&path[0]) != nullptr;
+    assert(created);
+    tr::unused(created);
+    return path;
+}
+
+std::string readFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+bool exists(const std::string& path)
+{
+    return access(path.c_str(), F_OK) == 0;
+}
+
+void removeTree(const std::string& path)
+{
+    const std::string command = "rm -rf '" + path + "'";
+    const int status = system(command.c_str());
+    tr::unused(status);
+}
+
+// Answers every URL with its scripted statuses in order, the last one repeats, zero is a transport failure:
+struct Script
+{
+    std::mutex mutex;
+    std::condition_variable released;
+    bool hold = false; // Requests wait until it is reset
+    std::map<std::string, std::vector<unsigned int>> statuses;
+    std::map<std::string, unsigned int> calls;
+    std::string body;
+};
+
+class StubClient : public Corpus::HttpClient
+{
+private:
+    Script& m_script;
+
+public:
+    explicit StubClient(Script& script) noexcept : m_script(script)
+    {
+    }
+
+    virtual bool get(const Request& request, Sink& sink) override
+    {
+        unsigned int status = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_script.mutex);
+            m_script.released.wait(lock, [this]() { return !m_script.hold; });
+
+            const auto& statuses = m_script.statuses.at(request.url);
+            const unsigned int call = m_script.calls[request.url]++;
+            status = statuses[std::min<size_t>(call, statuses.size() - 1)];
+        }
+
+        if (!status)
+        {
+            return false;
+        }
+
+        const long long length = (status == 200) ? static_cast<long long>(m_script.body.size()) : 0;
+        if (!sink.onResponse(Response{ status, length, 0, -1 }))
+        {
+            return true;
+        }
+
+        return (status != 200) || sink.onData(m_script.body.data(), m_script.body.size());
+    }
+};
+
+// HTTP server on the loopback, every connection is served by its own thread.
+// The handler gets the request head and the index of the request on its connection,
+// false from it closes the connection without an answer:
+class TestServer
+{
+public:
+    using Handler = std::function<bool(const std::string& head, unsigned int index, std::string& response)>;
+
+private:
+    Handler m_handler;
+    int m_listener;
+    unsigned short m_port;
+    std::thread m_acceptor;
+    std::mutex m_mutex;
+    std::vector<std::thread> m_connections;
+    std::atomic<unsigned int> m_accepted;
+
+private:
+    void serve(const int fd)
+    {
+        std::string data;
+        char buffer[4096];
+        for (unsigned int index = 0; ; ++index)
+        {
+            size_t headEnd = std::string::npos;
+            while ((headEnd = data.find("\r\n\r\n")) == std::string::npos)
+            {
+                const auto received = recv(fd, buffer, sizeof(buffer), 0);
+                if (received <= 0)
+                {
+                    close(fd);
+                    return;
+                }
+                data.append(buffer, static_cast<size_t>(received));
+            }
+
+            const std::string head = data.substr(0, headEnd + 4);
+            data.erase(0, headEnd + 4);
+
+            std::string response;
+            if (!m_handler(head, index, response) || (send(fd, response.data(), response.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(response.size())))
+            {
+                close(fd);
+                return;
+            }
+        }
+    }
+
+    void accept()
+    {
+        for (;;)
+        {
+            const int fd = ::accept(m_listener, nullptr, nullptr);
+            if (fd < 0)
+            {
+                return;
+            }
+
+            ++m_accepted;
+            const std::lock_guard<std::mutex> lock(m_mutex);
+            m_connections.emplace_back(&TestServer::serve, this, fd);
+        }
+    }
+
+public:
+    TestServer(const bool ipv6, Handler handler) : m_handler(std::move(handler)), m_listener(-1), m_port(0), m_accepted(0)
+    {
+        const int fd = socket(ipv6 ? AF_INET6 : AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            return;
+        }
+
+        sockaddr_storage address{};
+        socklen_t size = 0;
+        if (ipv6)
+        {
+            auto& v6 = reinterpret_cast<sockaddr_in6&>(address);
+            v6.sin6_family = AF_INET6;
+            v6.sin6_addr = in6addr_loopback;
+            size = sizeof(v6);
+        }
+        else
+        {
+            auto& v4 = reinterpret_cast<sockaddr_in&>(address);
+            v4.sin_family = AF_INET;
+            v4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            size = sizeof(v4);
+        }
+
+        if ((bind(fd, reinterpret_cast<const sockaddr*>(&address), size) != 0) || (listen(fd, 16) != 0)
+            || (getsockname(fd, reinterpret_cast<sockaddr*>(&address), &size) != 0))
+        {
+            close(fd);
+            return;
+        }
+
+        m_port = ntohs(ipv6 ? reinterpret_cast<const sockaddr_in6&>(address).sin6_port : reinterpret_cast<const sockaddr_in&>(address).sin_port);
+        m_listener = fd;
+        m_acceptor = std::thread(&TestServer::accept, this);
+    }
+
+    ~TestServer()
+    {
+        if (m_listener < 0)
+        {
+            return;
+        }
+
+        shutdown(m_listener, SHUT_RDWR);
+        m_acceptor.join();
+        close(m_listener);
+
+        // The connections end when the clients close them:
+        for (auto& connection : m_connections)
+        {
+            connection.join();
+        }
+    }
+
+    TestServer(const TestServer&) = delete;
+    TestServer& operator = (const TestServer&) = delete;
+
+    bool valid() const noexcept
+    {
+        return m_listener >= 0;
+    }
+
+    unsigned short port() const noexcept
+    {
+        return m_port;
+    }
+
+    unsigned int accepted() const noexcept
+    {
+        return m_accepted;
+    }
+};
+
+struct BodySink : public Corpus::HttpClient::Sink
+{
+    Corpus::HttpClient::Response response{};
+    std::string body;
+
+    virtual bool onResponse(const Corpus::HttpClient::Response& received) override
+    {
+        response = received;
+        return true;
+    }
+
+    virtual bool onData(const void* const data, const size_t size) override
+    {
+        body.append(static_cast<const char*>(data), size);
+        return true;
+    }
+};
+
+// Stands for a TLS library: the channel is the plain socket:
+class PlainTls : public Corpus::HttpSession::Tls
+{
+private:
+    class PlainChannel : public Channel
+    {
+    private:
+        int m_fd;
+
+    public:
+        explicit PlainChannel(const int fd) noexcept : m_fd(fd)
+        {
+        }
+
+        virtual bool send(const void* const data, const size_t size) override
+        {
+            return ::send(m_fd, data, size, MSG_NOSIGNAL) == static_cast<ssize_t>(size);
+        }
+
+        virtual long receive(void* const buffer, const size_t size) override
+        {
+            return static_cast<long>(recv(m_fd, buffer, size, 0));
+        }
+    };
+
+public:
+    std::vector<std::string> hosts;
+
+    virtual std::unique_ptr<Channel> handshake(const int fd, const std::string& host) override
+    {
+        hosts.push_back(host);
+        return std::unique_ptr<Channel>(new PlainChannel(fd));
+    }
+};
+
+} // namespace
+
+
+
+void testUringReader()
+{
+    const std::string dir = makeTempDir("formatPE.uring");
+
+    const auto image32 = makeImage<Pe::Arch::x32>();
+    const auto image64 = makeImage<Pe::Arch::x64>();
+
+    // Valid images of both architectures, truncated ones, non-PE files and a missing file:
+    constexpr unsigned int k_files = 240;
+    std::vector<std::string> paths;
+    unsigned int expectedDelivered = 0;
+    for (unsigned int i = 0; i < k_files; ++i)
+    {
+        const std::string path = dir + "/" + std::to_string(i) + ".dll";
+        bool written = false;
+        switch (i % 4)
+        {
+        case 0:
+        {
+            written = writeFile(path, image32.data(), image32.size());
+            ++expectedDelivered;
+            break;
+        }
+        case 1:
+        {
+            written = writeFile(path, image64.data(), image64.size());
+            ++expectedDelivered;
+            break;
+        }
+        case 2:
+        {
+            written = writeFile(path, image64.data(), 0x100); // The section table is cut off
+            break;
+        }
+        default:
+        {
+            written = writeFile(path, "MZ not a PE", 11);
+            break;
+        }
+        }
+
+        assert(written);
+        paths.emplace_back(path);
+    }
+    paths.emplace_back(dir + "/missing.dll");
+
+    for (const unsigned int queueDepth : { 1u, 4u, 128u })
+    {
+        for (const unsigned int headerSize : { 64u, 4096u })
+        {
+            auto options = Corpus::UringReader::Options::defaults();
+            options.queueDepth = queueDepth;
+            options.headerSize = headerSize;
+            options.maxFiles = 8;
+            options.workers = 2;
+
+            Corpus::UringReader reader(options);
+
+            std::atomic<unsigned int> handled{ 0 };
+            const auto stats = reader.run(paths, [&handled](const Corpus::UringReader::Image& image)
+            {
+                const auto* const bytes = static_cast<const unsigned char*>(image.data);
+                assert(image.size == 0x1600);
+                assert(bytes[image.size - 1] == 0); // The end of .text is past the headers and isn't needed for the imports
+
+                const auto check = [](const auto& pe)
+                {
+                    unsigned int modules = 0;
+                    for (const auto& lib : pe.imports())
+                    {
+                        assert(strcmp(lib.libName(), "KERNEL32.dll") == 0);
+                        ++modules;
+                    }
+                    assert(modules == 1);
+                    tr::unused(modules);
+                };
+
+                if (image.arch == Pe::Arch::x32)
+                {
+                    check(Pe::Pe32::fromFile(image.data));
+                }
+                else
+                {
+                    assert(image.arch == Pe::Arch::x64);
+                    check(Pe::Pe64::fromFile(image.data));
+                }
+
+                ++handled;
+            });
+
+            printf("UringReader (%s, queue depth %u, headers %u): %llu delivered, %llu failed, %llu reads\n",
+                reader.async() ? "io_uring" : "pread", reader.options().queueDepth, headerSize, stats.delivered, stats.failed, stats.reads);
+
+            assert(stats.delivered == expectedDelivered);
+            assert(handled == expectedDelivered);
+            assert(stats.delivered + stats.failed == paths.size());
+        }
+    }
+
+    removeTree(dir);
+}
+
+void testSummaryCache()
+{
+    const std::string dir = makeTempDir("formatPE.summaries");
+    const std::string storage = dir + "/cache";
+    const std::string path = dir + "/image.dll";
+
+    auto image = makeImage<Pe::Arch::x64>();
+    auto* const nt = reinterpret_cast<IMAGE_NT_HEADERS64*>(image.data() + reinterpret_cast<const IMAGE_DOS_HEADER*>(image.data())->e_lfanew);
+
+    const auto rewrite = [&](const unsigned int timestamp) -> bool
+    {
+        // Keeps the size, mtimes differ only by milliseconds:
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        nt->FileHeader.TimeDateStamp = timestamp;
+        return writeFile(path, image.data(), image.size());
+    };
+
+    {
+        Corpus::SummaryCache cache(storage);
+        assert(cache.valid());
+
+        Pe::Summary summary{};
+        bool status = rewrite(1) && cache.get(path.c_str(), summary);
+        assert(status && (summary.timestamp == 1) && (summary.imports.size() == 1));
+
+        status = cache.get(path.c_str(), summary);
+        assert(status && (cache.stats().hits == 1));
+
+        // The new version replaces the entry of the old one:
+        status = rewrite(2) && cache.get(path.c_str(), summary);
+        assert(status && (summary.timestamp == 2) && (cache.stats().misses == 2) && (cache.size() == 1));
+
+        status = rewrite(3) && cache.get(path.c_str(), summary);
+        assert(status && (summary.timestamp == 3) && (cache.size() == 1));
+    }
+
+    // Two of the three records are overridden, so the log is compacted on load:
+    const auto logSize = readFile(storage).size();
+    {
+        Corpus::SummaryCache cache(storage);
+        assert((cache.size() == 1) && (readFile(storage).size() < logSize));
+
+        Pe::Summary summary{};
+        const bool status = cache.get(path.c_str(), summary);
+        assert(status && (summary.timestamp == 3) && (cache.stats().hits == 1));
+    }
+
+    // Export directory that claims 0x20000000 functions and names in the .rdata tail:
+    {
+        constexpr unsigned int k_rdata = 0x1000;
+        constexpr unsigned int k_rdataRaw = 0x400;
+        constexpr unsigned int k_exports = 0x100;
+
+        nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT] = { k_rdata + k_exports, sizeof(IMAGE_EXPORT_DIRECTORY) };
+        auto* const exports = reinterpret_cast<IMAGE_EXPORT_DIRECTORY*>(image.data() + k_rdataRaw + k_exports);
+        exports->Name = k_rdata + 0xA0;
+        exports->Base = 1;
+        exports->NumberOfFunctions = 0x20000000;
+        exports->NumberOfNames = 0x20000000;
+        exports->AddressOfFunctions = k_rdata + 0x140;
+        exports->AddressOfNames = k_rdata + 0x1C0;
+        exports->AddressOfNameOrdinals = k_rdata + 0x1E0;
+
+        const unsigned int function = 0x2000;
+        memcpy(image.data() + k_rdataRaw + 0x140, &function, sizeof(function));
+
+        const auto view = Pe::Pe64::fromFile(image.data());
+        assert((view.exports().count() == 0x30) && (view.exports().namesCount() == 0x10));
+
+        Corpus::SummaryCache cache(storage);
+        Pe::Summary summary{};
+        const bool status = rewrite(4) && cache.get(path.c_str(), summary);
+        assert(status && (summary.timestamp == 4) && (summary.exportModuleName == "KERNEL32.dll"));
+        assert(!summary.exports.empty() && (summary.exports.size() <= 0x30) && (summary.exports[0].rva == function));
+    }
+
+    removeTree(dir);
+}
+
+void testSymbolStore()
+{
+    const std::string root = makeTempDir("formatPE.symbols");
+
+    const GUID guid{ 0x01020304, 0x0506, 0x0708, { 9, 10, 11, 12, 13, 14, 15, 16 } };
+    const Pe::CodeView::SymbolKey first(guid, 1);
+    const Pe::CodeView::SymbolKey second(guid, 2);
+
+    const auto publish = [](Corpus::SymbolStore& store, const char* const name, const Pe::CodeView::SymbolKey& key, const size_t size) -> bool
+    {
+        const auto temp = store.prepare(name, key);
+        const std::string content(size, 'x');
+        return !temp.empty() && writeFile(temp, content.data(), content.size()) && store.publish(name, key, temp);
+    };
+
+    {
+        Corpus::SymbolStore store(root, 150);
+        assert(store.valid() && !store.size());
+        assert(store.path("../evil.pdb", first).empty());
+
+        bool published = publish(store, "a.pdb", first, 100)
+            && publish(store, "b.pdb", first, 100)
+            && publish(store, "c.pdb", second, 100);
+        assert(published);
+        assert((store.size() == 3) && (store.totalSize() == 300));
+
+        const auto* const entry = store.find("b.pdb", first);
+        assert(entry && (entry->size == 100));
+        assert(!store.find("b.pdb", second) && (store.stats().hits == 1) && (store.stats().misses == 1));
+
+        // The held entry survives, the others are evicted to fit the budget:
+        Corpus::SymbolStore other(root, 0);
+        const auto held = other.lock("a.pdb", first, false);
+        assert(held.locked());
+
+        const bool evicted = store.evict();
+        assert(evicted);
+        assert((store.size() == 1) && (store.totalSize() == 100) && (store.stats().evictedFiles == 2));
+        assert(store.find("a.pdb", first) && exists(store.path("a.pdb", first)));
+        assert(!store.find("b.pdb", first) && !exists(store.path("b.pdb", first)));
+        assert(!exists(store.path("c.pdb", second)));
+        tr::unused(published, entry, evicted);
+    }
+
+    // Two instances see each other's entries through the index:
+    Corpus::SymbolStore left(root, 1000);
+    Corpus::SymbolStore right(root, 1000);
+    assert((left.size() == 1) && left.find("a.pdb", first));
+
+    bool published = publish(left, "d.pdb", first, 10) && left.flush();
+    assert(published && !right.find("d.pdb", first));
+
+    bool refreshed = right.refresh();
+    assert(refreshed && right.find("d.pdb", first) && (right.size() == 2));
+
+    published = publish(right, "e.pdb", second, 20) && right.flush();
+    assert(published);
+
+    refreshed = left.refresh();
+    assert(refreshed && left.find("e.pdb", second));
+    assert((left.size() == 3) && (left.totalSize() == 130));
+
+    // Removed entries don't come back from the other instance's index:
+    const bool removed = left.remove("d.pdb", first) && left.flush();
+    assert(removed && !left.find("d.pdb", first) && (left.size() == 2));
+
+    refreshed = right.refresh();
+    assert(refreshed && !right.find("d.pdb", first) && (right.size() == 2));
+
+    const Corpus::SymbolStore reopened(root, 1000);
+    assert((reopened.size() == 2) && (reopened.totalSize() == 120));
+    tr::unused(published, refreshed, removed);
+
+    removeTree(root);
+}
+
+void testDownloadPool()
+{
+    const std::string dir = makeTempDir("formatPE.downloads");
+
+    Script script;
+    script.body = "Microsoft C/C++ MSF 7.00\r\n";
+    script.statuses["/flaky"] = { 503, 0, 200 };
+    script.statuses["/down"] = { 503 };
+    script.statuses["/missing"] = { 404 };
+    script.statuses["/shared"] = { 200 };
+
+    const auto factory = [&script]() -> std::unique_ptr<Corpus::HttpClient>
+    {
+        return std::unique_ptr<Corpus::HttpClient>(new StubClient(script));
+    };
+
+    auto options = Corpus::DownloadPool::Options::defaults();
+    options.workers = 2;
+    options.maxAttempts = 4;
+    options.initialBackoffMs = 20;
+    options.maxBackoffMs = 1000;
+
+    const GUID guid{ 0x11223344, 0x5566, 0x7788, { 1, 2, 3, 4, 5, 6, 7, 8 } };
+    using Status = Corpus::DownloadPool::Status;
+
+    // Retried with backoff until it succeeds, gives up after maxAttempts, 404 isn't retried:
+    {
+        Corpus::DownloadPool pool(factory, options);
+
+        const auto started = std::chrono::steady_clock::now();
+        const auto results = pool.run({
+            { Pe::CodeView::SymbolKey(guid, 1), "/flaky", dir + "/flaky.pdb" },
+            { Pe::CodeView::SymbolKey(guid, 2), "/down", dir + "/down.pdb" },
+            { Pe::CodeView::SymbolKey(guid, 3), "/missing", dir + "/missing.pdb" }
+        });
+        const auto elapsed = std::chrono::steady_clock::now() - started;
+
+        assert((results[0].status == Status::downloaded) && (results[0].attempts == 3));
+        assert(readFile(dir + "/flaky.pdb") == script.body);
+
+        assert((results[1].status == Status::failed) && (results[1].attempts == options.maxAttempts) && (results[1].httpStatus == 503));
+        assert(!exists(dir + "/down.pdb") && !exists(dir + "/down.pdb.partial"));
+
+        assert((results[2].status == Status::notFound) && (results[2].attempts == 1));
+        assert(!exists(dir + "/missing.pdb.partial"));
+
+        // At least the fixed halves of the delays (10, 20 and 40 ms) before the last attempt of "/down":
+        assert(elapsed >= std::chrono::milliseconds(70));
+
+        const auto stats = pool.stats();
+        assert((stats.retries == 2 + 3) && (stats.downloaded == 1) && (stats.failed == 1) && (stats.notFound == 1));
+        tr::unused(results, elapsed, stats);
+    }
+
+    // One request for the submissions of the same key, every destination gets the file:
+    {
+        Corpus::DownloadPool pool(factory, options);
+
+        {
+            const std::lock_guard<std::mutex> lock(script.mutex);
+            script.hold = true;
+        }
+
+        const Pe::CodeView::SymbolKey key(guid, 4);
+        std::vector<std::shared_future<Corpus::DownloadPool::Result>> futures;
+        for (const char* const name : { "/first.pdb", "/second.pdb", "/third.pdb" })
+        {
+            futures.push_back(pool.submit({ key, "/shared", dir + name }));
+        }
+
+        assert(pool.stats().deduplicated == 2);
+
+        {
+            const std::lock_guard<std::mutex> lock(script.mutex);
+            script.hold = false;
+        }
+        script.released.notify_all();
+
+        for (const auto& future : futures)
+        {
+            assert(future.get().status == Status::downloaded);
+        }
+
+        assert(script.calls["/shared"] == 1);
+        for (const char* const name : { "/first.pdb", "/second.pdb", "/third.pdb" })
+        {
+            assert(readFile(dir + name) == script.body);
+            tr::unused(name);
+        }
+    }
+
+    removeTree(dir);
+}
+
+void testHttpSession()
+{
+    using Error = Corpus::HttpClient::Error;
+
+    std::string lastHead;
+    std::mutex headMutex;
+    const auto handler = [&](const std::string& head, const unsigned int index, std::string& response) -> bool
+    {
+        {
+            const std::lock_guard<std::mutex> lock(headMutex);
+            lastHead = head;
+        }
+
+        if (head.find("GET /stale ") == 0)
+        {
+            if (index)
+            {
+                return false; // Closes the kept-alive connection on the next request
+            }
+        }
+        else if (head.find("GET /moved ") == 0)
+        {
+            response = "HTTP/1.1 301 Moved Permanently\r\nLocation: /file\r\nContent-Length: 0\r\n\r\n";
+            return true;
+        }
+        else if (head.find("GET /secure ") == 0)
+        {
+            response = "HTTP/1.1 302 Found\r\nLocation: https://localhost/file\r\nContent-Length: 0\r\n\r\n";
+            return true;
+        }
+        else if (head.find("GET /loop ") == 0)
+        {
+            response = "HTTP/1.1 302 Found\r\nLocation: /loop\r\nContent-Length: 0\r\n\r\n";
+            return true;
+        }
+
+        response = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello";
+        return true;
+    };
+
+    const auto get = [](Corpus::HttpSession& session, const std::string& url, BodySink& sink) -> bool
+    {
+        return session.get(Corpus::HttpClient::Request{ url, 0 }, sink);
+    };
+
+    TestServer server(false, handler);
+    assert(server.valid());
+    const std::string base = "http://127.0.0.1:" + std::to_string(server.port());
+
+    // Sequential requests share one kept-alive connection:
+    {
+        Corpus::HttpSession session;
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+            BodySink sink;
+            const bool received = get(session, base + "/file", sink);
+            assert(received && (sink.response.status == 200) && (sink.body == "hello"));
+            tr::unused(received);
+        }
+
+        assert((session.stats().connects == 1) && (session.stats().reuses == 2) && (session.idleConnections() == 1));
+    }
+    assert(server.accepted() == 1);
+
+    // A pooled connection closed by the server is replaced without failing the request:
+    {
+        Corpus::HttpSession session;
+        BodySink first;
+        BodySink second;
+        const bool received = get(session, base + "/stale", first) && get(session, base + "/stale", second);
+        assert(received && (second.body == "hello"));
+        assert((session.stats().connects == 2) && (session.stats().reuses == 1) && (session.stats().requests == 3));
+        tr::unused(received);
+    }
+
+    // Redirects within the session are followed, the others fail as redirects:
+    {
+        Corpus::HttpSession session;
+
+        BodySink moved;
+        bool received = get(session, base + "/moved", moved);
+        assert(received && (moved.body == "hello") && (session.stats().redirects == 1));
+
+        BodySink secure;
+        received = get(session, base + "/secure", secure);
+        assert(!received && (session.error() == Error::redirect) && !secure.response.status);
+
+        BodySink loop;
+        received = get(session, base + "/loop", loop);
+        assert(!received && (session.error() == Error::redirect));
+
+        BodySink https;
+        received = get(session, "https://127.0.0.1:" + std::to_string(server.port()) + "/file", https);
+        assert(!received && (session.error() == Error::unsupportedUrl));
+        tr::unused(received);
+    }
+
+    // https goes through the TLS layer:
+    {
+        PlainTls tls;
+        auto options = Corpus::HttpSession::Options::defaults();
+        options.tls = &tls;
+
+        Corpus::HttpSession session(options);
+        BodySink sink;
+        const bool received = get(session, "https://localhost:" + std::to_string(server.port()) + "/moved", sink);
+        assert(received && (sink.body == "hello") && (tls.hosts.size() == 1) && (tls.hosts[0] == "localhost"));
+        tr::unused(received);
+    }
+
+    // IPv6 literals are bracketed in the Host header:
+    TestServer server6(true, handler);
+    if (server6.valid())
+    {
+        Corpus::HttpSession session;
+        BodySink sink;
+        const std::string authority = "[::1]:" + std::to_string(server6.port());
+        const bool received = get(session, "http://" + authority + "/file", sink);
+        assert(received && (sink.body == "hello"));
+        assert(lastHead.find("\r\nHost: " + authority + "\r\n") != std::string::npos);
+        tr::unused(received);
+    }
+}
+
+void testResume()
+{
+    const std::string dir = makeTempDir("formatPE.resume");
+    const std::string file = "Microsoft C/C++ MSF 7.00\r\n\x1A" "DS synthetic PDB body";
+
+    // Honours "Range: bytes=N-" with a 206, or a 416 if N is past the end:
+    std::atomic<unsigned int> ranged{ 0 };
+    TestServer server(false, [&](const std::string& head, unsigned int, std::string& response) -> bool
+    {
+        static constexpr char k_range[] = "\r\nRange: bytes=";
+        const auto range = head.find(k_range);
+        if (range == std::string::npos)
+        {
+            response = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(file.size()) + "\r\n\r\n" + file;
+            return true;
+        }
+
+        ++ranged;
+        const auto first = static_cast<size_t>(strtoull(head.c_str() + range + sizeof(k_range) - 1, nullptr, 10));
+        if (first >= file.size())
+        {
+            response = "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" + std::to_string(file.size()) + "\r\nContent-Length: 0\r\n\r\n";
+            return true;
+        }
+
+        response = "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " + std::to_string(first) + "-" + std::to_string(file.size() - 1) + "/" + std::to_string(file.size())
+            + "\r\nContent-Length: " + std::to_string(file.size() - first) + "\r\n\r\n" + file.substr(first);
+        return true;
+    });
+    assert(server.valid());
+
+    // Partial files left by earlier runs: a head, the whole file and a file larger than the one on the server:
+    const bool prepared = writeFile(dir + "/head.pdb.partial", file.data(), 10)
+        && writeFile(dir + "/whole.pdb.partial", file.data(), file.size())
+        && writeFile(dir + "/larger.pdb.partial", (file + "garbage").data(), file.size() + 7);
+    assert(prepared);
+    tr::unused(prepared);
+
+    auto options = Corpus::DownloadPool::Options::defaults();
+    options.workers = 1;
+    options.initialBackoffMs = 1;
+
+    Corpus::DownloadPool pool([]() { return std::unique_ptr<Corpus::HttpClient>(new Corpus::HttpSession()); }, options);
+
+    const GUID guid{ 0x55667788, 0x1122, 0x3344, { 8, 7, 6, 5, 4, 3, 2, 1 } };
+    const std::string url = "http://127.0.0.1:" + std::to_string(server.port()) + "/file.pdb";
+    const auto results = pool.run({
+        { Pe::CodeView::SymbolKey(guid, 1), url, dir + "/head.pdb" },
+        { Pe::CodeView::SymbolKey(guid, 2), url, dir + "/whole.pdb" },
+        { Pe::CodeView::SymbolKey(guid, 3), url, dir + "/larger.pdb" }
+    });
+
+    using Status = Corpus::DownloadPool::Status;
+    for (const auto& result : results)
+    {
+        assert(result.status == Status::downloaded);
+        tr::unused(result);
+    }
+
+    assert((results[0].offset == 10) && (results[0].bytes == file.size() - 10) && (results[0].attempts == 1));
+    assert((results[1].httpStatus == 416) && (results[1].attempts == 1));
+    assert(results[2].attempts == 2); // The 416 with another size starts over
+
+    for (const char* const name : { "/head.pdb", "/whole.pdb", "/larger.pdb" })
+    {
+        assert((readFile(dir + name) == file) && !exists(dir + name + ".partial"));
+        tr::unused(name);
+    }
+
+    assert((ranged == 3) && (pool.stats().resumed == 1));
+
+    removeTree(dir);
+}
+
+int main()
+{
+    testUringReader();
+    testSummaryCache();
+    testSymbolStore();
+    testDownloadPool();
+    testHttpSession();
+    testResume();
+    return 0;
+}
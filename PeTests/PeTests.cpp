@@ -1,8 +1,21 @@
 ﻿#include <Windows.h>
 
 #include <Pe/Pe.hpp>
+#include <Pe/ImportIndex.hpp>
+#include <Pe/ImportCallScanner.hpp>
+#include <Pe/PatternScanner.hpp>
+#include <Pe/StringExtractor.hpp>
+#include <Pe/XrefIndex.hpp>
+#include <Pe/Summary.hpp>
+#include <Pe/Diff.hpp>
+#include <Pe/Embedded.hpp>
+#include <Pe/DirectoryWalk.hpp>
 #include <Pdb/Pdb.h>
 #include <Pdb/SymLoader.h>
+#include <Corpus/SummaryCache.h>
+#include <Corpus/SummaryStore.h>
+#include <Corpus/Columnar.h>
+#include <Corpus/NegativeCache.h>
 
 #include <cstdio>
 #include <cassert>
@@ -11,6 +24,10 @@
 #include <DbgHelp.h>
 
 #include <vector>
+#include <sstream>
+#include <thread>
+#include <iterator>
+#include <type_traits>
 
 namespace tr
 {
@@ -67,6 +84,98 @@ void parsePe(const PeObject& pe)
 
     printf("\n");
 
+    {
+        printf("IAT index:\n");
+        const Pe::ImportIndex<PeObject::k_arch> index(pe);
+        for (const auto& impLib : pe.imports())
+        {
+            for (const auto& fn : impLib)
+            {
+                const Pe::Rva slot = impLib.descriptor()->FirstThunk + fn.index() * sizeof(*fn.importAddressTableEntry());
+                const auto sym = index.find(slot);
+                assert(sym.valid());
+                assert(sym.type() == fn.type());
+                assert(strcmp(sym.moduleName(), impLib.libName()) == 0);
+                if (fn.type() == Pe::ImportType::name)
+                {
+                    assert(sym.name() == fn.name());
+                }
+            }
+        }
+        printf("  %u IAT ranges\n", static_cast<unsigned int>(index.ranges().size()));
+    }
+
+    printf("\n");
+
+    {
+        printf("Import call sites:\n");
+        const Pe::ImportCallScanner<PeObject::k_arch> scanner(pe);
+        scanner.scan([](const auto& site)
+        {
+            const auto* const name = site.symbol.name();
+            if (name)
+            {
+                printf("  0x%X: %s [0x%X] -> %s!%s\n", site.rva, site.jump ? "jmp" : "call", site.slot, site.symbol.moduleName(), name->Name);
+            }
+            else
+            {
+                printf("  0x%X: %s [0x%X] -> %s!#%u\n", site.rva, site.jump ? "jmp" : "call", site.slot, site.symbol.moduleName(), static_cast<unsigned int>(site.symbol.ordinal()));
+            }
+        });
+    }
+
+    printf("\n");
+
+    {
+        printf("Patterns:\n");
+        Pe::PatternSet patterns;
+        const auto syscallId = patterns.add("4C 8B D1 B8 ?? ?? ?? ??"); // mov r10, rcx; mov eax, imm32
+        const auto int3Id = patterns.add("CC CC CC CC CC CC CC CC");
+        assert(syscallId != Pe::PatternSet::k_invalidId);
+        assert(int3Id != Pe::PatternSet::k_invalidId);
+        assert(patterns.add("4C 8B Z1") == Pe::PatternSet::k_invalidId);
+        assert(patterns.add("?? ??") == Pe::PatternSet::k_invalidId);
+
+        const Pe::PatternScanner scanner(patterns);
+        unsigned int counts[2]{};
+        scanner.scan(pe, [](const auto& sec, unsigned int) -> bool
+        {
+            return (sec.Characteristics & IMAGE_SCN_MEM_EXECUTE) != 0;
+        }, [&](const Pe::PatternScanner::Match& match)
+        {
+            assert(pe.sectionData(pe.sections().sections()[match.section]).contains(match.rva));
+            ++counts[match.pattern];
+        });
+
+        printf("  Syscall stubs: %u, int3 paddings: %u\n", counts[syscallId], counts[int3Id]);
+    }
+
+    printf("\n");
+
+    {
+        printf("Strings:\n");
+        const Pe::StringExtractor extractor(8);
+        unsigned int asciiCount = 0;
+        unsigned int utf16Count = 0;
+        extractor.extract(pe, [&](const Pe::StringExtractor::Entry& entry)
+        {
+            assert(entry.length >= extractor.minLength());
+            assert(entry.data == pe.byRva<void>(entry.rva));
+            if (entry.encoding == Pe::StringExtractor::Encoding::ascii)
+            {
+                ++asciiCount;
+            }
+            else
+            {
+                ++utf16Count;
+            }
+        });
+
+        printf("  ASCII: %u, UTF-16LE: %u\n", asciiCount, utf16Count);
+    }
+
+    printf("\n");
+
     {
         const auto exports = pe.exports();
         printf("Exports count %u (0x%X):\n", exports.count(), exports.count());
@@ -177,6 +286,24 @@ void parsePe(const PeObject& pe)
 
     printf("\n");
 
+    {
+        printf("Xrefs:\n");
+        const Pe::XrefIndex<PeObject::k_arch> xrefs(pe);
+        for (size_t i = 0; i < xrefs.targetsCount(); ++i)
+        {
+            const Pe::Rva target = xrefs.targets()[i];
+            const auto sites = xrefs.references(target);
+            assert(sites.size() == xrefs.sitesAt(i).size());
+            if (sites.size() > 16)
+            {
+                printf("  0x%X is referenced %u times\n", target, static_cast<unsigned int>(sites.size()));
+            }
+        }
+        printf("  %u targets, %u sites\n", static_cast<unsigned int>(xrefs.targetsCount()), static_cast<unsigned int>(xrefs.sitesCount()));
+    }
+
+    printf("\n");
+
     {
         printf("Exceptions:\n");
         for (const auto& exception : pe.exceptions())
@@ -237,6 +364,95 @@ void parsePe(const PeObject& pe)
 }
 
 
+std::vector<unsigned char> readFile(const wchar_t* const path)
+{
+    const auto hFile = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        printf("Unable to open the file %ws\n", path);
+        return {};
+    }
+    
+    const auto fileSize = GetFileSize(hFile, nullptr);
+    if (!fileSize)
+    {
+        printf("Unable to size of the file %ws\n", path);
+        CloseHandle(hFile);
+        return {};
+    }
+
+    std::vector<unsigned char> fileBuf(fileSize);
+    unsigned long readBytes = 0;
+    const bool readStatus = !!ReadFile(hFile, &fileBuf[0], fileSize, &readBytes, nullptr);
+    if (!readStatus)
+    {
+        printf("Unable to read the file %ws\n", path);
+        CloseHandle(hFile);
+        return {};
+    }
+
+    CloseHandle(hFile);
+
+    return fileBuf;
+}
+
+
+// Minimal PE32+ file with an export directory, built at compile time for Pe::EmbeddedPe:
+struct EmbeddedImage
+{
+    unsigned char bytes[0x400];
+};
+
+constexpr void put(EmbeddedImage& image, const unsigned int offset, const unsigned long long value, const unsigned int size)
+{
+    for (unsigned int i = 0; i < size; ++i)
+    {
+        image.bytes[offset + i] = static_cast<unsigned char>(value >> (i * 8u));
+    }
+}
+
+constexpr EmbeddedImage makeEmbeddedImage()
+{
+    constexpr unsigned int k_nt = 0x40;
+    constexpr unsigned int k_opt = k_nt + offsetof(IMAGE_NT_HEADERS64, OptionalHeader);
+    constexpr unsigned int k_sec = k_opt + sizeof(IMAGE_OPTIONAL_HEADER64);
+    constexpr unsigned int k_exp = 0x200; // RVA 0x1000
+
+    EmbeddedImage image{};
+    put(image, 0, IMAGE_DOS_SIGNATURE, 2);
+    put(image, offsetof(IMAGE_DOS_HEADER, e_lfanew), k_nt, 4);
+    put(image, k_nt, IMAGE_NT_SIGNATURE, 4);
+    put(image, k_nt + 4 + offsetof(IMAGE_FILE_HEADER, Machine), IMAGE_FILE_MACHINE_AMD64, 2);
+    put(image, k_nt + 4 + offsetof(IMAGE_FILE_HEADER, NumberOfSections), 1, 2);
+    put(image, k_nt + 4 + offsetof(IMAGE_FILE_HEADER, SizeOfOptionalHeader), sizeof(IMAGE_OPTIONAL_HEADER64), 2);
+    put(image, k_opt + offsetof(IMAGE_OPTIONAL_HEADER64, Magic), IMAGE_NT_OPTIONAL_HDR64_MAGIC, 2);
+    put(image, k_opt + offsetof(IMAGE_OPTIONAL_HEADER64, ImageBase), 0x180000000ull, 8);
+    put(image, k_opt + offsetof(IMAGE_OPTIONAL_HEADER64, SectionAlignment), 0x1000, 4);
+    put(image, k_opt + offsetof(IMAGE_OPTIONAL_HEADER64, FileAlignment), 0x200, 4);
+    put(image, k_opt + offsetof(IMAGE_OPTIONAL_HEADER64, NumberOfRvaAndSizes), IMAGE_NUMBEROF_DIRECTORY_ENTRIES, 4);
+    put(image, k_opt + offsetof(IMAGE_OPTIONAL_HEADER64, DataDirectory), 0x1000, 4);
+    put(image, k_opt + offsetof(IMAGE_OPTIONAL_HEADER64, DataDirectory) + 4, 0x60, 4);
+    put(image, k_sec + offsetof(IMAGE_SECTION_HEADER, Name), 0x61746164722Eull, 8); // ".rdata"
+    put(image, k_sec + offsetof(IMAGE_SECTION_HEADER, Misc), 0x200, 4);
+    put(image, k_sec + offsetof(IMAGE_SECTION_HEADER, VirtualAddress), 0x1000, 4);
+    put(image, k_sec + offsetof(IMAGE_SECTION_HEADER, SizeOfRawData), 0x200, 4);
+    put(image, k_sec + offsetof(IMAGE_SECTION_HEADER, PointerToRawData), k_exp, 4);
+    put(image, k_exp + offsetof(IMAGE_EXPORT_DIRECTORY, Base), 1, 4);
+    put(image, k_exp + offsetof(IMAGE_EXPORT_DIRECTORY, NumberOfFunctions), 1, 4);
+    put(image, k_exp + offsetof(IMAGE_EXPORT_DIRECTORY, NumberOfNames), 1, 4);
+    put(image, k_exp + offsetof(IMAGE_EXPORT_DIRECTORY, AddressOfFunctions), 0x1040, 4);
+    put(image, k_exp + offsetof(IMAGE_EXPORT_DIRECTORY, AddressOfNames), 0x1044, 4);
+    put(image, k_exp + offsetof(IMAGE_EXPORT_DIRECTORY, AddressOfNameOrdinals), 0x1048, 4);
+    put(image, k_exp + 0x40, 0x1234, 4); // Entry RVA
+    put(image, k_exp + 0x44, 0x1050, 4); // Name RVA
+    put(image, k_exp + 0x48, 0, 2);      // Unbiased ordinal
+    put(image, k_exp + 0x50, 0x7972746E45ull, 6); // "Entry"
+    return image;
+}
+
+constexpr EmbeddedImage k_embeddedImage = makeEmbeddedImage();
+
+
 void testPe()
 {
     const HMODULE hModule = GetModuleHandleW(L"ntdll.dll");
@@ -257,35 +473,341 @@ void testPe()
         return;
     }
 
-    const auto hFile = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if (hFile == INVALID_HANDLE_VALUE)
+    const auto fileBuf = readFile(path);
+    if (fileBuf.empty())
     {
-        printf("Unable to open the file %ws\n", path);
         return;
     }
-    
-    const auto fileSize = GetFileSize(hFile, nullptr);
-    if (!fileSize)
+
+    const auto filePe = Pe::PeNative::fromFile(&fileBuf[0]);
+
+#ifdef PE_INSTRUMENTATION
+    const Pe::Instrumentation::Scope scope;
+    parsePe(filePe);
+
+    const auto counters = scope.delta();
+    printf("\n\nCounters:\n");
+    for (unsigned int i = 0; i < static_cast<unsigned int>(Pe::Instrumentation::Counter::count); ++i)
     {
-        printf("Unable to size of the file %ws\n", path);
-        CloseHandle(hFile);
-        return;
+        const auto counter = static_cast<Pe::Instrumentation::Counter>(i);
+        printf("  %s: %llu\n", Pe::Instrumentation::name(counter), counters[counter]);
     }
 
-    std::vector<unsigned char> fileBuf(fileSize);
-    unsigned long readBytes = 0;
-    const bool readStatus = !!ReadFile(hFile, &fileBuf[0], fileSize, &readBytes, nullptr);
-    if (!readStatus)
+    assert(counters[Pe::Instrumentation::Counter::byRva] > 0);
+    assert(counters[Pe::Instrumentation::Counter::sectionStep] > 0);
+    assert(counters[Pe::Instrumentation::Counter::importFunctionStep] > 0);
+#else
+    parsePe(filePe);
+#endif // PE_INSTRUMENTATION
+
+
+    printf("\n\nDiff of the file and the module:\n");
+
+    // Only the content of the relocated and written sections may differ:
+    Pe::makeDiff(filePe, modPe).compare([](const Pe::DiffTypes::Change& change)
+    {
+        assert((change.category == Pe::DiffTypes::Category::section) && (change.kind == Pe::DiffTypes::Kind::changed));
+        printf("  Section %.8s changed: 0x%X\n", change.name, change.fields);
+    });
+
+
+    printf("\n\nViews shared across threads:\n");
+
+    static_assert(std::is_trivially_copyable<Pe::PeNative>::value, "Pe must be a value");
+    static_assert(std::is_trivially_copyable<Pe::Imports<Pe::Arch::native>::FunctionEntry>::value, "Entries must be values");
+    static_assert(std::is_trivially_copyable<Pe::Exports<Pe::Arch::native>>::value, "Views must be values");
+
+    // Entries outlive the views and the loops that produced them:
+    std::vector<Pe::Imports<Pe::Arch::native>::FunctionEntry> imports;
+    for (const auto& lib : filePe.imports())
+    {
+        for (const auto& func : lib)
+        {
+            imports.push_back(func);
+        }
+    }
+
+    unsigned int exportsCount = 0;
+    unsigned int importsCount = 0;
+    std::thread exportsWorker([exports = filePe.exports(), &exportsCount]()
+    {
+        for (const auto& func : exports)
+        {
+            exportsCount += func.hasName() ? 1 : 0;
+        }
+    });
+
+    std::thread importsWorker([&imports, &importsCount]()
+    {
+        for (const auto& func : imports)
+        {
+            importsCount += (func.lib().libName() != nullptr) ? 1 : 0;
+        }
+    });
+
+    exportsWorker.join();
+    importsWorker.join();
+
+    assert(importsCount == imports.size());
+    printf("  Named exports: %u, imports: %u\n", exportsCount, importsCount);
+
+
+    printf("\n\nRandom access:\n");
+
+    static_assert(std::is_same<Pe::Exports<Pe::Arch::native>::FunctionIterator::iterator_concept, std::random_access_iterator_tag>::value, "Exports must be random access");
+    static_assert(std::is_same<std::iterator_traits<Pe::Exports<Pe::Arch::native>::FunctionIterator>::iterator_category, std::input_iterator_tag>::value, "Exports yield values, not references");
+    static_assert(std::is_same<std::iterator_traits<Pe::Sections::Iterator>::iterator_category, std::random_access_iterator_tag>::value, "Sections must be random access");
+
+    const auto exports = filePe.exports();
+    const auto exportsTotal = exports.end() - exports.begin();
+    assert(static_cast<unsigned int>(exportsTotal) == exports.count());
+    if (exportsTotal)
+    {
+        const auto middle = exports.begin()[exportsTotal / 2];
+        assert(middle.ordinal() == exports.ordinalBase() + exportsTotal / 2);
+        printf("  Middle export: #%u %s\n", middle.ordinal(), middle.hasName() ? middle.name() : "<no name>");
+    }
+
+    const auto sections = filePe.sections();
+    for (auto sec = std::make_reverse_iterator(sections.end()); sec != std::make_reverse_iterator(sections.begin()); ++sec)
+    {
+        printf("  %.8s\n", reinterpret_cast<const char*>(sec->Name));
+    }
+
+
+    printf("\n\nCompile-time parsing:\n");
+
+    constexpr auto embedded = Pe::EmbeddedPe(k_embeddedImage.bytes);
+    static_assert(embedded.valid() && (embedded.arch() == Pe::Arch::x64), "Invalid embedded image");
+    static_assert(embedded.imageBase() == 0x180000000ull, "Wrong image base");
+    static_assert(embedded.section(0).name[1] == 'r', "Wrong section");
+
+    constexpr auto entry = embedded.findExport("Entry");
+    static_assert(entry.found() && (entry.rva == 0x1234) && (entry.ordinal == 1), "Export not found");
+    static_assert(!embedded.findExport("Entr").found(), "Unexpected export");
+
+    const auto runtime = Pe::Pe64::fromFile(k_embeddedImage.bytes).exports().find("Entry");
+    assert(runtime.ordinal() == entry.ordinal);
+    printf("  Entry: RVA 0x%X, #%u\n", entry.rva, entry.ordinal);
+
+
+    printf("\n\nArchitecture visitor:\n");
+
+    const auto anyPe = Pe::PeAny::fromFile(&fileBuf[0]);
+    assert(anyPe.arch() == Pe::Arch::native);
+
+    const auto visitedExports = Pe::visit(&fileBuf[0], [](const auto& pe)
+    {
+        return pe.exports().count();
+    });
+    assert(visitedExports == filePe.exports().count());
+
+    const char junk[sizeof(IMAGE_DOS_HEADER)]{};
+    assert(!Pe::PeAny::fromFile(junk).valid() && (Pe::visit(junk, [](const auto& pe) { return pe.exports().count(); }) == 0));
+    printf("  Exports: %u\n", visitedExports);
+
+
+    printf("\n\nDirectories in the file order:\n");
+
+    unsigned long long lastPosition = 0;
+    Pe::makeDirectoryWalk(filePe).walk([&lastPosition](const Pe::DirectoryExtent& extent, const auto& view)
+    {
+        static_cast<void>(view);
+        assert(extent.position >= lastPosition);
+        lastPosition = extent.position;
+        printf("  #%u at 0x%llX, %u bytes\n", extent.id, extent.position, extent.size);
+    });
+
+
+    printf("\n\nDebug data:\n");
+
+    const auto fileDebug = filePe.debug();
+    const auto modPogo = modPe.debug().pogo();
+    const auto filePogo = fileDebug.pogo();
+    assert(filePogo.signature() == modPogo.signature());
+
+    auto modRecord = modPogo.begin();
+    for (const auto& record : filePogo)
+    {
+        assert((modRecord != modPogo.end()) && (modRecord->rva() == record.rva()));
+        ++modRecord;
+        printf("  POGO 0x%08X..0x%08X %s\n", record.rva(), record.rva() + record.size(), record.name());
+    }
+    assert(modRecord == modPogo.end());
+
+    if (const auto* const features = fileDebug.vcFeature())
+    {
+        printf("  C/C++: %u, /GS: %u, /sdl: %u, guardN: %u\n", features->cAndCpp, features->gs, features->sdl, features->guardN);
+    }
+
+    if (const auto* const exFlags = fileDebug.exDllCharacteristics())
+    {
+        printf("  CET compatible: %u\n", exFlags->flags & Pe::DebugData::ExDllCharacteristics::cetCompat);
+    }
+
+    printf("  ILTCG: %u, repro hash: %u bytes\n", fileDebug.iltcg(), fileDebug.repro().size());
+
+    const auto pdb = fileDebug.pdbIdentity();
+    assert(pdb.valid() && (strcmp(pdb.key, modPe.debug().pdbIdentity().key) == 0));
+    const auto pdbNameLength = static_cast<int>(pdb.pdbNameLength());
+    printf("  PDB: %.*s/%s/%.*s\n", pdbNameLength, pdb.pdbName(), pdb.key, pdbNameLength, pdb.pdbName());
+}
+
+
+void testClr()
+{
+    const auto fileBuf = readFile(L"C:\\Windows\\Microsoft.NET\\Framework\\v4.0.30319\\System.dll");
+    if (fileBuf.empty())
     {
-        printf("Unable to read the file %ws\n", path);
-        CloseHandle(hFile);
         return;
     }
 
-    CloseHandle(hFile);
+    const auto pe = Pe::Pe32::fromFile(&fileBuf[0]);
+    assert(pe.valid());
 
-    const auto filePe = Pe::PeNative::fromFile(&fileBuf[0]);
-    parsePe(filePe);
+    const auto clr = pe.clr();
+    assert(clr.valid());
+
+    printf("CLR metadata %s:\n", clr.runtimeVersion());
+
+    const auto typeDefs = clr.typeDefs();
+    printf("  TypeDefs: %u\n", typeDefs.count());
+    for (const auto& typeDef : typeDefs)
+    {
+        const auto extends = typeDef.extends();
+        printf("    %s.%s (extends %u:%u, methods from %u)\n", typeDef.namespaceName(), typeDef.name(), static_cast<unsigned int>(extends.table), extends.rid, typeDef.methodList());
+    }
+
+    const auto methodDefs = clr.methodDefs();
+    printf("  MethodDefs: %u\n", methodDefs.count());
+    for (const auto& methodDef : methodDefs)
+    {
+        printf("    %s at 0x%X\n", methodDef.name(), methodDef.rva());
+    }
+
+    const auto memberRefs = clr.memberRefs();
+    printf("  MemberRefs: %u\n", memberRefs.count());
+    if (!memberRefs.empty())
+    {
+        // Random access without enumeration of previous rows:
+        const auto last = clr.memberRef(memberRefs.count() - 1);
+        const auto parent = last.parent();
+        assert(parent.valid());
+        printf("    Last: %s (parent %u:%u)\n", last.name(), static_cast<unsigned int>(parent.table), parent.rid);
+    }
+}
+
+
+void testCorpus()
+{
+    char cachePath[MAX_PATH]{};
+    GetTempPathA(static_cast<unsigned int>(std::size(cachePath)), cachePath);
+    strcat_s(cachePath, "formatPE.cache");
+    DeleteFileA(cachePath);
+
+    const char* const path = "C:\\Windows\\System32\\ntdll.dll";
+
+    Pe::Summary parsed{};
+    {
+        Corpus::SummaryCache cache(cachePath);
+        assert(cache.valid());
+
+        const bool status = cache.get(path, parsed);
+        assert(status && (cache.stats().misses == 1));
+    }
+
+    // Answered from the storage without parsing:
+    Corpus::SummaryCache cache(cachePath);
+    assert(cache.size() == 1);
+
+    Pe::Summary cached{};
+    const bool status = cache.get(path, cached);
+    assert(status && (cache.stats().hits == 1));
+    assert(cached.exports.size() == parsed.exports.size());
+    assert(cached.debug.pdbPath == parsed.debug.pdbPath);
+
+    printf("Summary of %s: %zu sections, %zu imported modules, %zu exports, PDB '%s'\n",
+        path, cached.sections.size(), cached.imports.size(), cached.exports.size(), cached.debug.pdbPath.c_str());
+
+    // Fixed-layout storage:
+    Corpus::Store::Writer writer;
+    writer.add(path, cached);
+
+    std::ostringstream stream;
+    const bool written = writer.write(stream);
+    assert(written);
+
+    const auto storage = stream.str();
+    std::vector<unsigned long long> aligned((storage.size() + sizeof(unsigned long long) - 1) / sizeof(unsigned long long));
+    memcpy(aligned.data(), storage.data(), storage.size());
+
+    const Corpus::Store::View view(aligned.data(), storage.size());
+    assert(view.valid());
+
+    const auto* const image = view.find(path);
+    assert(image && (view.exports(*image).count() == cached.exports.size()));
+    for (const auto& module : view.importModules(*image))
+    {
+        printf("  %s: %u functions\n", view.string(module.name), view.importFunctions(module).count());
+    }
+
+    // Columnar export and a query over the only needed columns:
+    std::ostringstream columnarStream;
+    Corpus::Columnar::Writer columnar(columnarStream, 256);
+    columnar.add("ntdll.dll", Pe::PeNative::fromModule(GetModuleHandleW(L"ntdll.dll")));
+    columnar.add("PeTests.exe", Pe::PeNative::fromModule(GetModuleHandleW(nullptr)));
+    const bool finished = columnar.finish();
+    assert(finished);
+
+    const auto columnarData = columnarStream.str();
+    std::vector<unsigned long long> columnarAligned((columnarData.size() + sizeof(unsigned long long) - 1) / sizeof(unsigned long long));
+    memcpy(columnarAligned.data(), columnarData.data(), columnarData.size());
+
+    const Corpus::Columnar::Reader reader(columnarAligned.data(), columnarData.size());
+    assert(reader.valid());
+
+    unsigned int function = 0;
+    const bool found = reader.findString("GetModuleHandleW", function);
+    assert(found);
+
+    for (const auto& group : reader.rowGroups())
+    {
+        if (group.table != Corpus::Columnar::Table::imports)
+        {
+            continue;
+        }
+
+        const auto* const functions = reader.column<unsigned int>(group, Corpus::Columnar::Columns::Imports::function);
+        const auto* const images = reader.column<unsigned int>(group, Corpus::Columnar::Columns::Imports::image);
+        assert(functions && images);
+        for (unsigned int i = 0; i < group.rows; ++i)
+        {
+            if (functions[i] == function)
+            {
+                printf("  Image #%u imports GetModuleHandleW\n", images[i]);
+            }
+        }
+    }
+
+    // Negative cache of the missing symbols survives a restart:
+    char negativePath[MAX_PATH]{};
+    GetTempPathA(static_cast<unsigned int>(std::size(negativePath)), negativePath);
+    strcat_s(negativePath, "formatPE.negative");
+    DeleteFileA(negativePath);
+
+    const Pe::CodeView::SymbolKey missingKey(0x12345678u, 1u);
+    {
+        Corpus::NegativeCache negative(negativePath, std::chrono::hours(24));
+        assert(negative.valid() && !negative.missing(missingKey));
+        negative.store(missingKey);
+    }
+
+    Corpus::NegativeCache negative(negativePath, std::chrono::hours(24));
+    assert(negative.missing(missingKey) && (negative.stats(missingKey).hits == 1));
+
+    // Keys that expired more than a TTL ago are dropped by the compaction:
+    const bool compacted = negative.compact(Corpus::NegativeCache::Clock::now() + std::chrono::hours(48));
+    assert(compacted && !negative.size() && !negative.missing(missingKey));
 }
 
 
@@ -375,6 +897,17 @@ void testPdb()
         const auto pdbInfo = prov.getPdbInfo(exePath.c_str());
         printf("CodeView PDB Path: '%ws'\n", pdbInfo.pdbPath().c_str());
 
+        const auto exeBuf = readFile(exePath.c_str());
+        if (!exeBuf.empty())
+        {
+            const auto identity = Pe::PeNative::fromFile(&exeBuf[0]).debug().pdbIdentity();
+            assert(identity.symbolKey() == pdbInfo.key());
+
+            wchar_t sig[Pe::CodeView::SymbolKey::k_maxLength + 1]{};
+            identity.symbolKey().format(sig);
+            assert(pdbInfo.pdbSig() == sig);
+        }
+
         const auto url = std::wstring(Pdb::Prov::k_microsoftSymbolServerSecure) + L"/" + pdbInfo.pdbUrl();
         const std::wstring symFolder = L"C:\\Symbols\\";
         
@@ -481,6 +1014,8 @@ void testPdb()
 int main()
 {
     testPe();
+    testClr();
+    testCorpus();
     testPdb();
     return 0;
 }
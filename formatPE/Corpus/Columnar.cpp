@@ -0,0 +1,497 @@
+#include "Columnar.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+
+constexpr unsigned long long k_alignment = 8;
+
+struct FileHeader
+{
+    unsigned int magic;
+    unsigned short version;
+    unsigned short reserved;
+};
+
+struct Trailer
+{
+    unsigned long long footerOffset;
+    unsigned int version;
+    unsigned int magic;
+};
+
+class FooterReader
+{
+private:
+    const unsigned char* m_pos;
+    const unsigned char* const m_end;
+    bool m_valid;
+
+public:
+    FooterReader(const unsigned char* const begin, const unsigned char* const end) noexcept : m_pos(begin), m_end(end), m_valid(true)
+    {
+    }
+
+    bool valid() const noexcept
+    {
+        return m_valid;
+    }
+
+    template <typename Type>
+    Type pod() noexcept
+    {
+        Type value{};
+        if (!m_valid || (static_cast<size_t>(m_end - m_pos) < sizeof(value)))
+        {
+            m_valid = false;
+            return value;
+        }
+
+        memcpy(&value, m_pos, sizeof(value));
+        m_pos += sizeof(value);
+        return value;
+    }
+
+    void skip(const size_t size) noexcept
+    {
+        if (!m_valid || (static_cast<size_t>(m_end - m_pos) < size))
+        {
+            m_valid = false;
+            return;
+        }
+
+        m_pos += size;
+    }
+};
+
+} // namespace
+
+
+namespace Corpus
+{
+namespace Columnar
+{
+
+Writer::Writer(std::ostream& stream, const unsigned int rowGroupRows)
+    : m_stream(stream)
+    , m_offset(0)
+    , m_rowGroupRows(rowGroupRows ? rowGroupRows : k_defaultRowGroupRows)
+    , m_status(true)
+    , m_finished(false)
+    , m_images(0)
+    , m_tables{}
+    , m_pendingFirstId(1)
+{
+    for (size_t i = 0; i < static_cast<size_t>(Table::count); ++i)
+    {
+        m_tables[i].columns.resize(schema(static_cast<Table>(i)).count);
+    }
+
+    const FileHeader header{ k_magic, k_version, 0 };
+    write(&header, sizeof(header));
+}
+
+bool Writer::write(const void* const data, const size_t size)
+{
+    if (!m_status)
+    {
+        return false;
+    }
+
+    m_stream.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    m_offset += size;
+    m_status = !!m_stream;
+    return m_status;
+}
+
+bool Writer::align()
+{
+    static const char k_zeros[k_alignment]{};
+    const auto padding = static_cast<size_t>((k_alignment - (m_offset % k_alignment)) % k_alignment);
+    return write(k_zeros, padding);
+}
+
+bool Writer::flushDictionary()
+{
+    if (m_pendingOffsets.empty())
+    {
+        return m_status;
+    }
+
+    align();
+
+    const auto count = static_cast<unsigned int>(m_pendingOffsets.size());
+    m_dictionaryBlocks.push_back(DictionaryBlockInfo{ m_offset, m_pendingFirstId, count });
+
+    m_pendingOffsets.push_back(static_cast<unsigned int>(m_pendingChars.size()));
+    write(&count, sizeof(count));
+    write(m_pendingOffsets.data(), m_pendingOffsets.size() * sizeof(unsigned int));
+    write(m_pendingChars.data(), m_pendingChars.size());
+
+    m_pendingFirstId += count;
+    m_pendingOffsets.clear();
+    m_pendingChars.clear();
+
+    return m_status;
+}
+
+bool Writer::flushTable(const Table table)
+{
+    auto& buffer = m_tables[static_cast<size_t>(table)];
+    if (!buffer.rows)
+    {
+        return m_status;
+    }
+
+    // Strings used by the rows must be readable before the rows:
+    flushDictionary();
+
+    RowGroupInfo group{ table, buffer.rows, buffer.totalRows, {} };
+    group.chunks.reserve(buffer.columns.size());
+    for (auto& column : buffer.columns)
+    {
+        align();
+        group.chunks.push_back(Chunk{ m_offset, column.size() });
+        write(column.data(), column.size());
+        column.clear();
+    }
+
+    m_rowGroups.emplace_back(std::move(group));
+    buffer.totalRows += buffer.rows;
+    buffer.rows = 0;
+
+    return m_status;
+}
+
+unsigned int Writer::intern(const char* const str, const size_t length)
+{
+    if (!str || !length)
+    {
+        return 0;
+    }
+
+    std::string key(str, length);
+    const auto it = m_dictionary.find(key);
+    if (it != m_dictionary.end())
+    {
+        return it->second;
+    }
+
+    const auto id = m_pendingFirstId + static_cast<unsigned int>(m_pendingOffsets.size());
+    m_pendingOffsets.push_back(static_cast<unsigned int>(m_pendingChars.size()));
+    m_pendingChars.insert(m_pendingChars.end(), str, str + length);
+    m_pendingChars.push_back('\0');
+    m_dictionary.emplace(std::move(key), id);
+
+    if (m_pendingChars.size() >= k_dictionaryBlockSize)
+    {
+        flushDictionary();
+    }
+
+    return id;
+}
+
+unsigned int Writer::intern(const char* const str)
+{
+    return str ? intern(str, strlen(str)) : 0;
+}
+
+void Writer::endRow(const Table table)
+{
+    auto& buffer = m_tables[static_cast<size_t>(table)];
+    if (++buffer.rows >= m_rowGroupRows)
+    {
+        flushTable(table);
+    }
+}
+
+bool Writer::finish()
+{
+    if (m_finished)
+    {
+        return m_status;
+    }
+
+    m_finished = true;
+
+    for (size_t i = 0; i < static_cast<size_t>(Table::count); ++i)
+    {
+        flushTable(static_cast<Table>(i));
+    }
+
+    flushDictionary();
+    align();
+
+    const unsigned long long footerOffset = m_offset;
+
+    const auto tableCount = static_cast<unsigned int>(Table::count);
+    write(&tableCount, sizeof(tableCount));
+    for (unsigned int i = 0; i < tableCount; ++i)
+    {
+        const auto& table = schema(static_cast<Table>(i));
+        const auto columnCount = static_cast<unsigned char>(table.count);
+        write(&columnCount, sizeof(columnCount));
+        for (unsigned int col = 0; col < table.count; ++col)
+        {
+            const auto type = static_cast<unsigned char>(table.columns[col].type);
+            const auto nameLength = static_cast<unsigned char>(strlen(table.columns[col].name));
+            write(&type, sizeof(type));
+            write(&nameLength, sizeof(nameLength));
+            write(table.columns[col].name, nameLength);
+        }
+    }
+
+    const auto dictionaryBlocks = static_cast<unsigned int>(m_dictionaryBlocks.size());
+    write(&dictionaryBlocks, sizeof(dictionaryBlocks));
+    for (const auto& block : m_dictionaryBlocks)
+    {
+        write(&block.offset, sizeof(block.offset));
+        write(&block.firstId, sizeof(block.firstId));
+        write(&block.count, sizeof(block.count));
+    }
+
+    const auto rowGroups = static_cast<unsigned int>(m_rowGroups.size());
+    write(&rowGroups, sizeof(rowGroups));
+    for (const auto& group : m_rowGroups)
+    {
+        const auto table = static_cast<unsigned char>(group.table);
+        const auto columnCount = static_cast<unsigned char>(group.chunks.size());
+        const unsigned short reserved = 0;
+        write(&table, sizeof(table));
+        write(&columnCount, sizeof(columnCount));
+        write(&reserved, sizeof(reserved));
+        write(&group.rows, sizeof(group.rows));
+        write(&group.firstRow, sizeof(group.firstRow));
+        for (const auto& chunk : group.chunks)
+        {
+            write(&chunk.offset, sizeof(chunk.offset));
+            write(&chunk.size, sizeof(chunk.size));
+        }
+    }
+
+    const Trailer trailer{ footerOffset, k_version, k_magic };
+    write(&trailer, sizeof(trailer));
+
+    m_stream.flush();
+    return m_status && !!m_stream;
+}
+
+bool Writer::valid() const noexcept
+{
+    return m_status;
+}
+
+unsigned int Writer::images() const noexcept
+{
+    return m_images;
+}
+
+
+
+Reader::Reader(const void* const data, const size_t size)
+    : m_data(static_cast<const unsigned char*>(data)), m_size(size), m_strings(0)
+{
+    if (!parse())
+    {
+        m_data = nullptr;
+        m_size = 0;
+        for (auto& types : m_types)
+        {
+            types.clear();
+        }
+        m_dictionary.clear();
+        m_rowGroups.clear();
+        m_strings = 0;
+    }
+}
+
+bool Reader::parse()
+{
+    if (!m_data || (m_size < sizeof(FileHeader) + sizeof(Trailer)) || (reinterpret_cast<size_t>(m_data) % k_alignment))
+    {
+        return false;
+    }
+
+    FileHeader header{};
+    Trailer trailer{};
+    memcpy(&header, m_data, sizeof(header));
+    memcpy(&trailer, m_data + m_size - sizeof(trailer), sizeof(trailer));
+    if ((header.magic != k_magic) || (header.version != k_version) || (trailer.magic != k_magic) || (trailer.version != k_version))
+    {
+        return false;
+    }
+
+    const size_t footerEnd = m_size - sizeof(trailer);
+    if ((trailer.footerOffset < sizeof(header)) || (trailer.footerOffset > footerEnd))
+    {
+        return false;
+    }
+
+    const auto dataEnd = trailer.footerOffset; // Chunks and dictionaries are before the footer
+    FooterReader footer(m_data + trailer.footerOffset, m_data + footerEnd);
+
+    const auto tableCount = footer.pod<unsigned int>();
+    for (unsigned int i = 0; footer.valid() && (i < tableCount); ++i)
+    {
+        const auto columnCount = footer.pod<unsigned char>();
+        for (unsigned int col = 0; footer.valid() && (col < columnCount); ++col)
+        {
+            const auto type = footer.pod<unsigned char>();
+            footer.skip(footer.pod<unsigned char>()); // Name
+            if (type > static_cast<unsigned char>(Type::guid))
+            {
+                return false;
+            }
+
+            if (i < static_cast<unsigned int>(Table::count))
+            {
+                m_types[i].push_back(static_cast<Type>(type));
+            }
+        }
+    }
+
+    unsigned int nextId = 1;
+    const auto dictionaryBlocks = footer.pod<unsigned int>();
+    for (unsigned int i = 0; footer.valid() && (i < dictionaryBlocks); ++i)
+    {
+        const auto offset = footer.pod<unsigned long long>();
+        const auto firstId = footer.pod<unsigned int>();
+        const auto count = footer.pod<unsigned int>();
+        if (!footer.valid() || (firstId != nextId) || (offset % sizeof(unsigned int)) || (offset > dataEnd))
+        {
+            return false;
+        }
+
+        const unsigned long long indexSize = sizeof(unsigned int) + (static_cast<unsigned long long>(count) + 1) * sizeof(unsigned int);
+        if (indexSize > dataEnd - offset)
+        {
+            return false;
+        }
+
+        unsigned int storedCount = 0;
+        memcpy(&storedCount, m_data + offset, sizeof(storedCount));
+
+        const auto* const offsets = reinterpret_cast<const unsigned int*>(m_data + offset + sizeof(unsigned int));
+        const auto charsSize = offsets[count];
+        if ((storedCount != count) || !charsSize || (charsSize > dataEnd - offset - indexSize))
+        {
+            return false;
+        }
+
+        // Every string starts inside the block and the block ends with a terminator:
+        const auto* const chars = reinterpret_cast<const char*>(m_data + offset + indexSize);
+        if (chars[charsSize - 1])
+        {
+            return false;
+        }
+
+        for (unsigned int id = 0; id < count; ++id)
+        {
+            if (offsets[id] >= charsSize)
+            {
+                return false;
+            }
+        }
+
+        m_dictionary.push_back(DictionaryBlock{ firstId, count, offsets, chars });
+        nextId += count;
+    }
+
+    m_strings = nextId;
+
+    const auto rowGroups = footer.pod<unsigned int>();
+    for (unsigned int i = 0; footer.valid() && (i < rowGroups); ++i)
+    {
+        RowGroup group{};
+        const auto table = footer.pod<unsigned char>();
+        const auto columnCount = footer.pod<unsigned char>();
+        footer.skip(sizeof(unsigned short));
+        group.table = static_cast<Table>(table);
+        group.rows = footer.pod<unsigned int>();
+        group.firstRow = footer.pod<unsigned long long>();
+
+        for (unsigned int col = 0; footer.valid() && (col < columnCount); ++col)
+        {
+            const auto offset = footer.pod<unsigned long long>();
+            const auto size = footer.pod<unsigned long long>();
+            if ((offset % k_alignment) || (offset > dataEnd) || (size > dataEnd - offset))
+            {
+                return false;
+            }
+
+            group.columns.push_back(Chunk{ m_data + offset, size });
+        }
+
+        if (footer.valid() && (table < static_cast<unsigned char>(Table::count)))
+        {
+            m_rowGroups.emplace_back(std::move(group));
+        }
+    }
+
+    return footer.valid();
+}
+
+bool Reader::valid() const noexcept
+{
+    return m_data != nullptr;
+}
+
+const std::vector<Reader::RowGroup>& Reader::rowGroups() const noexcept
+{
+    return m_rowGroups;
+}
+
+unsigned int Reader::stringCount() const noexcept
+{
+    return m_strings;
+}
+
+const char* Reader::string(const unsigned int id) const noexcept
+{
+    if (!id)
+    {
+        return "";
+    }
+
+    const auto block = std::upper_bound(m_dictionary.cbegin(), m_dictionary.cend(), id, [](const unsigned int value, const DictionaryBlock& entry)
+    {
+        return value < entry.firstId;
+    });
+
+    if (block == m_dictionary.cbegin())
+    {
+        return nullptr;
+    }
+
+    const auto& entry = *(block - 1);
+    const auto index = id - entry.firstId;
+    return (index < entry.count) ? (entry.chars + entry.offsets[index]) : nullptr;
+}
+
+bool Reader::findString(const char* const str, unsigned int& id) const noexcept
+{
+    if (!str || !*str)
+    {
+        id = 0;
+        return true;
+    }
+
+    for (const auto& block : m_dictionary)
+    {
+        for (unsigned int i = 0; i < block.count; ++i)
+        {
+            if (strcmp(block.chars + block.offsets[i], str) == 0)
+            {
+                id = block.firstId + i;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+} // namespace Columnar
+} // namespace Corpus
@@ -0,0 +1,470 @@
+#pragma once
+
+#include <Pe/Summary.hpp>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <ostream>
+
+namespace Corpus
+{
+namespace Columnar
+{
+
+
+
+//
+// Columnar storage of the corpus metadata for analytics:
+// every table is split into row groups, and every row group stores each column as a separate contiguous chunk,
+// so a query like "which images import X" reads only the module and function name columns of the imports table.
+// Strings are dictionary-encoded: columns keep 32-bit ids, the dictionary is shared by all tables and columns.
+//
+//   "PECL" version
+//   [Dictionary block | Row group]...  - in order of writing, a dictionary block precedes the row groups using it
+//   Footer                             - schema, dictionary blocks and row groups with offsets of every column chunk
+//   Footer offset, "PECL"
+//
+// All chunks are aligned to 8 bytes, integers are little-endian.
+//
+
+constexpr unsigned int k_magic = 0x4C434550u; // "PECL"
+constexpr unsigned short k_version = 1;
+
+enum class Table : unsigned char
+{
+    images,
+    sections,
+    imports,  // One row per imported function
+    exports,
+    count
+};
+
+enum class Type : unsigned char
+{
+    u8,
+    u16,
+    u32,
+    u64,
+    string, // 32-bit id in the dictionary, zero is the empty string
+    guid
+};
+
+constexpr unsigned int typeSize(const Type type) noexcept
+{
+    return (type == Type::u8) ? 1
+        : (type == Type::u16) ? 2
+        : ((type == Type::u32) || (type == Type::string)) ? 4
+        : (type == Type::u64) ? 8
+        : 16;
+}
+
+namespace Columns
+{
+    enum class Images : unsigned char
+    {
+        path,
+        machine,
+        characteristics,
+        timestamp,
+        imageBase,
+        imageSize,
+        entryPoint,
+        subsystem,
+        dllCharacteristics,
+        pdbGuid,
+        pdbAge,
+        pdbPath,
+        count
+    };
+
+    enum class Sections : unsigned char
+    {
+        image,
+        name,
+        rva,
+        virtualSize,
+        rawSize,
+        characteristics,
+        count
+    };
+
+    enum class Imports : unsigned char
+    {
+        image,
+        module,
+        function, // Empty if imported by ordinal
+        ordinal,  // Zero if imported by name
+        delayed,
+        count
+    };
+
+    enum class Exports : unsigned char
+    {
+        image,
+        name,
+        ordinal,
+        rva,      // Zero for forwarders
+        forwarder,
+        count
+    };
+} // namespace Columns
+
+struct ColumnSchema
+{
+    const char* name;
+    Type type;
+};
+
+struct TableSchema
+{
+    const char* name;
+    const ColumnSchema* columns;
+    unsigned int count;
+};
+
+inline const TableSchema& schema(const Table table) noexcept
+{
+    static const ColumnSchema k_images[] = {
+        { "path", Type::string },
+        { "machine", Type::u16 },
+        { "characteristics", Type::u16 },
+        { "timestamp", Type::u32 },
+        { "imageBase", Type::u64 },
+        { "imageSize", Type::u32 },
+        { "entryPoint", Type::u32 },
+        { "subsystem", Type::u16 },
+        { "dllCharacteristics", Type::u16 },
+        { "pdbGuid", Type::guid },
+        { "pdbAge", Type::u32 },
+        { "pdbPath", Type::string }
+    };
+
+    static const ColumnSchema k_sections[] = {
+        { "image", Type::u32 },
+        { "name", Type::string },
+        { "rva", Type::u32 },
+        { "virtualSize", Type::u32 },
+        { "rawSize", Type::u32 },
+        { "characteristics", Type::u32 }
+    };
+
+    static const ColumnSchema k_imports[] = {
+        { "image", Type::u32 },
+        { "module", Type::string },
+        { "function", Type::string },
+        { "ordinal", Type::u16 },
+        { "delayed", Type::u8 }
+    };
+
+    static const ColumnSchema k_exports[] = {
+        { "image", Type::u32 },
+        { "name", Type::string },
+        { "ordinal", Type::u32 },
+        { "rva", Type::u32 },
+        { "forwarder", Type::string }
+    };
+
+    static_assert(sizeof(k_images) / sizeof(*k_images) == static_cast<size_t>(Columns::Images::count), "Schema mismatch");
+    static_assert(sizeof(k_sections) / sizeof(*k_sections) == static_cast<size_t>(Columns::Sections::count), "Schema mismatch");
+    static_assert(sizeof(k_imports) / sizeof(*k_imports) == static_cast<size_t>(Columns::Imports::count), "Schema mismatch");
+    static_assert(sizeof(k_exports) / sizeof(*k_exports) == static_cast<size_t>(Columns::Exports::count), "Schema mismatch");
+
+    static const TableSchema k_tables[] = {
+        { "images", k_images, static_cast<unsigned int>(Columns::Images::count) },
+        { "sections", k_sections, static_cast<unsigned int>(Columns::Sections::count) },
+        { "imports", k_imports, static_cast<unsigned int>(Columns::Imports::count) },
+        { "exports", k_exports, static_cast<unsigned int>(Columns::Exports::count) }
+    };
+
+    return k_tables[static_cast<size_t>(table)];
+}
+
+
+
+//
+// Streaming writer: rows are buffered per table and written out as a row group when it is full,
+// so the memory is bounded by the row group size, the footer index and the set of distinct strings.
+// Not thread-safe.
+//
+
+class Writer
+{
+public:
+    static constexpr unsigned int k_defaultRowGroupRows = 65536;
+    static constexpr size_t k_dictionaryBlockSize = 1024 * 1024; // Pending dictionary chars before they are flushed
+
+private:
+    struct TableBuffer
+    {
+        std::vector<std::vector<unsigned char>> columns;
+        unsigned int rows;
+        unsigned long long totalRows;
+    };
+
+    struct Chunk
+    {
+        unsigned long long offset;
+        unsigned long long size;
+    };
+
+    struct RowGroupInfo
+    {
+        Table table;
+        unsigned int rows;
+        unsigned long long firstRow;
+        std::vector<Chunk> chunks;
+    };
+
+    struct DictionaryBlockInfo
+    {
+        unsigned long long offset;
+        unsigned int firstId;
+        unsigned int count;
+    };
+
+private:
+    std::ostream& m_stream;
+    unsigned long long m_offset;
+    unsigned int m_rowGroupRows;
+    bool m_status;
+    bool m_finished;
+    unsigned int m_images;
+
+    TableBuffer m_tables[static_cast<size_t>(Table::count)];
+
+    std::unordered_map<std::string, unsigned int> m_dictionary;
+    unsigned int m_pendingFirstId;
+    std::vector<unsigned int> m_pendingOffsets;
+    std::vector<char> m_pendingChars;
+
+    std::vector<DictionaryBlockInfo> m_dictionaryBlocks;
+    std::vector<RowGroupInfo> m_rowGroups;
+
+private:
+    bool write(const void* data, size_t size);
+    bool align();
+    bool flushDictionary();
+    bool flushTable(Table table);
+
+    unsigned int intern(const char* str, size_t length);
+    unsigned int intern(const char* str);
+
+    template <typename ColumnId, typename Value>
+    void put(const Table table, const ColumnId column, const Value& value)
+    {
+        auto& data = m_tables[static_cast<size_t>(table)].columns[static_cast<size_t>(column)];
+        const auto* const bytes = reinterpret_cast<const unsigned char*>(&value);
+        data.insert(data.end(), bytes, bytes + sizeof(value));
+    }
+
+    void endRow(Table table);
+
+public:
+    explicit Writer(std::ostream& stream, unsigned int rowGroupRows = k_defaultRowGroupRows);
+
+    Writer(const Writer&) = delete;
+    Writer& operator = (const Writer&) = delete;
+
+    // Appends the image and all its sections, imports and exports, returns the image id:
+    template <Pe::Arch arch>
+    unsigned int add(const char* const path, const Pe::Pe<arch>& pe)
+    {
+        const unsigned int image = m_images++;
+
+        const auto headers = pe.headers();
+        const auto* const fileHdr = &headers.nt()->FileHeader;
+        const auto* const optHdr = headers.opt();
+        const auto debug = Pe::Summary::debugIdentity(pe);
+
+        put(Table::images, Columns::Images::path, intern(path));
+        put(Table::images, Columns::Images::machine, fileHdr->Machine);
+        put(Table::images, Columns::Images::characteristics, fileHdr->Characteristics);
+        put(Table::images, Columns::Images::timestamp, static_cast<unsigned int>(fileHdr->TimeDateStamp));
+        put(Table::images, Columns::Images::imageBase, static_cast<unsigned long long>(optHdr->ImageBase));
+        put(Table::images, Columns::Images::imageSize, static_cast<unsigned int>(optHdr->SizeOfImage));
+        put(Table::images, Columns::Images::entryPoint, static_cast<unsigned int>(optHdr->AddressOfEntryPoint));
+        put(Table::images, Columns::Images::subsystem, optHdr->Subsystem);
+        put(Table::images, Columns::Images::dllCharacteristics, optHdr->DllCharacteristics);
+        put(Table::images, Columns::Images::pdbGuid, debug.guid);
+        put(Table::images, Columns::Images::pdbAge, debug.age);
+        put(Table::images, Columns::Images::pdbPath, intern(debug.pdbPath.c_str(), debug.pdbPath.size()));
+        endRow(Table::images);
+
+        for (const auto& sec : pe.sections())
+        {
+            size_t nameLength = 0;
+            while ((nameLength < sizeof(sec.Name)) && sec.Name[nameLength])
+            {
+                ++nameLength;
+            }
+
+            put(Table::sections, Columns::Sections::image, image);
+            put(Table::sections, Columns::Sections::name, intern(reinterpret_cast<const char*>(sec.Name), nameLength));
+            put(Table::sections, Columns::Sections::rva, static_cast<unsigned int>(sec.VirtualAddress));
+            put(Table::sections, Columns::Sections::virtualSize, static_cast<unsigned int>(sec.Misc.VirtualSize));
+            put(Table::sections, Columns::Sections::rawSize, static_cast<unsigned int>(sec.SizeOfRawData));
+            put(Table::sections, Columns::Sections::characteristics, static_cast<unsigned int>(sec.Characteristics));
+            endRow(Table::sections);
+        }
+
+        const auto addFunction = [this, image](const unsigned int module, const unsigned char delayed, const auto& fn)
+        {
+            unsigned int name = 0;
+            unsigned short ordinal = 0;
+            switch (fn.type())
+            {
+            case Pe::ImportType::name:
+            {
+                const auto* const entry = fn.name();
+                name = entry ? intern(reinterpret_cast<const char*>(entry->Name)) : 0;
+                break;
+            }
+            case Pe::ImportType::ordinal:
+            {
+                ordinal = static_cast<unsigned short>(fn.ordinal());
+                break;
+            }
+            default:
+            {
+                return;
+            }
+            }
+
+            put(Table::imports, Columns::Imports::image, image);
+            put(Table::imports, Columns::Imports::module, module);
+            put(Table::imports, Columns::Imports::function, name);
+            put(Table::imports, Columns::Imports::ordinal, ordinal);
+            put(Table::imports, Columns::Imports::delayed, delayed);
+            endRow(Table::imports);
+        };
+
+        for (const auto& lib : pe.imports())
+        {
+            const unsigned int module = intern(lib.libName());
+            for (const auto& fn : lib)
+            {
+                addFunction(module, 0, fn);
+            }
+        }
+
+        for (const auto& lib : pe.delayedImports())
+        {
+            const unsigned int module = intern(lib.moduleName());
+            for (const auto& fn : lib)
+            {
+                addFunction(module, 1, fn);
+            }
+        }
+
+        const auto exports = pe.exports();
+        for (const auto& exp : exports)
+        {
+            const auto type = exp.type();
+            const auto* const entry = exp.exportAddressTableEntry();
+            if ((type == Pe::ExportType::unknown) || !entry->address)
+            {
+                continue;
+            }
+
+            put(Table::exports, Columns::Exports::image, image);
+            put(Table::exports, Columns::Exports::name, intern(exp.name()));
+            put(Table::exports, Columns::Exports::ordinal, static_cast<unsigned int>(exp.ordinal()));
+            put(Table::exports, Columns::Exports::rva, static_cast<unsigned int>((type == Pe::ExportType::exact) ? entry->address : 0));
+            put(Table::exports, Columns::Exports::forwarder, intern(exp.forwarder()));
+            endRow(Table::exports);
+        }
+
+        return image;
+    }
+
+    // Writes the rest of the rows and the footer, the writer can't be used after it:
+    bool finish();
+
+    bool valid() const noexcept;
+    unsigned int images() const noexcept;
+};
+
+
+
+//
+// Reader over the whole file in memory (e.g. mapped), column chunks are accessed in place.
+//
+
+class Reader
+{
+public:
+    struct Chunk
+    {
+        const unsigned char* data;
+        unsigned long long size;
+    };
+
+    struct RowGroup
+    {
+        Table table;
+        unsigned int rows;
+        unsigned long long firstRow;
+        std::vector<Chunk> columns;
+    };
+
+private:
+    struct DictionaryBlock
+    {
+        unsigned int firstId;
+        unsigned int count;
+        const unsigned int* offsets; // count + 1
+        const char* chars;
+    };
+
+private:
+    const unsigned char* m_data;
+    size_t m_size;
+    std::vector<Type> m_types[static_cast<size_t>(Table::count)];
+    std::vector<DictionaryBlock> m_dictionary;
+    std::vector<RowGroup> m_rowGroups;
+    unsigned int m_strings;
+
+private:
+    bool parse();
+
+public:
+    Reader(const void* data, size_t size);
+
+    bool valid() const noexcept;
+
+    const std::vector<RowGroup>& rowGroups() const noexcept;
+
+    // Typed column of the row group, nullptr if the column doesn't exist or has another type:
+    template <typename Value, typename ColumnId>
+    const Value* column(const RowGroup& group, const ColumnId columnId) const noexcept
+    {
+        const auto& types = m_types[static_cast<size_t>(group.table)];
+        const auto index = static_cast<size_t>(columnId);
+        if ((index >= types.size()) || (index >= group.columns.size()) || (typeSize(types[index]) != sizeof(Value)))
+        {
+            return nullptr;
+        }
+
+        const auto& chunk = group.columns[index];
+        if (chunk.size != static_cast<unsigned long long>(group.rows) * sizeof(Value))
+        {
+            return nullptr;
+        }
+
+        return reinterpret_cast<const Value*>(chunk.data);
+    }
+
+    unsigned int stringCount() const noexcept;
+
+    // nullptr for unknown ids:
+    const char* string(unsigned int id) const noexcept;
+
+    // Linear search over the dictionary, resolve the string once and compare ids in the columns:
+    bool findString(const char* str, unsigned int& id) const noexcept;
+};
+
+
+
+} // namespace Columnar
+} // namespace Corpus
@@ -0,0 +1,598 @@
+#include "DownloadPool.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <random>
+
+namespace
+{
+
+bool writeAll(const int fd, const void* const data, size_t size, off_t offset) noexcept
+{
+    const auto* pos = static_cast<const unsigned char*>(data);
+    while (size)
+    {
+        const auto written = pwrite(fd, pos, size, offset);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+
+        pos += written;
+        size -= static_cast<size_t>(written);
+        offset += written;
+    }
+
+    return true;
+}
+
+// Places the downloaded file at another destination through a temporary file:
+bool share(const std::string& from, const std::string& to)
+{
+    const auto temp = to + ".partial";
+    unlink(temp.c_str());
+    if (link(from.c_str(), temp.c_str()) != 0)
+    {
+        const int source = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+        if (source < 0)
+        {
+            return false;
+        }
+
+        const int target = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (target < 0)
+        {
+            close(source);
+            return false;
+        }
+
+        bool copied = true;
+        off_t offset = 0;
+        char buffer[64 * 1024];
+        for (;;)
+        {
+            const auto size = read(source, buffer, sizeof(buffer));
+            if ((size < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+
+            if (size <= 0)
+            {
+                copied = (size == 0);
+                break;
+            }
+
+            if (!writeAll(target, buffer, static_cast<size_t>(size), offset))
+            {
+                copied = false;
+                break;
+            }
+            offset += size;
+        }
+
+        close(source);
+        if ((close(target) != 0) || !copied)
+        {
+            unlink(temp.c_str());
+            return false;
+        }
+    }
+
+    if (rename(temp.c_str(), to.c_str()) != 0)
+    {
+        unlink(temp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool retriable(const unsigned int httpStatus) noexcept
+{
+    return !httpStatus || (httpStatus == 408) || (httpStatus == 429) || (httpStatus >= 500);
+}
+
+// Writes the body into the partial file at its position: a 206 continues the file, a 200 rewrites it from the start:
+class FileSink : public Corpus::HttpClient::Sink
+{
+private:
+    int m_fd;
+    unsigned long long m_offset; // Size of the partial file when the request was sent
+    Corpus::HttpClient::Response m_response;
+    unsigned long long m_position;
+    unsigned long long m_bytes;
+    bool m_writeFailed;
+
+    // Reserves the blocks without changing the file size, so the size still tells how much has been received:
+    bool preallocate(const long long size) noexcept
+    {
+        if ((size <= 0) || (static_cast<unsigned long long>(size) <= m_position))
+        {
+            return true;
+        }
+
+        if (fallocate(m_fd, FALLOC_FL_KEEP_SIZE, 0, size) == 0)
+        {
+            return true;
+        }
+
+        // Not supported by the filesystem is fine, running out of space is not:
+        return (errno != ENOSPC) && (errno != EFBIG);
+    }
+
+public:
+    FileSink(const int fd, const unsigned long long offset) noexcept
+        : m_fd(fd)
+        , m_offset(offset)
+        , m_response{ 0, -1, 0, -1 }
+        , m_position(0)
+        , m_bytes(0)
+        , m_writeFailed(false)
+    {
+    }
+
+    const Corpus::HttpClient::Response& response() const noexcept
+    {
+        return m_response;
+    }
+
+    unsigned long long bytes() const noexcept
+    {
+        return m_bytes;
+    }
+
+    bool writeFailed() const noexcept
+    {
+        return m_writeFailed;
+    }
+
+    // The body continues the partial file:
+    bool resumed() const noexcept
+    {
+        return m_offset && (m_response.status == 206) && (m_response.rangeStart == m_offset);
+    }
+
+    // The partial file holds the whole body:
+    bool complete() const noexcept
+    {
+        if (m_response.status == 200)
+        {
+            return (m_response.contentLength < 0) || (static_cast<unsigned long long>(m_response.contentLength) == m_bytes);
+        }
+
+        if (resumed())
+        {
+            if (m_response.totalLength >= 0)
+            {
+                return static_cast<unsigned long long>(m_response.totalLength) == m_position;
+            }
+
+            return (m_response.contentLength >= 0) && (static_cast<unsigned long long>(m_response.contentLength) == m_bytes);
+        }
+
+        return false;
+    }
+
+    virtual bool onResponse(const Corpus::HttpClient::Response& response) override
+    {
+        m_response = response;
+
+        if (response.status == 200)
+        {
+            // The server has ignored the Range or there was nothing to resume:
+            m_position = 0;
+            if (m_offset && (ftruncate(m_fd, 0) != 0))
+            {
+                m_writeFailed = true;
+                return false;
+            }
+
+            if (!preallocate(response.contentLength))
+            {
+                m_writeFailed = true;
+                return false;
+            }
+
+            return true;
+        }
+
+        if (resumed())
+        {
+            m_position = m_offset;
+            if (!preallocate(response.totalLength))
+            {
+                m_writeFailed = true;
+                return false;
+            }
+
+            return true;
+        }
+
+        return false;
+    }
+
+    virtual bool onData(const void* const data, const size_t size) override
+    {
+        if (!writeAll(m_fd, data, size, static_cast<off_t>(m_position)))
+        {
+            m_writeFailed = true;
+            return false;
+        }
+
+        m_position += size;
+        m_bytes += size;
+        return true;
+    }
+};
+
+} // namespace
+
+
+namespace Corpus
+{
+
+DownloadPool::Options DownloadPool::Options::defaults() noexcept
+{
+    Options options{};
+    options.workers = 8;
+    options.maxAttempts = 5;
+    options.initialBackoffMs = 500;
+    options.maxBackoffMs = 30000;
+    options.negativeCache = nullptr;
+    return options;
+}
+
+bool DownloadPool::TaskOrder::operator () (const Task& left, const Task& right) const noexcept
+{
+    // std::push_heap keeps the greatest element on top, so the earliest task is the "greatest":
+    if (left.notBefore != right.notBefore)
+    {
+        return left.notBefore > right.notBefore;
+    }
+
+    return left.sequence > right.sequence;
+}
+
+DownloadPool::DownloadPool(ClientFactory factory, const Options& options)
+    : m_options(options)
+    , m_factory(std::move(factory))
+    , m_sequence(0)
+    , m_busy(0)
+    , m_stop(false)
+    , m_stats{}
+{
+    if (!m_options.workers)
+    {
+        m_options.workers = 1;
+    }
+
+    if (!m_options.maxAttempts)
+    {
+        m_options.maxAttempts = 1;
+    }
+
+    m_workers.reserve(m_options.workers);
+    for (unsigned int i = 0; i < m_options.workers; ++i)
+    {
+        m_workers.emplace_back(&DownloadPool::worker, this);
+    }
+}
+
+DownloadPool::~DownloadPool()
+{
+    {
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+
+    m_queueEvent.notify_all();
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+
+    // Jobs that didn't start or were waiting for a retry:
+    for (const auto& task : m_queue)
+    {
+        for (auto& waiter : m_inFlight[task.job.key])
+        {
+            waiter.promise.set_value(Result{ Status::cancelled, 0, task.attempts, 0, 0 });
+        }
+    }
+}
+
+unsigned int DownloadPool::backoff(const unsigned int attempts) const noexcept
+{
+    unsigned long long delay = m_options.initialBackoffMs;
+    for (unsigned int i = 1; (i < attempts) && (delay < m_options.maxBackoffMs); ++i)
+    {
+        delay *= 2;
+    }
+
+    return static_cast<unsigned int>(std::min<unsigned long long>(delay, m_options.maxBackoffMs));
+}
+
+DownloadPool::Result DownloadPool::attempt(HttpClient& client, const Task& task)
+{
+    Result result{ Status::failed, 0, task.attempts, 0, 0 };
+
+    const auto partial = task.job.destination + ".partial";
+    const int fd = open(partial.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return result;
+    }
+
+    // Whatever an earlier attempt has received is kept and resumed:
+    struct stat info{};
+    const unsigned long long offset = (fstat(fd, &info) == 0) ? static_cast<unsigned long long>(info.st_size) : 0;
+
+    FileSink sink(fd, offset);
+    const bool received = client.get(HttpClient::Request{ task.job.url, offset }, sink);
+    const bool closed = (close(fd) == 0);
+
+    result.httpStatus = sink.response().status;
+    result.bytes = sink.bytes();
+    result.offset = sink.resumed() ? offset : 0;
+
+    if (!received && (client.error() == HttpClient::Error::redirect))
+    {
+        if (!offset)
+        {
+            unlink(partial.c_str());
+        }
+        result.status = Status::redirect;
+        return result;
+    }
+
+    const bool complete = received && closed && !sink.writeFailed() && sink.complete();
+    if (complete && (rename(partial.c_str(), task.job.destination.c_str()) == 0))
+    {
+        result.status = Status::downloaded;
+        return result;
+    }
+
+    // Nothing left to send, the partial file is the whole file:
+    const long long totalLength = sink.response().totalLength;
+    if (offset && (result.httpStatus == 416) && (totalLength >= 0) && (static_cast<unsigned long long>(totalLength) == offset)
+        && closed && (rename(partial.c_str(), task.job.destination.c_str()) == 0))
+    {
+        result.status = Status::downloaded;
+        return result;
+    }
+
+    if ((result.httpStatus == 404) || (result.httpStatus == 410))
+    {
+        unlink(partial.c_str());
+        result.status = Status::notFound;
+    }
+    else if ((offset && (result.httpStatus == 416)) || ((result.httpStatus == 206) && !sink.resumed()))
+    {
+        // The partial file doesn't match the file on the server, start over:
+        unlink(partial.c_str());
+        result.httpStatus = 0;
+    }
+    else if (!result.bytes && !offset)
+    {
+        unlink(partial.c_str());
+    }
+    else if ((result.httpStatus == 200) || (result.httpStatus == 206))
+    {
+        // Dropped transfer or a local failure, the received part stays for the retry:
+        result.httpStatus = 0;
+        if (sink.writeFailed())
+        {
+            unlink(partial.c_str());
+        }
+    }
+
+    return result;
+}
+
+std::vector<DownloadPool::Waiter> DownloadPool::complete(const Task& task, const Result& result)
+{
+    std::vector<Waiter> waiters;
+    const auto inFlight = m_inFlight.find(task.job.key);
+    if (inFlight != m_inFlight.end())
+    {
+        waiters = std::move(inFlight->second);
+        m_inFlight.erase(inFlight);
+    }
+
+    switch (result.status)
+    {
+    case Status::downloaded:
+    {
+        ++m_stats.downloaded;
+        m_stats.bytes += result.bytes;
+        break;
+    }
+    case Status::notFound:
+    {
+        ++m_stats.notFound;
+        break;
+    }
+    default:
+    {
+        ++m_stats.failed;
+        break;
+    }
+    }
+
+    return waiters;
+}
+
+void DownloadPool::deliver(const Job& job, const Result& result, std::vector<Waiter>& waiters)
+{
+    for (auto& waiter : waiters)
+    {
+        Result own = result;
+        if ((result.status == Status::downloaded) && (waiter.destination != job.destination) && !share(job.destination, waiter.destination))
+        {
+            own.status = Status::failed;
+        }
+
+        waiter.promise.set_value(own);
+    }
+}
+
+void DownloadPool::worker()
+{
+    const auto client = m_factory ? m_factory() : nullptr;
+    std::minstd_rand random(static_cast<unsigned int>(std::hash<std::thread::id>()(std::this_thread::get_id())));
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop)
+    {
+        if (m_queue.empty())
+        {
+            m_queueEvent.wait(lock);
+            continue;
+        }
+
+        const auto notBefore = m_queue.front().notBefore;
+        if (notBefore > Clock::now())
+        {
+            m_queueEvent.wait_until(lock, notBefore);
+            continue;
+        }
+
+        std::pop_heap(m_queue.begin(), m_queue.end(), TaskOrder());
+        Task task = std::move(m_queue.back());
+        m_queue.pop_back();
+        ++m_busy;
+        lock.unlock();
+
+        ++task.attempts;
+        const Result result = client ? attempt(*client, task) : Result{ Status::failed, 0, task.attempts, 0, 0 };
+        const bool retry = (result.status == Status::failed) && retriable(result.httpStatus) && (task.attempts < m_options.maxAttempts);
+
+        // Equal jitter: half of the delay is fixed, the other half is random:
+        const unsigned int delay = retry ? backoff(task.attempts) : 0;
+        const unsigned int jittered = delay / 2 + (delay ? static_cast<unsigned int>(random() % (delay / 2 + 1)) : 0);
+
+        if (m_options.negativeCache && !retry)
+        {
+            if (result.status == Status::notFound)
+            {
+                m_options.negativeCache->store(task.job.key);
+            }
+            else if (result.status == Status::downloaded)
+            {
+                m_options.negativeCache->remove(task.job.key);
+            }
+        }
+
+        lock.lock();
+
+        if (result.offset)
+        {
+            ++m_stats.resumed;
+        }
+
+        if (retry)
+        {
+            ++m_stats.retries;
+            task.notBefore = Clock::now() + std::chrono::milliseconds(jittered);
+            task.sequence = m_sequence++;
+            m_queue.push_back(std::move(task));
+            std::push_heap(m_queue.begin(), m_queue.end(), TaskOrder());
+            m_queueEvent.notify_one();
+        }
+        else
+        {
+            // Files are shared with the other submitters outside the lock:
+            auto waiters = complete(task, result);
+            lock.unlock();
+            deliver(task.job, result, waiters);
+            lock.lock();
+        }
+
+        --m_busy;
+        if (m_queue.empty() && !m_busy)
+        {
+            m_idleEvent.notify_all();
+        }
+    }
+}
+
+std::shared_future<DownloadPool::Result> DownloadPool::submit(const Job& job)
+{
+    if (m_options.negativeCache && m_options.negativeCache->missing(job.key))
+    {
+        std::promise<Result> missing;
+        missing.set_value(Result{ Status::notFound, 0, 0, 0, 0 });
+
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_stats.submitted;
+        ++m_stats.cached;
+        return missing.get_future().share();
+    }
+
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_stats.submitted;
+
+    auto& waiters = m_inFlight[job.key];
+    waiters.push_back(Waiter{ job.destination, std::promise<Result>() });
+    auto future = waiters.back().promise.get_future().share();
+    if (waiters.size() > 1)
+    {
+        ++m_stats.deduplicated;
+        return future;
+    }
+
+    m_queue.push_back(Task{ job, Clock::now(), m_sequence++, 0 });
+    std::push_heap(m_queue.begin(), m_queue.end(), TaskOrder());
+    m_queueEvent.notify_one();
+
+    return future;
+}
+
+std::vector<DownloadPool::Result> DownloadPool::run(const std::vector<Job>& jobs)
+{
+    std::vector<std::shared_future<Result>> futures;
+    futures.reserve(jobs.size());
+    for (const auto& job : jobs)
+    {
+        futures.push_back(submit(job));
+    }
+
+    std::vector<Result> results;
+    results.reserve(futures.size());
+    for (const auto& future : futures)
+    {
+        results.push_back(future.get());
+    }
+
+    return results;
+}
+
+void DownloadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idleEvent.wait(lock, [this]()
+    {
+        return m_queue.empty() && !m_busy;
+    });
+}
+
+DownloadPool::Stats DownloadPool::stats() const
+{
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+
+
+} // namespace Corpus
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "NegativeCache.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <unordered_map>
+
+namespace Corpus
+{
+
+
+
+// Pluggable HTTP layer of the DownloadPool, one instance is used by one worker at a time:
+class HttpClient
+{
+public:
+    struct Request
+    {
+        std::string url;
+        unsigned long long offset; // Asks for the tail of the file starting here, 0 for the whole file
+    };
+
+    struct Response
+    {
+        unsigned int status;
+        long long contentLength; // -1 if unknown
+        unsigned long long rangeStart; // Of the 206 body
+        long long totalLength; // File size from the Content-Range of a 206 or 416, -1 if unknown
+    };
+
+    enum class Error
+    {
+        none,
+        transport,
+        unsupportedUrl,
+        redirect // Redirected to a URL the client can't follow
+    };
+
+    // Receives the final response (after redirects), false from the handlers aborts the transfer:
+    class Sink
+    {
+    public:
+        virtual ~Sink() = default;
+        virtual bool onResponse(const Response& response) = 0;
+        virtual bool onData(const void* data, size_t size) = 0;
+    };
+
+public:
+    virtual ~HttpClient() = default;
+
+    // False if the transfer failed before the whole body was received:
+    virtual bool get(const Request& request, Sink& sink) = 0;
+
+    // Why the last get() has failed, none if the client doesn't tell:
+    virtual Error error() const noexcept
+    {
+        return Error::none;
+    }
+};
+
+
+
+//
+// Downloads many PDBs over a bounded pool of workers, each worker owns its HttpClient.
+// Jobs for the same symbol key are deduplicated: while a key is in flight, later submissions wait for the first one
+// and get a hard link (or a copy, across filesystems) of its file at their own destination.
+// Transport failures, 408, 429 and 5xx are retried with exponential backoff and jitter,
+// the waiting jobs don't occupy workers. 404 and 410 complete as notFound immediately
+// and are remembered in the optional NegativeCache, whose keys complete as notFound without any request.
+// A file is written to "destination.partial" and renamed to the destination when complete.
+// A partial file left by a dropped transfer (in this or an earlier run) is resumed with a Range request,
+// the space for the whole file is reserved up front when its size is known.
+// A 416 whose Content-Range says the file is as large as the partial one completes the download.
+//
+
+class DownloadPool
+{
+public:
+    struct Options
+    {
+        unsigned int workers;           // Concurrent downloads
+        unsigned int maxAttempts;
+        unsigned int initialBackoffMs;  // Doubled after every failed attempt
+        unsigned int maxBackoffMs;
+        NegativeCache* negativeCache;   // Optional, must outlive the pool
+
+        static Options defaults() noexcept;
+    };
+
+    struct Job
+    {
+        Pe::CodeView::SymbolKey key;
+        std::string url;
+        std::string destination;
+    };
+
+    enum class Status
+    {
+        downloaded,
+        notFound,
+        failed,
+        redirect, // To a URL the client can't follow, not retried
+        cancelled
+    };
+
+    struct Result
+    {
+        Status status;
+        unsigned int httpStatus; // Of the last attempt, zero if the transport failed
+        unsigned int attempts;
+        unsigned long long bytes;  // Received by the last attempt
+        unsigned long long offset; // Where the last attempt has resumed the partial file, 0 if it started over
+    };
+
+    struct Stats
+    {
+        unsigned long long submitted;
+        unsigned long long deduplicated;
+        unsigned long long cached; // Answered by the negative cache
+        unsigned long long downloaded;
+        unsigned long long notFound;
+        unsigned long long failed;
+        unsigned long long retries;
+        unsigned long long resumed; // Attempts that continued a partial file
+        unsigned long long bytes;
+    };
+
+    using ClientFactory = std::function<std::unique_ptr<HttpClient>()>;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Task
+    {
+        Job job;
+        Clock::time_point notBefore;
+        unsigned long long sequence;
+        unsigned int attempts;
+    };
+
+    struct TaskOrder
+    {
+        bool operator () (const Task& left, const Task& right) const noexcept;
+    };
+
+    // Submitters of a key in flight, the first one is the job being downloaded:
+    struct Waiter
+    {
+        std::string destination;
+        std::promise<Result> promise;
+    };
+
+private:
+    Options m_options;
+    ClientFactory m_factory;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_queueEvent;
+    std::condition_variable m_idleEvent;
+    std::vector<Task> m_queue; // Heap by notBefore
+    std::unordered_map<Pe::CodeView::SymbolKey, std::vector<Waiter>, Pe::CodeView::SymbolKey::Hasher> m_inFlight;
+    unsigned long long m_sequence;
+    unsigned int m_busy;
+    bool m_stop;
+    Stats m_stats;
+
+    std::vector<std::thread> m_workers;
+
+private:
+    void worker();
+    Result attempt(HttpClient& client, const Task& task);
+    unsigned int backoff(unsigned int attempts) const noexcept;
+    std::vector<Waiter> complete(const Task& task, const Result& result);
+    static void deliver(const Job& job, const Result& result, std::vector<Waiter>& waiters);
+
+public:
+    explicit DownloadPool(ClientFactory factory, const Options& options = Options::defaults());
+    ~DownloadPool();
+
+    DownloadPool(const DownloadPool&) = delete;
+    DownloadPool& operator = (const DownloadPool&) = delete;
+
+    std::shared_future<Result> submit(const Job& job);
+
+    // Submits all jobs and waits for them, results are in the order of the jobs:
+    std::vector<Result> run(const std::vector<Job>& jobs);
+
+    // Blocks until the queue is empty and no download is in flight:
+    void wait();
+
+    Stats stats() const;
+};
+
+
+
+} // namespace Corpus
@@ -0,0 +1,755 @@
+#include "HttpSession.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <strings.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+namespace
+{
+
+constexpr size_t k_maxLineLength = 16384;
+constexpr unsigned long long k_maxDrainSize = 65536; // Larger unwanted bodies close the connection instead
+
+bool startsWithNoCase(const std::string& str, const char* const prefix) noexcept
+{
+    const size_t length = strlen(prefix);
+    return (str.size() >= length) && (strncasecmp(str.c_str(), prefix, length) == 0);
+}
+
+std::string trim(const std::string& str)
+{
+    const auto first = str.find_first_not_of(" \t");
+    if (first == std::string::npos)
+    {
+        return {};
+    }
+
+    const auto last = str.find_last_not_of(" \t");
+    return str.substr(first, last - first + 1);
+}
+
+bool isRedirect(const unsigned int status) noexcept
+{
+    return (status == 301) || (status == 302) || (status == 303) || (status == 307) || (status == 308);
+}
+
+} // namespace
+
+
+namespace Corpus
+{
+
+class HttpSession::Connection
+{
+private:
+    int m_fd;
+    std::unique_ptr<Tls::Channel> m_channel; // Null for http
+    std::vector<char> m_buf;
+    size_t m_pos;
+    size_t m_end;
+    bool m_received;
+
+private:
+    // Receives more data to the buffer, false on EOF or error:
+    bool fill()
+    {
+        if (m_pos == m_end)
+        {
+            m_pos = 0;
+            m_end = 0;
+        }
+        else if (m_end == m_buf.size())
+        {
+            if (m_pos)
+            {
+                memmove(m_buf.data(), &m_buf[m_pos], m_end - m_pos);
+                m_end -= m_pos;
+                m_pos = 0;
+            }
+            else
+            {
+                m_buf.resize(m_buf.size() * 2);
+            }
+        }
+
+        while (true)
+        {
+            const long received = m_channel
+                ? m_channel->receive(&m_buf[m_end], m_buf.size() - m_end)
+                : static_cast<long>(recv(m_fd, &m_buf[m_end], m_buf.size() - m_end, 0));
+            if (received > 0)
+            {
+                m_end += static_cast<size_t>(received);
+                m_received = true;
+                return true;
+            }
+
+            if ((received < 0) && !m_channel && (errno == EINTR))
+            {
+                continue;
+            }
+
+            return false;
+        }
+    }
+
+public:
+    Connection(const int fd, std::unique_ptr<Tls::Channel> channel)
+        : m_fd(fd), m_channel(std::move(channel)), m_buf(16384), m_pos(0), m_end(0), m_received(false)
+    {
+    }
+
+    ~Connection()
+    {
+        m_channel.reset(); // May still talk to the server
+        close(m_fd);
+    }
+
+    Connection(const Connection&) = delete;
+    Connection& operator = (const Connection&) = delete;
+
+    // Starts a new exchange on the connection:
+    void reset() noexcept
+    {
+        m_received = false;
+    }
+
+    // Whether any byte of the response was received:
+    bool received() const noexcept
+    {
+        return m_received;
+    }
+
+    bool buffered() const noexcept
+    {
+        return m_pos != m_end;
+    }
+
+    // An idle connection is alive if the server neither closed it nor sent anything:
+    bool alive() const noexcept
+    {
+        char byte = 0;
+        const auto peeked = recv(m_fd, &byte, sizeof(byte), MSG_PEEK | MSG_DONTWAIT);
+        return (peeked < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK));
+    }
+
+    bool send(const std::string& data) noexcept
+    {
+        if (m_channel)
+        {
+            return m_channel->send(data.data(), data.size());
+        }
+
+        size_t pos = 0;
+        while (pos < data.size())
+        {
+            const auto sent = ::send(m_fd, data.data() + pos, data.size() - pos, MSG_NOSIGNAL);
+            if (sent < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+
+            pos += static_cast<size_t>(sent);
+        }
+
+        return true;
+    }
+
+    // Reads a line without the CRLF:
+    bool readLine(std::string& line)
+    {
+        size_t scanned = m_pos;
+        while (true)
+        {
+            const auto* const begin = &m_buf[0];
+            const auto* const found = static_cast<const char*>(memchr(begin + scanned, '\n', m_end - scanned));
+            if (found)
+            {
+                const size_t lineEnd = static_cast<size_t>(found - begin);
+                line.assign(begin + m_pos, lineEnd - m_pos);
+                if (!line.empty() && (line.back() == '\r'))
+                {
+                    line.pop_back();
+                }
+
+                m_pos = lineEnd + 1;
+                return true;
+            }
+
+            if (m_end - m_pos > k_maxLineLength)
+            {
+                return false;
+            }
+
+            const size_t offset = m_end - m_pos;
+            if (!fill())
+            {
+                return false;
+            }
+            scanned = m_pos + offset;
+        }
+    }
+
+    // Passes exactly the size bytes to the consumer, or everything up to EOF if untilClose:
+    template <typename Consumer>
+    bool read(unsigned long long size, const bool untilClose, Consumer&& consumer)
+    {
+        while (untilClose || size)
+        {
+            if (m_pos == m_end)
+            {
+                if (!fill())
+                {
+                    return untilClose;
+                }
+            }
+
+            const size_t available = m_end - m_pos;
+            const size_t portion = untilClose ? available : static_cast<size_t>(std::min<unsigned long long>(available, size));
+            const char* const data = &m_buf[m_pos];
+            m_pos += portion;
+            if (!untilClose)
+            {
+                size -= portion;
+            }
+
+            if (!consumer(data, portion))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+
+
+HttpSession::Options HttpSession::Options::defaults() noexcept
+{
+    Options options{};
+    options.timeoutMs = 30000;
+    options.maxRedirects = 5;
+    options.maxIdlePerHost = 4;
+    options.tls = nullptr;
+    return options;
+}
+
+bool HttpSession::Url::parse(const std::string& url, Url& result)
+{
+    static constexpr char k_http[] = "http://";
+    static constexpr char k_https[] = "https://";
+
+    size_t authorityBegin = 0;
+    if (startsWithNoCase(url, k_http))
+    {
+        result.secure = false;
+        authorityBegin = sizeof(k_http) - 1;
+    }
+    else if (startsWithNoCase(url, k_https))
+    {
+        result.secure = true;
+        authorityBegin = sizeof(k_https) - 1;
+    }
+    else
+    {
+        return false;
+    }
+
+    size_t authorityEnd = url.find_first_of("/?#", authorityBegin);
+    if (authorityEnd == std::string::npos)
+    {
+        authorityEnd = url.size();
+    }
+
+    const auto authority = url.substr(authorityBegin, authorityEnd - authorityBegin);
+    if (authority.empty() || (authority.find('@') != std::string::npos))
+    {
+        return false;
+    }
+
+    // "[v6]:port", "host:port" or "host":
+    const size_t bracket = authority.rfind(']');
+    const size_t colon = authority.rfind(':');
+    const bool hasPort = (colon != std::string::npos) && ((bracket == std::string::npos) || (colon > bracket));
+
+    result.host = authority.substr(0, hasPort ? colon : std::string::npos);
+    if ((result.host.size() >= 2) && (result.host.front() == '[') && (result.host.back() == ']'))
+    {
+        result.host = result.host.substr(1, result.host.size() - 2);
+    }
+
+    result.port = result.secure ? 443 : 80;
+    if (hasPort)
+    {
+        const auto port = authority.substr(colon + 1);
+        char* end = nullptr;
+        const unsigned long value = strtoul(port.c_str(), &end, 10);
+        if (port.empty() || *end || !value || (value > 65535))
+        {
+            return false;
+        }
+
+        result.port = static_cast<unsigned short>(value);
+    }
+
+    const size_t fragment = url.find('#', authorityEnd);
+    result.path = url.substr(authorityEnd, (fragment == std::string::npos) ? std::string::npos : fragment - authorityEnd);
+    if (result.path.empty() || (result.path.front() != '/'))
+    {
+        result.path.insert(result.path.begin(), '/');
+    }
+
+    return !result.host.empty();
+}
+
+std::string HttpSession::hostKey(const Url& url)
+{
+    return (url.secure ? "https://" : "http://") + url.host + ":" + std::to_string(url.port);
+}
+
+HttpSession::HttpSession(const Options& options) : m_options(options), m_stats{}, m_error(Error::none)
+{
+}
+
+HttpSession::~HttpSession() = default;
+
+std::unique_ptr<HttpSession::Connection> HttpSession::connect(const Url& url)
+{
+    if (url.secure && !m_options.tls)
+    {
+        return nullptr;
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(url.host.c_str(), std::to_string(url.port).c_str(), &hints, &addresses) != 0)
+    {
+        return nullptr;
+    }
+
+    const timeval timeout{ static_cast<time_t>(m_options.timeoutMs / 1000), static_cast<suseconds_t>((m_options.timeoutMs % 1000) * 1000) };
+
+    int connected = -1;
+    for (const auto* address = addresses; address && (connected < 0); address = address->ai_next)
+    {
+        const int fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+        if (fd < 0)
+        {
+            continue;
+        }
+
+        // Non-blocking connect to apply the timeout:
+        const int flags = fcntl(fd, F_GETFL);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+        bool status = (::connect(fd, address->ai_addr, address->ai_addrlen) == 0);
+        if (!status && (errno == EINPROGRESS))
+        {
+            pollfd poller{ fd, POLLOUT, 0 };
+            int error = 0;
+            socklen_t errorSize = sizeof(error);
+            status = (poll(&poller, 1, static_cast<int>(m_options.timeoutMs)) == 1)
+                && (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errorSize) == 0)
+                && !error;
+        }
+
+        if (!status)
+        {
+            close(fd);
+            continue;
+        }
+
+        fcntl(fd, F_SETFL, flags);
+
+        const int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        connected = fd;
+    }
+
+    freeaddrinfo(addresses);
+
+    if (connected < 0)
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<Tls::Channel> channel;
+    if (url.secure)
+    {
+        channel = m_options.tls->handshake(connected, url.host);
+        if (!channel)
+        {
+            close(connected);
+            return nullptr;
+        }
+    }
+
+    ++m_stats.connects;
+    return std::unique_ptr<Connection>(new Connection(connected, std::move(channel)));
+}
+
+std::unique_ptr<HttpSession::Connection> HttpSession::acquire(const Url& url, bool& reused)
+{
+    reused = false;
+
+    const auto idle = m_idle.find(hostKey(url));
+    if (idle != m_idle.end())
+    {
+        auto& connections = idle->second;
+        while (!connections.empty())
+        {
+            auto connection = std::move(connections.back());
+            connections.pop_back();
+            if (connection->alive())
+            {
+                ++m_stats.reuses;
+                reused = true;
+                connection->reset();
+                return connection;
+            }
+        }
+    }
+
+    return connect(url);
+}
+
+void HttpSession::release(const Url& url, std::unique_ptr<Connection> connection)
+{
+    if (!connection || connection->buffered())
+    {
+        return;
+    }
+
+    auto& connections = m_idle[hostKey(url)];
+    if (connections.size() < m_options.maxIdlePerHost)
+    {
+        connections.push_back(std::move(connection));
+    }
+}
+
+HttpSession::Exchange HttpSession::exchange(Url& url, const unsigned long long offset, Sink& sink, const bool lastHop)
+{
+    // IPv6 literals are bracketed like in the URL:
+    const bool literal6 = (url.host.find(':') != std::string::npos);
+    std::string head = "GET " + url.path + " HTTP/1.1\r\nHost: " + (literal6 ? "[" + url.host + "]" : url.host);
+    if (url.port != (url.secure ? 443 : 80))
+    {
+        head += ":" + std::to_string(url.port);
+    }
+    if (offset)
+    {
+        head += "\r\nRange: bytes=" + std::to_string(offset) + "-";
+    }
+    head += "\r\nUser-Agent: formatPE\r\nAccept: */*\r\nConnection: keep-alive\r\n\r\n";
+
+    for (unsigned int attempt = 0; attempt < 2; ++attempt)
+    {
+        bool reused = false;
+        auto connection = acquire(url, reused);
+        if (!connection)
+        {
+            return Exchange::failed;
+        }
+
+        ++m_stats.requests;
+
+        std::string line;
+        if (!connection->send(head) || !connection->readLine(line))
+        {
+            if (reused && !connection->received())
+            {
+                // The server has closed the idle connection meanwhile:
+                continue;
+            }
+            return Exchange::failed;
+        }
+
+        unsigned int status = 0;
+        unsigned int minorVersion = 0;
+        bool keepAlive = false;
+        bool chunked = false;
+        long long contentLength = -1;
+        unsigned long long rangeStart = 0;
+        long long totalLength = -1;
+        std::string location;
+
+        // Interim 1xx responses are skipped:
+        do
+        {
+            if (sscanf(line.c_str(), "HTTP/1.%u %u", &minorVersion, &status) != 2)
+            {
+                return Exchange::failed;
+            }
+
+            keepAlive = (minorVersion >= 1);
+            chunked = false;
+            contentLength = -1;
+            rangeStart = 0;
+            totalLength = -1;
+            location.clear();
+
+            while (true)
+            {
+                if (!connection->readLine(line))
+                {
+                    return Exchange::failed;
+                }
+
+                if (line.empty())
+                {
+                    break;
+                }
+
+                const auto colon = line.find(':');
+                if (colon == std::string::npos)
+                {
+                    continue;
+                }
+
+                const auto name = line.substr(0, colon);
+                const auto value = trim(line.substr(colon + 1));
+                if (!strcasecmp(name.c_str(), "Content-Length"))
+                {
+                    contentLength = strtoll(value.c_str(), nullptr, 10);
+                }
+                else if (!strcasecmp(name.c_str(), "Transfer-Encoding"))
+                {
+                    chunked = (strcasestr(value.c_str(), "chunked") != nullptr);
+                }
+                else if (!strcasecmp(name.c_str(), "Connection"))
+                {
+                    if (strcasestr(value.c_str(), "close"))
+                    {
+                        keepAlive = false;
+                    }
+                    else if (strcasestr(value.c_str(), "keep-alive"))
+                    {
+                        keepAlive = true;
+                    }
+                }
+                else if (!strcasecmp(name.c_str(), "Content-Range"))
+                {
+                    // "bytes first-last/total" of a 206, the total may be "*", or "bytes */total" of a 416:
+                    unsigned long long first = 0;
+                    unsigned long long last = 0;
+                    long long total = -1;
+                    if (sscanf(value.c_str(), "bytes %llu-%llu/%lld", &first, &last, &total) >= 2)
+                    {
+                        rangeStart = first;
+                        totalLength = total;
+                    }
+                    else if (sscanf(value.c_str(), "bytes */%lld", &total) == 1)
+                    {
+                        totalLength = total;
+                    }
+                }
+                else if (!strcasecmp(name.c_str(), "Location"))
+                {
+                    location = value;
+                }
+            }
+        } while ((status >= 100) && (status < 200) && connection->readLine(line));
+
+        if (status < 200)
+        {
+            return Exchange::failed;
+        }
+
+        if ((status == 204) || (status == 304))
+        {
+            contentLength = 0;
+            chunked = false;
+        }
+
+        const bool untilClose = !chunked && (contentLength < 0);
+        if (untilClose)
+        {
+            keepAlive = false;
+        }
+
+        // Follow the redirect if the target is reachable by this session:
+        Url target = url;
+        bool follow = false;
+        if (isRedirect(status) && !location.empty() && !lastHop)
+        {
+            if (location.front() == '/')
+            {
+                target.path = location;
+                follow = true;
+            }
+            else
+            {
+                follow = Url::parse(location, target) && (!target.secure || m_options.tls);
+            }
+        }
+
+        if (isRedirect(status) && !follow)
+        {
+            return Exchange::unfollowable;
+        }
+
+        const Response response{ status, chunked ? -1 : contentLength, rangeStart, totalLength };
+        const bool wanted = !follow && sink.onResponse(response);
+
+        if (!wanted && (untilClose || (contentLength > static_cast<long long>(k_maxDrainSize))))
+        {
+            // Cheaper to reconnect than to drain:
+            if (follow)
+            {
+                ++m_stats.redirects;
+                url = target;
+                return Exchange::redirect;
+            }
+            return Exchange::done;
+        }
+
+        bool aborted = false;
+        const auto consumer = [&](const char* const data, const size_t size) -> bool
+        {
+            if (wanted && !sink.onData(data, size))
+            {
+                aborted = true;
+                return false;
+            }
+            return true;
+        };
+
+        bool complete = false;
+        if (chunked)
+        {
+            while (true)
+            {
+                if (!connection->readLine(line))
+                {
+                    break;
+                }
+
+                const unsigned long long chunkSize = strtoull(line.c_str(), nullptr, 16);
+                if (!chunkSize)
+                {
+                    // Trailers up to the empty line:
+                    while (connection->readLine(line) && !line.empty())
+                    {
+                    }
+                    complete = line.empty();
+                    break;
+                }
+
+                if (!connection->read(chunkSize, false, consumer) || !connection->readLine(line))
+                {
+                    break;
+                }
+            }
+        }
+        else
+        {
+            complete = connection->read(untilClose ? 0 : static_cast<unsigned long long>(contentLength), untilClose, consumer);
+        }
+
+        if (!complete || aborted)
+        {
+            return Exchange::failed;
+        }
+
+        if (keepAlive)
+        {
+            release(url, std::move(connection));
+        }
+
+        if (follow)
+        {
+            ++m_stats.redirects;
+            url = target;
+            return Exchange::redirect;
+        }
+
+        return Exchange::done;
+    }
+
+    return Exchange::failed;
+}
+
+bool HttpSession::get(const Request& request, Sink& sink)
+{
+    m_error = Error::none;
+
+    Url url{};
+    if (!Url::parse(request.url, url) || (url.secure && !m_options.tls))
+    {
+        m_error = Error::unsupportedUrl;
+        return false;
+    }
+
+    for (unsigned int hop = 0; ; ++hop)
+    {
+        switch (exchange(url, request.offset, sink, hop >= m_options.maxRedirects))
+        {
+        case Exchange::done:
+        {
+            return true;
+        }
+        case Exchange::redirect:
+        {
+            continue;
+        }
+        case Exchange::unfollowable:
+        {
+            m_error = Error::redirect;
+            return false;
+        }
+        default:
+        {
+            m_error = Error::transport;
+            return false;
+        }
+        }
+    }
+}
+
+HttpClient::Error HttpSession::error() const noexcept
+{
+    return m_error;
+}
+
+const HttpSession::Stats& HttpSession::stats() const noexcept
+{
+    return m_stats;
+}
+
+size_t HttpSession::idleConnections() const noexcept
+{
+    size_t count = 0;
+    for (const auto& host : m_idle)
+    {
+        count += host.second.size();
+    }
+
+    return count;
+}
+
+
+
+} // namespace Corpus
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "DownloadPool.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+namespace Corpus
+{
+
+
+
+//
+// HTTP/1.1 client over plain sockets that keeps the connections alive between requests:
+// idle connections are pooled per "host:port" and reused for the next requests to the host,
+// so sequential downloads from one symbol server pay for one connection instead of one per file.
+// A reused connection that was closed by the server meanwhile is replaced transparently.
+// Redirects are followed within the session, the sink sees only the final response,
+// a redirect that can't be followed fails the request with Error::redirect.
+// https needs a Tls implementation in the options, none is built in.
+// One session per thread, e.g. one per DownloadPool worker.
+//
+
+class HttpSession : public HttpClient
+{
+public:
+    // TLS layer for https URLs, e.g. over OpenSSL, the session speaks plain HTTP over its channels:
+    class Tls
+    {
+    public:
+        class Channel
+        {
+        public:
+            virtual ~Channel() = default;
+
+            virtual bool send(const void* data, size_t size) = 0; // The whole buffer
+            virtual long receive(void* buffer, size_t size) = 0; // Zero on close, negative on error
+        };
+
+    public:
+        virtual ~Tls() = default;
+
+        // Null if the handshake over the connected socket has failed, the socket stays owned by the session:
+        virtual std::unique_ptr<Channel> handshake(int fd, const std::string& host) = 0;
+    };
+
+    struct Options
+    {
+        unsigned int timeoutMs;      // Connect, send and receive timeout
+        unsigned int maxRedirects;
+        unsigned int maxIdlePerHost;
+        Tls* tls;                    // Optional, enables https, must outlive the session
+
+        static Options defaults() noexcept;
+    };
+
+    struct Stats
+    {
+        unsigned long long requests;
+        unsigned long long connects;
+        unsigned long long reuses;
+        unsigned long long redirects;
+    };
+
+    struct Url
+    {
+        bool secure;
+        std::string host; // IPv6 literals without the brackets
+        unsigned short port;
+        std::string path; // With the query
+
+        // "http://host[:port][/path]" or "https://host[:port][/path]":
+        static bool parse(const std::string& url, Url& result);
+    };
+
+private:
+    class Connection;
+
+    enum class Exchange
+    {
+        done,
+        redirect,
+        unfollowable, // Redirect to a URL the session can't reach
+        failed
+    };
+
+private:
+    Options m_options;
+    std::unordered_map<std::string, std::vector<std::unique_ptr<Connection>>> m_idle;
+    Stats m_stats;
+    Error m_error;
+
+private:
+    static std::string hostKey(const Url& url);
+
+    std::unique_ptr<Connection> connect(const Url& url);
+    std::unique_ptr<Connection> acquire(const Url& url, bool& reused);
+    void release(const Url& url, std::unique_ptr<Connection> connection);
+
+    Exchange exchange(Url& url, unsigned long long offset, Sink& sink, bool lastHop);
+
+public:
+    explicit HttpSession(const Options& options = Options::defaults());
+    ~HttpSession();
+
+    HttpSession(const HttpSession&) = delete;
+    HttpSession& operator = (const HttpSession&) = delete;
+
+    virtual bool get(const Request& request, Sink& sink) override;
+    virtual Error error() const noexcept override;
+
+    const Stats& stats() const noexcept;
+    size_t idleConnections() const noexcept;
+};
+
+
+
+} // namespace Corpus
@@ -0,0 +1,321 @@
+#include "NegativeCache.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include <cstring>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+
+bool readFile(const char* const path, std::vector<unsigned char>& content)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return false;
+    }
+
+    const auto size = static_cast<size_t>(file.tellg());
+    content.resize(size);
+    file.seekg(0);
+    return size && file.read(reinterpret_cast<char*>(content.data()), static_cast<std::streamsize>(size));
+}
+
+bool replaceFile(const std::string& from, const std::string& to) noexcept
+{
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+template <typename Type>
+unsigned char* put(unsigned char* const pos, const Type& value) noexcept
+{
+    memcpy(pos, &value, sizeof(value));
+    return pos + sizeof(value);
+}
+
+template <typename Type>
+const unsigned char* get(const unsigned char* const pos, Type& value) noexcept
+{
+    memcpy(&value, pos, sizeof(value));
+    return pos + sizeof(value);
+}
+
+} // namespace
+
+
+namespace Corpus
+{
+
+NegativeCache::NegativeCache(const std::string& storagePath, const std::chrono::seconds ttl, const bool persistCounters)
+    : m_storagePath(storagePath)
+    , m_ttl(ttl)
+    , m_persistCounters(persistCounters)
+    , m_stats{}
+    , m_dirty(false)
+{
+    const std::lock_guard<std::mutex> lock(m_mutex);
+
+    bool torn = false;
+    const bool loaded = load(torn);
+    if (loaded && torn)
+    {
+        // Cut off the broken tail so that new records aren't appended after it:
+        compactLocked(Clock::now());
+        return;
+    }
+
+    openLog(!loaded);
+}
+
+NegativeCache::~NegativeCache()
+{
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_dirty)
+    {
+        compactLocked(Clock::now());
+    }
+}
+
+long long NegativeCache::seconds(const Clock::time_point time) noexcept
+{
+    return static_cast<long long>(std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count());
+}
+
+bool NegativeCache::load(bool& torn)
+{
+    torn = false;
+
+    std::vector<unsigned char> content;
+    if (!readFile(m_storagePath.c_str(), content))
+    {
+        return false;
+    }
+
+    unsigned int header[2]{};
+    if (content.size() < sizeof(header))
+    {
+        return false;
+    }
+
+    memcpy(header, content.data(), sizeof(header));
+    if ((header[0] != k_magic) || (header[1] != k_version))
+    {
+        return false;
+    }
+
+    size_t pos = sizeof(header);
+    for (; content.size() - pos >= k_recordSize; pos += k_recordSize)
+    {
+        Pe::CodeView::SymbolKey key;
+        Entry entry{};
+
+        const unsigned char* field = &content[pos];
+        field = get(field, key);
+        field = get(field, entry.expires);
+        field = get(field, entry.stats.hits);
+        get(field, entry.stats.misses);
+
+        m_entries[key] = entry;
+    }
+
+    torn = (pos != content.size());
+    return true;
+}
+
+bool NegativeCache::openLog(const bool truncate)
+{
+    m_log.close();
+    m_log.clear();
+    m_log.open(m_storagePath, std::ios::binary | (truncate ? std::ios::trunc : std::ios::app));
+    if (!m_log)
+    {
+        return false;
+    }
+
+    if (truncate)
+    {
+        const unsigned int header[] = { k_magic, k_version };
+        m_log.write(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+
+    return !!m_log;
+}
+
+bool NegativeCache::append(const Pe::CodeView::SymbolKey& key, const Entry& entry)
+{
+    if (!m_log)
+    {
+        return false;
+    }
+
+    unsigned char record[k_recordSize];
+    unsigned char* field = record;
+    field = put(field, key);
+    field = put(field, entry.expires);
+    field = put(field, entry.stats.hits);
+    put(field, entry.stats.misses);
+
+    m_log.write(reinterpret_cast<const char*>(record), sizeof(record));
+    return !!m_log;
+}
+
+bool NegativeCache::compactLocked(const Clock::time_point now)
+{
+    // Removed keys and the keys that expired long ago would only grow the storage:
+    const long long horizon = seconds(now - m_ttl);
+    for (auto entry = m_entries.begin(); entry != m_entries.end();)
+    {
+        if (entry->second.expires <= horizon)
+        {
+            entry = m_entries.erase(entry);
+        }
+        else
+        {
+            ++entry;
+        }
+    }
+
+    const std::string tempPath = m_storagePath + ".tmp";
+    {
+        std::ofstream temp(tempPath, std::ios::binary | std::ios::trunc);
+        const unsigned int header[] = { k_magic, k_version };
+        temp.write(reinterpret_cast<const char*>(header), sizeof(header));
+        m_log.close();
+        m_log.swap(temp);
+
+        bool status = true;
+        for (const auto& entry : m_entries)
+        {
+            status &= append(entry.first, entry.second);
+        }
+
+        // The buffered tail is written on close, a failure there leaves a truncated log:
+        m_log.close();
+        status &= !m_log.fail();
+        if (!status)
+        {
+            std::remove(tempPath.c_str());
+            openLog(false);
+            return false;
+        }
+    }
+
+    // Renamed over the old one, so there is always a storage to load:
+    if (!replaceFile(tempPath, m_storagePath))
+    {
+        std::remove(tempPath.c_str());
+        openLog(false);
+        return false;
+    }
+
+    m_dirty = false;
+    return openLog(false);
+}
+
+bool NegativeCache::valid() const
+{
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    return !!m_log;
+}
+
+bool NegativeCache::missing(const Pe::CodeView::SymbolKey& key, const Clock::time_point now)
+{
+    const std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto it = m_entries.find(key);
+    if (it == m_entries.end())
+    {
+        ++m_stats.misses;
+        return false;
+    }
+
+    auto& entry = it->second;
+    if (m_persistCounters)
+    {
+        m_dirty = true;
+    }
+
+    if (entry.expires > seconds(now))
+    {
+        ++entry.stats.hits;
+        ++m_stats.hits;
+        return true;
+    }
+
+    if (entry.expires)
+    {
+        ++m_stats.expired;
+    }
+
+    ++entry.stats.misses;
+    ++m_stats.misses;
+    return false;
+}
+
+bool NegativeCache::store(const Pe::CodeView::SymbolKey& key, const Clock::time_point now)
+{
+    const std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto& entry = m_entries[key];
+    entry.expires = seconds(now + m_ttl);
+    ++m_stats.stored;
+    return append(key, entry);
+}
+
+bool NegativeCache::remove(const Pe::CodeView::SymbolKey& key)
+{
+    const std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto it = m_entries.find(key);
+    if ((it == m_entries.end()) || !it->second.expires)
+    {
+        return true;
+    }
+
+    // The counters stay, the key is only not missing anymore:
+    it->second.expires = 0;
+    return append(key, it->second);
+}
+
+bool NegativeCache::compact(const Clock::time_point now)
+{
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    return compactLocked(now);
+}
+
+bool NegativeCache::flush()
+{
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    m_log.flush();
+    return !!m_log;
+}
+
+size_t NegativeCache::size() const
+{
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+NegativeCache::Stats NegativeCache::stats() const
+{
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+NegativeCache::KeyStats NegativeCache::stats(const Pe::CodeView::SymbolKey& key) const
+{
+    const std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto it = m_entries.find(key);
+    return (it != m_entries.end()) ? it->second.stats : KeyStats{};
+}
+
+} // namespace Corpus
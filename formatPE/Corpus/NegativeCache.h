@@ -0,0 +1,108 @@
+#pragma once
+
+#include <Pe/Pe.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <fstream>
+#include <mutex>
+#include <chrono>
+
+namespace Corpus
+{
+
+
+
+//
+// Persistent cache of the symbol keys that the symbol server doesn't have (404/410),
+// so that the next runs don't ask for them again until the entry expires.
+// Storage is an append-only log of fixed-size records like the SummaryCache one,
+// later records override earlier ones, a torn record at the end is ignored on load.
+// compact() rewrites the log without the removed keys and the keys that expired more than a TTL ago.
+// Per-key hit and miss counters are saved by compact(); with persistCounters the destructor runs it
+// if they changed, otherwise lookups never rewrite the storage.
+// Thread-safe within a process, one process per storage file.
+//
+
+class NegativeCache
+{
+public:
+    static constexpr unsigned int k_magic = 0x434E4550u; // "PENC"
+    static constexpr unsigned int k_version = 1;
+
+    using Clock = std::chrono::system_clock;
+
+    struct Stats
+    {
+        unsigned long long hits;    // Requests avoided
+        unsigned long long misses;  // Lookups that have to go to the server
+        unsigned long long expired; // Misses of the keys whose entry has expired
+        unsigned long long stored;
+    };
+
+    struct KeyStats
+    {
+        unsigned long long hits;
+        unsigned long long misses; // Only counted after the key was stored once
+    };
+
+private:
+    struct Entry
+    {
+        long long expires; // Seconds since the epoch, 0 if the key is not missing anymore
+        KeyStats stats;
+    };
+
+    // Key, expiration, hits and misses, without padding:
+    static constexpr size_t k_recordSize = sizeof(Pe::CodeView::SymbolKey) + sizeof(long long) + 2 * sizeof(unsigned long long);
+
+private:
+    std::string m_storagePath;
+    std::chrono::seconds m_ttl;
+    bool m_persistCounters;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<Pe::CodeView::SymbolKey, Entry, Pe::CodeView::SymbolKey::Hasher> m_entries;
+    std::ofstream m_log;
+    Stats m_stats;
+    bool m_dirty;
+
+private:
+    static long long seconds(Clock::time_point time) noexcept;
+
+    bool load(bool& torn);
+    bool openLog(bool truncate);
+    bool append(const Pe::CodeView::SymbolKey& key, const Entry& entry);
+    bool compactLocked(Clock::time_point now);
+
+public:
+    NegativeCache(const std::string& storagePath, std::chrono::seconds ttl, bool persistCounters = false);
+    ~NegativeCache();
+
+    NegativeCache(const NegativeCache&) = delete;
+    NegativeCache& operator = (const NegativeCache&) = delete;
+
+    bool valid() const;
+
+    // True if the key is known to be missing, counts a hit or a miss:
+    bool missing(const Pe::CodeView::SymbolKey& key, Clock::time_point now = Clock::now());
+
+    // Remembers a 404 for the TTL from now:
+    bool store(const Pe::CodeView::SymbolKey& key, Clock::time_point now = Clock::now());
+
+    // Forgets the key, e.g. when the PDB has been found meanwhile, its counters stay until the next compaction:
+    bool remove(const Pe::CodeView::SymbolKey& key);
+
+    // Rewrites the log keeping the latest state and the counters of the keys still worth keeping:
+    bool compact(Clock::time_point now = Clock::now());
+
+    bool flush();
+
+    size_t size() const; // Keys stored since the last compaction or kept by it, the removed ones included
+    Stats stats() const;
+    KeyStats stats(const Pe::CodeView::SymbolKey& key) const;
+};
+
+
+
+} // namespace Corpus
@@ -0,0 +1,673 @@
+#include "SummaryCache.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+
+namespace
+{
+
+// Parsing doesn't check the bounds inside the sections, the zeroes after the content terminate
+// the strings and the structures that run over the end of a truncated file:
+constexpr size_t k_zeroTail = 4096;
+
+class Writer
+{
+private:
+    std::vector<unsigned char>& m_buf;
+
+public:
+    explicit Writer(std::vector<unsigned char>& buf) : m_buf(buf)
+    {
+    }
+
+    template <typename Type>
+    void pod(const Type& value)
+    {
+        const auto* const bytes = reinterpret_cast<const unsigned char*>(&value);
+        m_buf.insert(m_buf.end(), bytes, bytes + sizeof(value));
+    }
+
+    void str(const std::string& value)
+    {
+        pod(static_cast<unsigned int>(value.size()));
+        m_buf.insert(m_buf.end(), value.cbegin(), value.cend());
+    }
+};
+
+class Reader
+{
+private:
+    const unsigned char* m_pos;
+    const unsigned char* const m_end;
+    bool m_valid;
+
+public:
+    Reader(const unsigned char* const data, const size_t size) : m_pos(data), m_end(data + size), m_valid(true)
+    {
+    }
+
+    bool valid() const noexcept
+    {
+        return m_valid;
+    }
+
+    template <typename Type>
+    Type pod()
+    {
+        Type value{};
+        if (!m_valid || (static_cast<size_t>(m_end - m_pos) < sizeof(value)))
+        {
+            m_valid = false;
+            return value;
+        }
+
+        memcpy(&value, m_pos, sizeof(value));
+        m_pos += sizeof(value);
+        return value;
+    }
+
+    std::string str()
+    {
+        const auto size = pod<unsigned int>();
+        if (!m_valid || (static_cast<size_t>(m_end - m_pos) < size))
+        {
+            m_valid = false;
+            return {};
+        }
+
+        std::string value(reinterpret_cast<const char*>(m_pos), size);
+        m_pos += size;
+        return value;
+    }
+
+    // Count of elements that can't exceed the rest of the data:
+    unsigned int count()
+    {
+        const auto value = pod<unsigned int>();
+        if (value > static_cast<size_t>(m_end - m_pos))
+        {
+            m_valid = false;
+            return 0;
+        }
+        return value;
+    }
+};
+
+void serialize(Writer& writer, const Pe::Summary& summary)
+{
+    writer.pod(static_cast<unsigned char>(summary.arch));
+    writer.pod(summary.machine);
+    writer.pod(summary.characteristics);
+    writer.pod(summary.timestamp);
+    writer.pod(summary.imageBase);
+    writer.pod(summary.imageSize);
+    writer.pod(summary.entryPoint);
+    writer.pod(summary.subsystem);
+    writer.pod(summary.dllCharacteristics);
+    writer.pod(summary.checksum);
+
+    writer.pod(static_cast<unsigned int>(summary.sections.size()));
+    for (const auto& sec : summary.sections)
+    {
+        writer.str(sec.name);
+        writer.pod(sec.rva);
+        writer.pod(sec.virtualSize);
+        writer.pod(sec.rawOffset);
+        writer.pod(sec.rawSize);
+        writer.pod(sec.characteristics);
+    }
+
+    writer.pod(static_cast<unsigned int>(summary.imports.size()));
+    for (const auto& lib : summary.imports)
+    {
+        writer.str(lib.name);
+        writer.pod(static_cast<unsigned char>(lib.delayed));
+        writer.pod(static_cast<unsigned int>(lib.functions.size()));
+        for (const auto& fn : lib.functions)
+        {
+            writer.str(fn.name);
+            writer.pod(fn.ordinal);
+        }
+    }
+
+    writer.str(summary.exportModuleName);
+    writer.pod(static_cast<unsigned int>(summary.exports.size()));
+    for (const auto& exp : summary.exports)
+    {
+        writer.str(exp.name);
+        writer.pod(exp.ordinal);
+        writer.pod(exp.rva);
+        writer.str(exp.forwarder);
+    }
+
+    writer.pod(static_cast<unsigned char>(summary.debug.type));
+    writer.pod(summary.debug.guid);
+    writer.pod(summary.debug.signature);
+    writer.pod(summary.debug.age);
+    writer.str(summary.debug.pdbPath);
+}
+
+bool deserialize(Reader& reader, Pe::Summary& summary)
+{
+    summary.arch = static_cast<Pe::Arch>(reader.pod<unsigned char>());
+    summary.machine = reader.pod<unsigned short>();
+    summary.characteristics = reader.pod<unsigned short>();
+    summary.timestamp = reader.pod<unsigned int>();
+    summary.imageBase = reader.pod<unsigned long long>();
+    summary.imageSize = reader.pod<unsigned int>();
+    summary.entryPoint = reader.pod<Pe::Rva>();
+    summary.subsystem = reader.pod<unsigned short>();
+    summary.dllCharacteristics = reader.pod<unsigned short>();
+    summary.checksum = reader.pod<unsigned int>();
+
+    summary.sections.resize(reader.count());
+    for (auto& sec : summary.sections)
+    {
+        sec.name = reader.str();
+        sec.rva = reader.pod<Pe::Rva>();
+        sec.virtualSize = reader.pod<unsigned int>();
+        sec.rawOffset = reader.pod<unsigned int>();
+        sec.rawSize = reader.pod<unsigned int>();
+        sec.characteristics = reader.pod<unsigned int>();
+    }
+
+    summary.imports.resize(reader.count());
+    for (auto& lib : summary.imports)
+    {
+        lib.name = reader.str();
+        lib.delayed = reader.pod<unsigned char>() != 0;
+        lib.functions.resize(reader.count());
+        for (auto& fn : lib.functions)
+        {
+            fn.name = reader.str();
+            fn.ordinal = reader.pod<Pe::Ordinal>();
+        }
+    }
+
+    summary.exportModuleName = reader.str();
+    summary.exports.resize(reader.count());
+    for (auto& exp : summary.exports)
+    {
+        exp.name = reader.str();
+        exp.ordinal = reader.pod<unsigned int>();
+        exp.rva = reader.pod<Pe::Rva>();
+        exp.forwarder = reader.str();
+    }
+
+    summary.debug.type = static_cast<Pe::Summary::DebugIdentity::Type>(reader.pod<unsigned char>());
+    summary.debug.guid = reader.pod<GUID>();
+    summary.debug.signature = reader.pod<unsigned int>();
+    summary.debug.age = reader.pod<unsigned int>();
+    summary.debug.pdbPath = reader.str();
+
+    return reader.valid();
+}
+
+bool readFile(const char* const path, std::vector<unsigned char>& content, const size_t zeroTail = 0)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return false;
+    }
+
+    const auto size = static_cast<size_t>(file.tellg());
+    content.reserve(size + zeroTail);
+    content.resize(size);
+    file.seekg(0);
+    return size && file.read(reinterpret_cast<char*>(content.data()), static_cast<std::streamsize>(size));
+}
+
+// The headers, the section table and the raw data of the sections as Pe::byRva maps it lie within the file:
+bool fitsInFile(const unsigned char* const data, const size_t size) noexcept
+{
+    IMAGE_DOS_HEADER dos{};
+    if (size < sizeof(dos))
+    {
+        return false;
+    }
+
+    memcpy(&dos, data, sizeof(dos));
+    if ((dos.e_magic != 0x5A4D) || (dos.e_lfanew < 0))
+    {
+        return false;
+    }
+
+    const auto ntOffset = static_cast<unsigned long long>(dos.e_lfanew);
+    const auto optOffset = ntOffset + offsetof(IMAGE_NT_HEADERS32, OptionalHeader);
+    if (optOffset + sizeof(unsigned short) > size)
+    {
+        return false;
+    }
+
+    unsigned short magic = 0;
+    memcpy(&magic, data + optOffset, sizeof(magic));
+
+    unsigned long long ntSize = 0;
+    unsigned int sectionAlignment = 0;
+    unsigned int fileAlignment = 0;
+    if (magic == Pe::Types<Pe::Arch::x32>::k_magic)
+    {
+        ntSize = sizeof(IMAGE_NT_HEADERS32);
+        if (ntOffset + ntSize <= size)
+        {
+            IMAGE_NT_HEADERS32 nt{};
+            memcpy(&nt, data + ntOffset, sizeof(nt));
+            sectionAlignment = nt.OptionalHeader.SectionAlignment;
+            fileAlignment = nt.OptionalHeader.FileAlignment;
+        }
+    }
+    else if (magic == Pe::Types<Pe::Arch::x64>::k_magic)
+    {
+        ntSize = sizeof(IMAGE_NT_HEADERS64);
+        if (ntOffset + ntSize <= size)
+        {
+            IMAGE_NT_HEADERS64 nt{};
+            memcpy(&nt, data + ntOffset, sizeof(nt));
+            sectionAlignment = nt.OptionalHeader.SectionAlignment;
+            fileAlignment = nt.OptionalHeader.FileAlignment;
+        }
+    }
+
+    if (!ntSize || (ntOffset + ntSize > size))
+    {
+        return false;
+    }
+
+    IMAGE_FILE_HEADER fileHeader{};
+    memcpy(&fileHeader, data + ntOffset + offsetof(IMAGE_NT_HEADERS32, FileHeader), sizeof(fileHeader));
+
+    const auto sectionsOffset = optOffset + fileHeader.SizeOfOptionalHeader;
+    if (sectionsOffset + static_cast<unsigned long long>(fileHeader.NumberOfSections) * sizeof(IMAGE_SECTION_HEADER) > size)
+    {
+        return false;
+    }
+
+    // Mirrors the file layout translation of Pe::byRva:
+    constexpr unsigned long long k_minimalSectionAlignment = 512;
+    for (unsigned int i = 0; i < fileHeader.NumberOfSections; ++i)
+    {
+        IMAGE_SECTION_HEADER sec{};
+        memcpy(&sec, data + sectionsOffset + i * sizeof(IMAGE_SECTION_HEADER), sizeof(sec));
+
+        unsigned long long offset = sec.PointerToRawData;
+        unsigned long long length = (sec.SizeOfRawData > sec.Misc.VirtualSize) ? sec.Misc.VirtualSize : sec.SizeOfRawData;
+        if (sectionAlignment >= k_minimalSectionAlignment)
+        {
+            const auto alignedFileSize = fileAlignment
+                ? (static_cast<unsigned long long>(sec.SizeOfRawData) + fileAlignment - 1) / fileAlignment * fileAlignment
+                : sec.SizeOfRawData;
+            const auto alignedSectionSize = (static_cast<unsigned long long>(sec.Misc.VirtualSize) + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+            length = (alignedFileSize > alignedSectionSize) ? alignedSectionSize : alignedFileSize;
+            offset &= ~(k_minimalSectionAlignment - 1);
+        }
+
+        if (offset + length > size)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Readers see either the old or the new file, never a missing one:
+bool replaceFile(const std::string& from, const std::string& to) noexcept
+{
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+} // namespace
+
+
+namespace Corpus
+{
+
+bool FileKey::query(const char* const path, FileKey& key) noexcept
+{
+    if (!path)
+    {
+        return false;
+    }
+
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info{};
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &info))
+    {
+        return false;
+    }
+
+    // FILETIME counts 100-nanosecond intervals since 1601:
+    constexpr long long k_epochDelta = 116444736000000000ll;
+    const auto writeTime = (static_cast<long long>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+    const auto size = (static_cast<unsigned long long>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    const auto mtime = (writeTime - k_epochDelta) * 100;
+#else
+    struct stat info{};
+    if (stat(path, &info) != 0)
+    {
+        return false;
+    }
+
+    const auto size = static_cast<unsigned long long>(info.st_size);
+    const auto mtime = static_cast<long long>(info.st_mtim.tv_sec) * 1000000000ll + info.st_mtim.tv_nsec;
+#endif
+
+    try
+    {
+        key.path = path;
+    }
+    catch (...)
+    {
+        return false;
+    }
+
+    key.size = size;
+    key.mtime = mtime;
+    return true;
+}
+
+ContentHash hashContent(const void* const data, const size_t size) noexcept
+{
+    constexpr ContentHash k_offsetBasis = 0xCBF29CE484222325ull;
+    constexpr ContentHash k_prime = 0x00000100000001B3ull;
+
+    ContentHash hash = k_offsetBasis;
+    const auto* const bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= k_prime;
+    }
+
+    return hash;
+}
+
+
+
+SummaryCache::SummaryCache(const std::string& storagePath) : m_storagePath(storagePath), m_stats{}
+{
+    bool torn = false;
+    size_t records = 0;
+    const bool loaded = load(torn, records);
+    if (loaded && (torn || (records - m_entries.size() > m_entries.size())))
+    {
+        // Cut off the broken tail so that new records aren't appended after it,
+        // drop the records of the previous versions of the files:
+        compact();
+        return;
+    }
+
+    openLog(!loaded);
+}
+
+bool SummaryCache::load(bool& torn, size_t& records)
+{
+    torn = false;
+    records = 0;
+
+    std::vector<unsigned char> content;
+    if (!readFile(m_storagePath.c_str(), content))
+    {
+        return false;
+    }
+
+    Reader header(content.data(), content.size());
+    if ((header.pod<unsigned int>() != k_magic) || (header.pod<unsigned int>() != k_version) || !header.valid())
+    {
+        return false;
+    }
+
+    size_t pos = 2 * sizeof(unsigned int);
+    while (content.size() - pos >= sizeof(unsigned int))
+    {
+        unsigned int recordSize = 0;
+        memcpy(&recordSize, &content[pos], sizeof(recordSize));
+        pos += sizeof(recordSize);
+        if (recordSize > content.size() - pos)
+        {
+            torn = true;
+            break;
+        }
+
+        Reader reader(&content[pos], recordSize);
+        pos += recordSize;
+
+        Entry entry{};
+        entry.key.path = reader.str();
+        entry.key.size = reader.pod<unsigned long long>();
+        entry.key.mtime = reader.pod<long long>();
+        entry.hash = reader.pod<ContentHash>();
+        if (!deserialize(reader, entry.summary))
+        {
+            torn = true;
+            break;
+        }
+
+        insert(std::move(entry));
+        ++records;
+    }
+
+    return true;
+}
+
+bool SummaryCache::openLog(const bool truncate)
+{
+    m_log.close();
+    m_log.clear();
+    m_log.open(m_storagePath, std::ios::binary | (truncate ? std::ios::trunc : std::ios::app));
+    if (!m_log)
+    {
+        return false;
+    }
+
+    if (truncate)
+    {
+        const unsigned int header[] = { k_magic, k_version };
+        m_log.write(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+
+    return !!m_log;
+}
+
+void SummaryCache::insert(Entry&& entry)
+{
+    // A changed file replaces the entry of its previous version:
+    const auto existing = m_byPath.find(entry.key.path);
+    if (existing != m_byPath.end())
+    {
+        auto& slot = m_entries[existing->second];
+        // The old hash may belong to another file with the same content now:
+        const auto byHash = m_byHash.find(slot.hash);
+        if ((slot.hash != entry.hash) && (byHash != m_byHash.end()) && (byHash->second == existing->second))
+        {
+            m_byHash.erase(byHash);
+        }
+        slot = std::move(entry);
+        m_byHash[slot.hash] = existing->second;
+        return;
+    }
+
+    const size_t index = m_entries.size();
+    m_entries.emplace_back(std::move(entry));
+    m_byPath.emplace(m_entries.back().key.path, index);
+    m_byHash[m_entries.back().hash] = index;
+}
+
+bool SummaryCache::append(const Entry& entry)
+{
+    if (!m_log)
+    {
+        return false;
+    }
+
+    std::vector<unsigned char> record(sizeof(unsigned int));
+    Writer writer(record);
+    writer.str(entry.key.path);
+    writer.pod(entry.key.size);
+    writer.pod(entry.key.mtime);
+    writer.pod(entry.hash);
+    serialize(writer, entry.summary);
+
+    const auto recordSize = static_cast<unsigned int>(record.size() - sizeof(unsigned int));
+    memcpy(record.data(), &recordSize, sizeof(recordSize));
+
+    m_log.write(reinterpret_cast<const char*>(record.data()), static_cast<std::streamsize>(record.size()));
+    return !!m_log;
+}
+
+bool SummaryCache::valid() const noexcept
+{
+    return !!m_log;
+}
+
+const Pe::Summary* SummaryCache::find(const FileKey& key) const noexcept
+{
+    const auto it = m_byPath.find(key.path);
+    if (it == m_byPath.end())
+    {
+        return nullptr;
+    }
+
+    const auto& entry = m_entries[it->second];
+    return (entry.key == key) ? &entry.summary : nullptr;
+}
+
+const Pe::Summary* SummaryCache::find(const ContentHash hash) const noexcept
+{
+    const auto it = m_byHash.find(hash);
+    return (it != m_byHash.end()) ? &m_entries[it->second].summary : nullptr;
+}
+
+bool SummaryCache::store(const FileKey& key, const ContentHash hash, const Pe::Summary& summary)
+{
+    Entry entry{ key, hash, summary };
+    const bool status = append(entry);
+    insert(std::move(entry));
+    return status;
+}
+
+bool SummaryCache::get(const char* const path, Pe::Summary& summary)
+{
+    // One broken file mustn't stop a rescan, e.g. bad_alloc on a table of absurd size:
+    try
+    {
+        FileKey key{};
+        if (!FileKey::query(path, key))
+        {
+            return false;
+        }
+
+        const auto* const cached = find(key);
+        if (cached)
+        {
+            ++m_stats.hits;
+            summary = *cached;
+            return true;
+        }
+
+        std::vector<unsigned char> content;
+        if (!readFile(path, content, k_zeroTail))
+        {
+            return false;
+        }
+
+        const auto hash = hashContent(content.data(), content.size());
+        const auto* const sameContent = find(hash);
+        if (sameContent)
+        {
+            // Renamed or touched: no need to parse it again, but remember the new key:
+            ++m_stats.hashHits;
+            summary = *sameContent;
+            store(key, hash, summary);
+            return true;
+        }
+
+        ++m_stats.misses;
+
+        if (!fitsInFile(content.data(), content.size()))
+        {
+            return false;
+        }
+
+        content.resize(content.size() + k_zeroTail);
+        if (!Pe::Summary::fromFile(content.data(), summary))
+        {
+            return false;
+        }
+
+        store(key, hash, summary);
+        return true;
+    }
+    catch (...)
+    {
+        return false;
+    }
+}
+
+bool SummaryCache::compact()
+{
+    const std::string tempPath = m_storagePath + ".tmp";
+    {
+        std::ofstream temp(tempPath, std::ios::binary | std::ios::trunc);
+        const unsigned int header[] = { k_magic, k_version };
+        temp.write(reinterpret_cast<const char*>(header), sizeof(header));
+        m_log.close();
+        m_log.swap(temp);
+
+        bool status = true;
+        for (const auto& entry : m_entries)
+        {
+            status &= append(entry);
+        }
+
+        // The buffered tail is written on close, e.g. ENOSPC shows up only here:
+        m_log.close();
+        status &= !m_log.fail();
+        if (!status)
+        {
+            std::remove(tempPath.c_str());
+            openLog(false);
+            return false;
+        }
+    }
+
+    if (!replaceFile(tempPath, m_storagePath))
+    {
+        std::remove(tempPath.c_str());
+        openLog(false);
+        return false;
+    }
+
+    return openLog(false);
+}
+
+bool SummaryCache::flush()
+{
+    m_log.flush();
+    return !!m_log;
+}
+
+size_t SummaryCache::size() const noexcept
+{
+    return m_entries.size();
+}
+
+const SummaryCache::Stats& SummaryCache::stats() const noexcept
+{
+    return m_stats;
+}
+
+} // namespace Corpus
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <Pe/Summary.hpp>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <fstream>
+
+namespace Corpus
+{
+
+
+
+// Identity of a file on disk that is assumed to be unchanged while these fields are the same:
+struct FileKey
+{
+    std::string path;
+    unsigned long long size;
+    long long mtime; // Nanoseconds since the epoch, a rewrite within the same second still changes it
+
+    static bool query(const char* path, FileKey& key) noexcept;
+
+    bool operator == (const FileKey& key) const noexcept
+    {
+        return (size == key.size) && (mtime == key.mtime) && (path == key.path);
+    }
+};
+
+using ContentHash = unsigned long long;
+
+// 64-bit FNV-1a:
+ContentHash hashContent(const void* data, size_t size) noexcept;
+
+
+
+//
+// Persistent cache of the parsed summaries for incremental corpus rescans.
+// Entries are found by (path, size, mtime) without opening the file,
+// or by the content hash if the file was moved or touched but not changed.
+// There is one live entry per path: a changed file replaces the entry of its previous version.
+// The storage is an append-only log of records, later records of a path override earlier ones,
+// a torn record at the end (e.g. after a crash) is ignored on load.
+// The log is compacted on load once the overridden records outnumber the live ones.
+// Not thread-safe, one process per storage file.
+//
+
+class SummaryCache
+{
+public:
+    static constexpr unsigned int k_magic = 0x43534550u; // "PESC"
+    static constexpr unsigned int k_version = 2;
+
+    struct Stats
+    {
+        unsigned long long hits;
+        unsigned long long hashHits;
+        unsigned long long misses;
+    };
+
+private:
+    struct Entry
+    {
+        FileKey key;
+        ContentHash hash;
+        Pe::Summary summary;
+    };
+
+private:
+    std::string m_storagePath;
+    std::vector<Entry> m_entries;
+    std::unordered_map<std::string, size_t> m_byPath;
+    std::unordered_map<ContentHash, size_t> m_byHash;
+    std::ofstream m_log;
+    Stats m_stats;
+
+private:
+    bool load(bool& torn, size_t& records);
+    bool openLog(bool truncate);
+    void insert(Entry&& entry);
+    bool append(const Entry& entry);
+
+public:
+    explicit SummaryCache(const std::string& storagePath);
+
+    SummaryCache(const SummaryCache&) = delete;
+    SummaryCache& operator = (const SummaryCache&) = delete;
+
+    bool valid() const noexcept;
+
+    const Pe::Summary* find(const FileKey& key) const noexcept;
+    const Pe::Summary* find(ContentHash hash) const noexcept;
+
+    bool store(const FileKey& key, ContentHash hash, const Pe::Summary& summary);
+
+    // Answers from the cache if the file is unchanged, otherwise reads, parses and stores it.
+    // A file that can't be read or parsed, or runs out of memory while parsing, is a failure, not an exception:
+    bool get(const char* path, Pe::Summary& summary);
+
+    // Rewrites the log keeping only the latest record for each path, false if the new log couldn't be written:
+    bool compact();
+
+    bool flush();
+
+    size_t size() const noexcept;
+    const Stats& stats() const noexcept;
+};
+
+
+
+} // namespace Corpus
@@ -0,0 +1,239 @@
+#include "SummaryStore.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+
+constexpr unsigned long long k_alignment = 8;
+
+unsigned long long alignUp(const unsigned long long value) noexcept
+{
+    return (value + k_alignment - 1) & ~(k_alignment - 1);
+}
+
+template <typename Record>
+Corpus::Store::TableDesc describe(unsigned long long& offset, const size_t count) noexcept
+{
+    offset = alignUp(offset);
+    const Corpus::Store::TableDesc desc{ offset, static_cast<unsigned int>(count), static_cast<unsigned int>(sizeof(Record)) };
+    offset += static_cast<unsigned long long>(count) * sizeof(Record);
+    return desc;
+}
+
+bool pad(std::ostream& stream, const unsigned long long offset)
+{
+    static const char k_zeros[k_alignment]{};
+    const auto pos = static_cast<unsigned long long>(stream.tellp());
+    if (pos > offset)
+    {
+        return false;
+    }
+
+    stream.write(k_zeros, static_cast<std::streamsize>(offset - pos));
+    return !!stream;
+}
+
+template <typename Record>
+bool writeTable(std::ostream& stream, const Corpus::Store::TableDesc& desc, const std::vector<Record>& records)
+{
+    if (!pad(stream, desc.offset))
+    {
+        return false;
+    }
+
+    stream.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(Record)));
+    return !!stream;
+}
+
+bool replaceFile(const std::string& from, const std::string& to) noexcept
+{
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+} // namespace
+
+
+namespace Corpus
+{
+namespace Store
+{
+
+Writer::Writer() : m_strings(1, '\0')
+{
+}
+
+StrRef Writer::intern(const std::string& str)
+{
+    if (str.empty())
+    {
+        return 0;
+    }
+
+    const auto it = m_stringIds.find(str);
+    if (it != m_stringIds.end())
+    {
+        return it->second;
+    }
+
+    const auto ref = static_cast<StrRef>(m_strings.size());
+    m_strings.insert(m_strings.end(), str.cbegin(), str.cend());
+    m_strings.push_back('\0');
+    m_stringIds.emplace(str, ref);
+    return ref;
+}
+
+unsigned int Writer::add(const std::string& path, const Pe::Summary& summary)
+{
+    Image image{};
+    image.path = intern(path);
+    image.arch = static_cast<unsigned char>(summary.arch);
+    image.debugType = static_cast<unsigned char>(summary.debug.type);
+    image.machine = summary.machine;
+    image.imageBase = summary.imageBase;
+    image.characteristics = summary.characteristics;
+    image.subsystem = summary.subsystem;
+    image.dllCharacteristics = summary.dllCharacteristics;
+    image.timestamp = summary.timestamp;
+    image.imageSize = summary.imageSize;
+    image.entryPoint = summary.entryPoint;
+    image.checksum = summary.checksum;
+
+    image.firstSection = static_cast<unsigned int>(m_sections.size());
+    image.sectionCount = static_cast<unsigned int>(summary.sections.size());
+    for (const auto& sec : summary.sections)
+    {
+        Section section{};
+        memcpy(section.name, sec.name.c_str(), std::min(sec.name.size(), sizeof(section.name)));
+        section.rva = sec.rva;
+        section.virtualSize = sec.virtualSize;
+        section.rawOffset = sec.rawOffset;
+        section.rawSize = sec.rawSize;
+        section.characteristics = sec.characteristics;
+        m_sections.push_back(section);
+    }
+
+    image.firstImportModule = static_cast<unsigned int>(m_importModules.size());
+    image.importModuleCount = static_cast<unsigned int>(summary.imports.size());
+    for (const auto& lib : summary.imports)
+    {
+        ImportModule module{};
+        module.name = intern(lib.name);
+        module.flags = lib.delayed ? static_cast<unsigned int>(ImportModule::delayed) : 0u;
+        module.firstFunction = static_cast<unsigned int>(m_importFunctions.size());
+        module.functionCount = static_cast<unsigned int>(lib.functions.size());
+        m_importModules.push_back(module);
+
+        for (const auto& fn : lib.functions)
+        {
+            m_importFunctions.push_back(ImportFunction{ intern(fn.name), fn.ordinal });
+        }
+    }
+
+    image.firstExport = static_cast<unsigned int>(m_exports.size());
+    image.exportCount = static_cast<unsigned int>(summary.exports.size());
+    for (const auto& exp : summary.exports)
+    {
+        m_exports.push_back(Export{ intern(exp.name), exp.ordinal, exp.rva, intern(exp.forwarder) });
+    }
+
+    image.exportModuleName = intern(summary.exportModuleName);
+    image.pdbGuid = summary.debug.guid;
+    image.pdbSignature = summary.debug.signature;
+    image.pdbAge = summary.debug.age;
+    image.pdbPath = intern(summary.debug.pdbPath);
+
+    m_images.push_back(image);
+    return static_cast<unsigned int>(m_images.size() - 1);
+}
+
+size_t Writer::count() const noexcept
+{
+    return m_images.size();
+}
+
+bool Writer::write(std::ostream& stream) const
+{
+    std::vector<unsigned int> pathIndex(m_images.size());
+    for (unsigned int i = 0; i < pathIndex.size(); ++i)
+    {
+        pathIndex[i] = i;
+    }
+
+    std::sort(pathIndex.begin(), pathIndex.end(), [this](const unsigned int left, const unsigned int right)
+    {
+        return strcmp(&m_strings[m_images[left].path], &m_strings[m_images[right].path]) < 0;
+    });
+
+    Header header{};
+    header.magic = Header::k_magic;
+    header.major = Header::k_major;
+    header.minor = Header::k_minor;
+    header.headerSize = sizeof(Header);
+
+    unsigned long long offset = sizeof(Header);
+    header.images = describe<Image>(offset, m_images.size());
+    header.pathIndex = describe<unsigned int>(offset, pathIndex.size());
+    header.sections = describe<Section>(offset, m_sections.size());
+    header.importModules = describe<ImportModule>(offset, m_importModules.size());
+    header.importFunctions = describe<ImportFunction>(offset, m_importFunctions.size());
+    header.exports = describe<Export>(offset, m_exports.size());
+    header.strings = describe<char>(offset, m_strings.size());
+
+    const auto start = stream.tellp();
+    if (start != std::streampos(0))
+    {
+        return false; // Offsets are relative to the beginning of the stream
+    }
+
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    return writeTable(stream, header.images, m_images)
+        && writeTable(stream, header.pathIndex, pathIndex)
+        && writeTable(stream, header.sections, m_sections)
+        && writeTable(stream, header.importModules, m_importModules)
+        && writeTable(stream, header.importFunctions, m_importFunctions)
+        && writeTable(stream, header.exports, m_exports)
+        && writeTable(stream, header.strings, m_strings)
+        && pad(stream, alignUp(offset));
+}
+
+bool Writer::save(const std::string& path) const
+{
+    // Written aside, readers never see a partially written storage:
+    const std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        const bool written = file && write(file);
+
+        // Closing flushes the rest of the buffer, which can fail too:
+        file.close();
+        if (!written || file.fail())
+        {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+
+    // Renamed over the old one, so readers see either the old or the new storage:
+    if (!replaceFile(tempPath, path))
+    {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace Store
+} // namespace Corpus
@@ -0,0 +1,438 @@
+#pragma once
+
+#include <Pe/Summary.hpp>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <ostream>
+#include <cstring>
+
+namespace Corpus
+{
+namespace Store
+{
+
+
+
+//
+// Fixed-layout little-endian storage of image summaries that is queried in place,
+// e.g. straight from a memory-mapped file, without a deserialization step:
+//
+//   Header
+//   Image          [imageCount]          (aligned to 8)
+//   unsigned int   [imageCount]          - indices of images sorted by path
+//   Section        [sectionCount]
+//   ImportModule   [importModuleCount]
+//   ImportFunction [importFunctionCount]
+//   Export         [exportCount]
+//   char           [stringsSize]         - pool of deduplicated null-terminated strings
+//
+// Every table is described in the header by its offset, count and record size,
+// so minor versions may append fields to the records and the older readers still work.
+//
+
+using StrRef = unsigned int; // Offset in the string pool, zero is the empty string
+
+struct TableDesc
+{
+    unsigned long long offset;
+    unsigned int count;
+    unsigned int stride;
+};
+
+struct Header
+{
+    static constexpr unsigned int k_magic = 0x53534550u; // "PESS"
+    static constexpr unsigned short k_major = 1;
+    static constexpr unsigned short k_minor = 0;
+
+    unsigned int magic;
+    unsigned short major;
+    unsigned short minor;
+    unsigned int headerSize;
+    unsigned int reserved;
+    TableDesc images;
+    TableDesc pathIndex;
+    TableDesc sections;
+    TableDesc importModules;
+    TableDesc importFunctions;
+    TableDesc exports;
+    TableDesc strings; // Stride is 1
+};
+
+struct Image
+{
+    StrRef path;
+    unsigned char arch; // Pe::Arch
+    unsigned char debugType; // Pe::Summary::DebugIdentity::Type
+    unsigned short machine;
+    unsigned long long imageBase;
+    unsigned short characteristics;
+    unsigned short subsystem;
+    unsigned short dllCharacteristics;
+    unsigned short reserved;
+    unsigned int timestamp;
+    unsigned int imageSize;
+    Pe::Rva entryPoint;
+    unsigned int checksum;
+    unsigned int firstSection;
+    unsigned int sectionCount;
+    unsigned int firstImportModule;
+    unsigned int importModuleCount;
+    unsigned int firstExport;
+    unsigned int exportCount;
+    StrRef exportModuleName;
+    GUID pdbGuid;
+    unsigned int pdbSignature;
+    unsigned int pdbAge;
+    StrRef pdbPath;
+};
+
+struct Section
+{
+    char name[8]; // Not null-terminated if all 8 chars are used
+    Pe::Rva rva;
+    unsigned int virtualSize;
+    unsigned int rawOffset;
+    unsigned int rawSize;
+    unsigned int characteristics;
+};
+
+struct ImportModule
+{
+    enum Flags : unsigned int
+    {
+        delayed = 1
+    };
+
+    StrRef name;
+    unsigned int flags;
+    unsigned int firstFunction;
+    unsigned int functionCount;
+};
+
+struct ImportFunction
+{
+    StrRef name; // Zero if imported by ordinal
+    unsigned int ordinal; // Zero if imported by name
+};
+
+struct Export
+{
+    StrRef name;
+    unsigned int ordinal;
+    Pe::Rva rva;
+    StrRef forwarder;
+};
+
+static_assert(sizeof(TableDesc) == 16, "Unexpected layout");
+static_assert(sizeof(Header) == 16 + 7 * sizeof(TableDesc), "Unexpected layout");
+static_assert(sizeof(Image) == 96, "Unexpected layout");
+static_assert(sizeof(Section) == 28, "Unexpected layout");
+static_assert(sizeof(ImportModule) == 16, "Unexpected layout");
+static_assert(sizeof(ImportFunction) == 8, "Unexpected layout");
+static_assert(sizeof(Export) == 16, "Unexpected layout");
+
+
+
+template <typename Record>
+class Table
+{
+private:
+    const unsigned char* m_base;
+    unsigned int m_count;
+    unsigned int m_stride;
+
+public:
+    class Iterator
+    {
+    private:
+        const unsigned char* m_pos;
+        unsigned int m_stride;
+
+    public:
+        Iterator(const unsigned char* const pos, const unsigned int stride) noexcept : m_pos(pos), m_stride(stride)
+        {
+        }
+
+        const Record& operator * () const noexcept
+        {
+            return *reinterpret_cast<const Record*>(m_pos);
+        }
+
+        const Record* operator -> () const noexcept
+        {
+            return reinterpret_cast<const Record*>(m_pos);
+        }
+
+        Iterator& operator ++ () noexcept
+        {
+            m_pos += m_stride;
+            return *this;
+        }
+
+        bool operator == (const Iterator& it) const noexcept
+        {
+            return m_pos == it.m_pos;
+        }
+
+        bool operator != (const Iterator& it) const noexcept
+        {
+            return m_pos != it.m_pos;
+        }
+    };
+
+public:
+    Table() noexcept : m_base(nullptr), m_count(0), m_stride(sizeof(Record))
+    {
+    }
+
+    Table(const unsigned char* const base, const unsigned int count, const unsigned int stride) noexcept
+        : m_base(base), m_count(count), m_stride(stride)
+    {
+    }
+
+    // Subrange [first, first + count), empty if it is out of the table:
+    Table slice(const unsigned int first, const unsigned int count) const noexcept
+    {
+        if ((first > m_count) || (count > m_count - first))
+        {
+            return Table();
+        }
+
+        return Table(m_base + static_cast<size_t>(first) * m_stride, count, m_stride);
+    }
+
+    unsigned int count() const noexcept
+    {
+        return m_count;
+    }
+
+    bool empty() const noexcept
+    {
+        return m_count == 0;
+    }
+
+    const Record& operator [] (const unsigned int index) const noexcept
+    {
+        return *reinterpret_cast<const Record*>(m_base + static_cast<size_t>(index) * m_stride);
+    }
+
+    Iterator begin() const noexcept
+    {
+        return Iterator(m_base, m_stride);
+    }
+
+    Iterator end() const noexcept
+    {
+        return Iterator(m_base + static_cast<size_t>(m_count) * m_stride, m_stride);
+    }
+};
+
+
+
+//
+// Zero-copy reader over the whole storage in memory.
+// The buffer must be aligned to 8 bytes (which is always true for mapped files).
+// Every table is bounds-checked once in the constructor, the references between the records
+// are checked on access and broken ones are treated as empty.
+//
+
+class View
+{
+private:
+    const unsigned char* m_data;
+    size_t m_size;
+    Table<Image> m_images;
+    Table<unsigned int> m_pathIndex;
+    Table<Section> m_sections;
+    Table<ImportModule> m_importModules;
+    Table<ImportFunction> m_importFunctions;
+    Table<Export> m_exports;
+    const char* m_strings;
+    unsigned int m_stringsSize;
+
+private:
+    template <typename Record>
+    bool bind(const TableDesc& desc, Table<Record>& table) const noexcept
+    {
+        if ((desc.stride < sizeof(Record)) || (desc.offset % alignof(Record)) || (desc.stride % alignof(Record)) || (desc.offset > m_size))
+        {
+            return false;
+        }
+
+        if (static_cast<unsigned long long>(desc.count) * desc.stride > m_size - desc.offset)
+        {
+            return false;
+        }
+
+        table = Table<Record>(m_data + desc.offset, desc.count, desc.stride);
+        return true;
+    }
+
+    bool init() noexcept
+    {
+        if (!m_data || (m_size < sizeof(Header)) || (reinterpret_cast<size_t>(m_data) % alignof(Header)))
+        {
+            return false;
+        }
+
+        const auto* const hdr = header();
+        if ((hdr->magic != Header::k_magic) || (hdr->major != Header::k_major) || (hdr->headerSize < sizeof(Header)))
+        {
+            return false;
+        }
+
+        if (!bind(hdr->images, m_images)
+            || !bind(hdr->pathIndex, m_pathIndex)
+            || !bind(hdr->sections, m_sections)
+            || !bind(hdr->importModules, m_importModules)
+            || !bind(hdr->importFunctions, m_importFunctions)
+            || !bind(hdr->exports, m_exports))
+        {
+            return false;
+        }
+
+        // The pool starts with the empty string and ends with a terminator, so any offset in it is a valid string:
+        const auto& strings = hdr->strings;
+        if ((strings.stride != 1) || !strings.count || (strings.offset > m_size) || (strings.count > m_size - strings.offset))
+        {
+            return false;
+        }
+
+        m_strings = reinterpret_cast<const char*>(m_data + strings.offset);
+        m_stringsSize = strings.count;
+        if (m_strings[0] || m_strings[m_stringsSize - 1])
+        {
+            return false;
+        }
+
+        return m_pathIndex.count() == m_images.count();
+    }
+
+public:
+    View() noexcept : m_data(nullptr), m_size(0), m_strings(nullptr), m_stringsSize(0)
+    {
+    }
+
+    View(const void* const data, const size_t size) noexcept
+        : m_data(static_cast<const unsigned char*>(data)), m_size(size), m_strings(nullptr), m_stringsSize(0)
+    {
+        if (!init())
+        {
+            *this = View();
+        }
+    }
+
+    bool valid() const noexcept
+    {
+        return m_data != nullptr;
+    }
+
+    const Header* header() const noexcept
+    {
+        return reinterpret_cast<const Header*>(m_data);
+    }
+
+    const char* string(const StrRef ref) const noexcept
+    {
+        return (ref < m_stringsSize) ? &m_strings[ref] : "";
+    }
+
+    const Table<Image>& images() const noexcept
+    {
+        return m_images;
+    }
+
+    Table<Section> sections(const Image& image) const noexcept
+    {
+        return m_sections.slice(image.firstSection, image.sectionCount);
+    }
+
+    Table<ImportModule> importModules(const Image& image) const noexcept
+    {
+        return m_importModules.slice(image.firstImportModule, image.importModuleCount);
+    }
+
+    Table<ImportFunction> importFunctions(const ImportModule& module) const noexcept
+    {
+        return m_importFunctions.slice(module.firstFunction, module.functionCount);
+    }
+
+    Table<Export> exports(const Image& image) const noexcept
+    {
+        return m_exports.slice(image.firstExport, image.exportCount);
+    }
+
+    // Binary search over the path index:
+    const Image* find(const char* const path) const noexcept
+    {
+        unsigned int lo = 0;
+        unsigned int hi = m_pathIndex.count();
+        while (lo < hi)
+        {
+            const unsigned int mid = lo + (hi - lo) / 2;
+            const unsigned int index = m_pathIndex[mid];
+            if (index >= m_images.count())
+            {
+                return nullptr;
+            }
+
+            const auto& image = m_images[index];
+            const int cmp = strcmp(string(image.path), path);
+            if (cmp == 0)
+            {
+                return &image;
+            }
+            else if (cmp < 0)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+
+        return nullptr;
+    }
+};
+
+
+
+//
+// Accumulates the summaries in the final layout and writes them at once.
+// Strings are deduplicated through the shared pool.
+//
+
+class Writer
+{
+private:
+    std::vector<Image> m_images;
+    std::vector<Section> m_sections;
+    std::vector<ImportModule> m_importModules;
+    std::vector<ImportFunction> m_importFunctions;
+    std::vector<Export> m_exports;
+    std::vector<char> m_strings;
+    std::unordered_map<std::string, StrRef> m_stringIds;
+
+private:
+    StrRef intern(const std::string& str);
+
+public:
+    Writer();
+
+    // Returns the index of the image record:
+    unsigned int add(const std::string& path, const Pe::Summary& summary);
+
+    size_t count() const noexcept;
+
+    bool write(std::ostream& stream) const;
+    bool save(const std::string& path) const;
+};
+
+
+
+} // namespace Store
+} // namespace Corpus
@@ -0,0 +1,832 @@
+#include "SymbolStore.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+namespace
+{
+
+int compareKeys(const Pe::CodeView::SymbolKey& left, const Pe::CodeView::SymbolKey& right) noexcept
+{
+    return memcmp(&left, &right, sizeof(left));
+}
+
+bool makeDir(const std::string& path) noexcept
+{
+    return (mkdir(path.c_str(), 0755) == 0) || (errno == EEXIST);
+}
+
+bool writeAll(const int fd, const unsigned char* data, size_t size) noexcept
+{
+    while (size)
+    {
+        const auto written = write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+
+    return true;
+}
+
+long long mtimeOf(const struct stat& info) noexcept
+{
+    return static_cast<long long>(info.st_mtim.tv_sec) * 1000000000ll + info.st_mtim.tv_nsec;
+}
+
+void unmap(void* const data, const size_t size) noexcept
+{
+    if (data)
+    {
+        munmap(data, size);
+    }
+}
+
+} // namespace
+
+
+namespace Corpus
+{
+
+std::string symbolPath(const char* const pdbName, const Pe::CodeView::SymbolKey& key)
+{
+    char keyText[Pe::CodeView::SymbolKey::k_maxLength + 1]{};
+    key.format(keyText);
+
+    std::string path(pdbName);
+    path.append(1, '/').append(keyText).append(1, '/').append(pdbName);
+    return path;
+}
+
+
+
+namespace SymbolIndex
+{
+
+View::View(const void* const data, const size_t size) noexcept
+    : m_data(static_cast<const unsigned char*>(data))
+    , m_size(size)
+    , m_header(nullptr)
+    , m_strings(nullptr)
+{
+    if (!data || (size < sizeof(Header)))
+    {
+        return;
+    }
+
+    const auto* const header = static_cast<const Header*>(data);
+    if ((header->magic != Header::k_magic) || (header->major != Header::k_major)
+        || (header->headerSize < sizeof(Header)) || (header->recordSize < sizeof(Record)) || !header->stringsSize)
+    {
+        return;
+    }
+
+    const unsigned long long stringsOffset = header->headerSize + static_cast<unsigned long long>(header->count) * header->recordSize;
+    if (stringsOffset + header->stringsSize > size)
+    {
+        return;
+    }
+
+    const auto* const strings = reinterpret_cast<const char*>(m_data + stringsOffset);
+    if (strings[header->stringsSize - 1] != '\0')
+    {
+        return;
+    }
+
+    m_header = header;
+    m_strings = strings;
+}
+
+bool View::valid() const noexcept
+{
+    return m_header != nullptr;
+}
+
+unsigned int View::count() const noexcept
+{
+    return m_header ? m_header->count : 0;
+}
+
+unsigned long long View::totalSize() const noexcept
+{
+    return m_header ? m_header->totalSize : 0;
+}
+
+const Record& View::operator [] (const unsigned int index) const noexcept
+{
+    return *reinterpret_cast<const Record*>(m_data + m_header->headerSize + static_cast<size_t>(index) * m_header->recordSize);
+}
+
+const char* View::name(const Record& record) const noexcept
+{
+    return (record.name < m_header->stringsSize) ? &m_strings[record.name] : "";
+}
+
+const Record* View::find(const char* const name, const Pe::CodeView::SymbolKey& key) const noexcept
+{
+    unsigned int first = 0;
+    unsigned int last = count();
+    while (first < last)
+    {
+        const unsigned int middle = first + (last - first) / 2;
+        const auto& record = (*this)[middle];
+
+        int order = compareKeys(record.key, key);
+        if (!order)
+        {
+            order = strcmp(this->name(record), name);
+        }
+
+        if (!order)
+        {
+            return &record;
+        }
+
+        if (order < 0)
+        {
+            first = middle + 1;
+        }
+        else
+        {
+            last = middle;
+        }
+    }
+
+    return nullptr;
+}
+
+std::vector<unsigned char> build(std::vector<Record> records, const std::vector<std::string>& names)
+{
+    std::vector<unsigned int> order(records.size());
+    for (unsigned int i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+
+    std::sort(order.begin(), order.end(), [&](const unsigned int left, const unsigned int right)
+    {
+        const int keyOrder = compareKeys(records[left].key, records[right].key);
+        return keyOrder ? (keyOrder < 0) : (names[left] < names[right]);
+    });
+
+    std::vector<char> strings(1, '\0');
+    Header header{};
+    header.magic = Header::k_magic;
+    header.major = Header::k_major;
+    header.minor = Header::k_minor;
+    header.headerSize = sizeof(Header);
+    header.recordSize = sizeof(Record);
+    header.count = static_cast<unsigned int>(records.size());
+
+    std::vector<Record> sorted;
+    sorted.reserve(records.size());
+    for (const auto index : order)
+    {
+        auto record = records[index];
+        record.name = static_cast<StrRef>(strings.size());
+        strings.insert(strings.end(), names[index].cbegin(), names[index].cend());
+        strings.push_back('\0');
+        header.totalSize += record.size;
+        sorted.push_back(record);
+    }
+
+    header.stringsSize = static_cast<unsigned int>(strings.size());
+
+    std::vector<unsigned char> image(sizeof(header) + sorted.size() * sizeof(Record) + strings.size());
+    memcpy(image.data(), &header, sizeof(header));
+    if (!sorted.empty())
+    {
+        memcpy(&image[sizeof(header)], sorted.data(), sorted.size() * sizeof(Record));
+    }
+    memcpy(&image[sizeof(header) + sorted.size() * sizeof(Record)], strings.data(), strings.size());
+
+    return image;
+}
+
+} // namespace SymbolIndex
+
+
+
+SymbolStore::Lock::Lock() noexcept : m_fd(-1)
+{
+}
+
+SymbolStore::Lock::Lock(const std::string& path, const bool wait) noexcept : m_fd(-1)
+{
+    while (true)
+    {
+        const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            return;
+        }
+
+        if (flock(fd, wait ? LOCK_EX : (LOCK_EX | LOCK_NB)) != 0)
+        {
+            close(fd);
+            return;
+        }
+
+        // The file could be unlinked by the eviction while we were waiting for it:
+        struct stat opened{};
+        struct stat current{};
+        if ((fstat(fd, &opened) == 0) && (stat(path.c_str(), &current) == 0)
+            && (opened.st_ino == current.st_ino) && (opened.st_dev == current.st_dev))
+        {
+            m_fd = fd;
+            return;
+        }
+
+        close(fd);
+        if (!wait)
+        {
+            return;
+        }
+    }
+}
+
+SymbolStore::Lock::~Lock()
+{
+    release();
+}
+
+SymbolStore::Lock::Lock(Lock&& lock) noexcept : m_fd(lock.m_fd)
+{
+    lock.m_fd = -1;
+}
+
+SymbolStore::Lock& SymbolStore::Lock::operator = (Lock&& lock) noexcept
+{
+    if (this != &lock)
+    {
+        release();
+        m_fd = lock.m_fd;
+        lock.m_fd = -1;
+    }
+
+    return *this;
+}
+
+bool SymbolStore::Lock::locked() const noexcept
+{
+    return m_fd >= 0;
+}
+
+void SymbolStore::Lock::release() noexcept
+{
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+
+
+size_t SymbolStore::IdHasher::operator () (const Id& id) const noexcept
+{
+    size_t hash = Pe::CodeView::SymbolKey::Hasher()(id.key);
+    hash ^= std::hash<std::string>()(id.name) + 0x9E3779B9u + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+bool SymbolStore::validName(const char* const name) noexcept
+{
+    if (!name || !*name || !strcmp(name, ".") || !strcmp(name, ".."))
+    {
+        return false;
+    }
+
+    return !strchr(name, '/') && !strchr(name, '\\');
+}
+
+std::string SymbolStore::indexPath() const
+{
+    return m_root + "/index.bin";
+}
+
+std::string SymbolStore::entryDir(const char* const name, const Pe::CodeView::SymbolKey& key) const
+{
+    char keyText[Pe::CodeView::SymbolKey::k_maxLength + 1]{};
+    key.format(keyText);
+
+    return m_root + "/" + name + "/" + keyText;
+}
+
+SymbolStore::SymbolStore(const std::string& root, const unsigned long long budget)
+    : m_root(root)
+    , m_budget(budget)
+    , m_mapping(nullptr)
+    , m_mappingSize(0)
+    , m_index(nullptr, 0)
+    , m_count(0)
+    , m_totalSize(0)
+    , m_indexInode(0)
+    , m_indexMtime(0)
+    , m_tempCounter(0)
+    , m_stats{}
+    , m_valid(false)
+{
+    while ((m_root.size() > 1) && (m_root.back() == '/'))
+    {
+        m_root.pop_back();
+    }
+
+    struct stat info{};
+    if (!makeDir(m_root) || (stat(m_root.c_str(), &info) != 0) || !S_ISDIR(info.st_mode))
+    {
+        return;
+    }
+
+    // A broken index is rebuilt by the next flush:
+    void* mapping = nullptr;
+    size_t size = 0;
+    loadIndex(mapping, size);
+    install(mapping, size);
+    m_valid = true;
+}
+
+SymbolStore::~SymbolStore()
+{
+    unmap(m_mapping, m_mappingSize);
+}
+
+bool SymbolStore::loadIndex(void*& mapping, size_t& size) noexcept
+{
+    mapping = nullptr;
+    size = 0;
+
+    const int fd = open(indexPath().c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        m_indexInode = 0;
+        m_indexMtime = 0;
+        return errno == ENOENT;
+    }
+
+    struct stat info{};
+    if ((fstat(fd, &info) != 0) || !info.st_size)
+    {
+        close(fd);
+        return false;
+    }
+
+    const auto fileSize = static_cast<size_t>(info.st_size);
+    void* const data = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    if (!SymbolIndex::View(data, fileSize).valid())
+    {
+        munmap(data, fileSize);
+        return false;
+    }
+
+    m_indexInode = static_cast<unsigned long long>(info.st_ino);
+    m_indexMtime = mtimeOf(info);
+    mapping = data;
+    size = fileSize;
+    return true;
+}
+
+void SymbolStore::install(void* const mapping, const size_t size) noexcept
+{
+    unmap(m_mapping, m_mappingSize);
+    m_mapping = mapping;
+    m_mappingSize = size;
+    m_index = SymbolIndex::View(mapping, size);
+    recount();
+}
+
+void SymbolStore::merge(void* const mapping, const size_t size)
+{
+    const SymbolIndex::View onDisk(mapping, size);
+    for (auto local = m_delta.begin(); local != m_delta.end();)
+    {
+        const auto* const record = onDisk.find(local->first.name.c_str(), local->first.key);
+        if (record)
+        {
+            local->second.lastAccess = std::max(local->second.lastAccess, record->lastAccess);
+            if (!local->second.added)
+            {
+                local->second.size = record->size;
+            }
+        }
+        else if (!local->second.added)
+        {
+            // Entries we knew before that are missing on disk were evicted by other processes:
+            local = m_delta.erase(local);
+            continue;
+        }
+
+        ++local;
+    }
+
+    install(mapping, size);
+}
+
+bool SymbolStore::writeIndex()
+{
+    std::vector<SymbolIndex::Record> records;
+    std::vector<std::string> names;
+    records.reserve(m_count);
+    names.reserve(m_count);
+    for (unsigned int i = 0; i < m_index.count(); ++i)
+    {
+        const auto& record = m_index[i];
+        Id id{ m_index.name(record), record.key };
+        if (!m_delta.count(id) && !m_removed.count(id))
+        {
+            records.push_back(record);
+            names.push_back(std::move(id.name));
+        }
+    }
+
+    for (const auto& entry : m_delta)
+    {
+        records.push_back(SymbolIndex::Record{ entry.first.key, 0, entry.second.size, entry.second.lastAccess });
+        names.push_back(entry.first.name);
+    }
+
+    const auto image = SymbolIndex::build(std::move(records), names);
+
+    const auto target = indexPath();
+    const auto temp = target + ".tmp." + std::to_string(getpid());
+    const int fd = open(temp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    // The written file becomes the new mapping, the rename keeps its inode and mtime:
+    struct stat info{};
+    void* mapping = MAP_FAILED;
+    if (writeAll(fd, image.data(), image.size()) && (fsync(fd) == 0) && (fstat(fd, &info) == 0))
+    {
+        mapping = mmap(nullptr, image.size(), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if ((mapping == MAP_FAILED) || (rename(temp.c_str(), target.c_str()) != 0))
+    {
+        if (mapping != MAP_FAILED)
+        {
+            munmap(mapping, image.size());
+        }
+        unlink(temp.c_str());
+        return false;
+    }
+
+    m_indexInode = static_cast<unsigned long long>(info.st_ino);
+    m_indexMtime = mtimeOf(info);
+
+    m_delta.clear();
+    m_removed.clear();
+    install(mapping, image.size());
+    return true;
+}
+
+void SymbolStore::recount() noexcept
+{
+    m_count = m_index.count();
+    m_totalSize = m_index.totalSize();
+
+    // The delta and the removed set never share an entry:
+    for (const auto& entry : m_delta)
+    {
+        const auto* const record = m_index.find(entry.first.name.c_str(), entry.first.key);
+        if (record)
+        {
+            m_totalSize -= record->size;
+        }
+        else
+        {
+            ++m_count;
+        }
+        m_totalSize += entry.second.size;
+    }
+
+    for (const auto& id : m_removed)
+    {
+        const auto* const record = m_index.find(id.name.c_str(), id.key);
+        if (record)
+        {
+            --m_count;
+            m_totalSize -= record->size;
+        }
+    }
+}
+
+bool SymbolStore::valid() const noexcept
+{
+    return m_valid;
+}
+
+const std::string& SymbolStore::root() const noexcept
+{
+    return m_root;
+}
+
+unsigned long long SymbolStore::budget() const noexcept
+{
+    return m_budget;
+}
+
+unsigned long long SymbolStore::totalSize() const noexcept
+{
+    return m_totalSize;
+}
+
+size_t SymbolStore::size() const noexcept
+{
+    return m_count;
+}
+
+const SymbolStore::Stats& SymbolStore::stats() const noexcept
+{
+    return m_stats;
+}
+
+std::string SymbolStore::path(const char* const name, const Pe::CodeView::SymbolKey& key) const
+{
+    if (!validName(name))
+    {
+        return {};
+    }
+
+    return entryDir(name, key) + "/" + name;
+}
+
+const SymbolStore::Entry* SymbolStore::find(const char* const name, const Pe::CodeView::SymbolKey& key) noexcept
+{
+    if (!name)
+    {
+        ++m_stats.misses;
+        return nullptr;
+    }
+
+    try
+    {
+        Id id{ name, key };
+        auto entry = m_delta.find(id);
+        if (entry == m_delta.end())
+        {
+            const auto* const record = m_removed.count(id) ? nullptr : m_index.find(name, key);
+            if (!record)
+            {
+                ++m_stats.misses;
+                return nullptr;
+            }
+
+            // Keeps the new access time until the next flush:
+            entry = m_delta.emplace(std::move(id), Entry{ record->size, record->lastAccess, false }).first;
+        }
+
+        entry->second.lastAccess = static_cast<long long>(time(nullptr));
+        ++m_stats.hits;
+        return &entry->second;
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+
+std::string SymbolStore::prepare(const char* const name, const Pe::CodeView::SymbolKey& key)
+{
+    if (!m_valid || !validName(name))
+    {
+        return {};
+    }
+
+    const auto dir = entryDir(name, key);
+    if (!makeDir(m_root + "/" + name) || !makeDir(dir))
+    {
+        return {};
+    }
+
+    return dir + "/" + name + ".tmp." + std::to_string(getpid()) + "." + std::to_string(m_tempCounter++);
+}
+
+bool SymbolStore::publish(const char* const name, const Pe::CodeView::SymbolKey& key, const std::string& tempPath)
+{
+    const auto target = path(name, key);
+    if (!m_valid || target.empty())
+    {
+        return false;
+    }
+
+    struct stat info{};
+    if ((stat(tempPath.c_str(), &info) != 0) || (rename(tempPath.c_str(), target.c_str()) != 0))
+    {
+        return false;
+    }
+
+    Id id{ name, key };
+    m_removed.erase(id);
+    m_delta[std::move(id)] = Entry{ static_cast<unsigned long long>(info.st_size), static_cast<long long>(time(nullptr)), true };
+    recount();
+
+    ++m_stats.published;
+    return true;
+}
+
+bool SymbolStore::remove(const char* const name, const Pe::CodeView::SymbolKey& key)
+{
+    const auto target = path(name, key);
+    if (target.empty())
+    {
+        return false;
+    }
+
+    if ((unlink(target.c_str()) != 0) && (errno != ENOENT))
+    {
+        return false;
+    }
+
+    Id id{ name, key };
+    m_delta.erase(id);
+    m_removed.insert(std::move(id));
+    recount();
+    return true;
+}
+
+SymbolStore::Lock SymbolStore::lock(const char* const name, const Pe::CodeView::SymbolKey& key, const bool wait)
+{
+    if (!m_valid || !validName(name))
+    {
+        return Lock();
+    }
+
+    const auto dir = entryDir(name, key);
+    if (!makeDir(m_root + "/" + name) || !makeDir(dir))
+    {
+        return Lock();
+    }
+
+    return Lock(dir + "/.lock", wait);
+}
+
+bool SymbolStore::refresh()
+{
+    if (!m_valid)
+    {
+        return false;
+    }
+
+    struct stat info{};
+    if (stat(indexPath().c_str(), &info) != 0)
+    {
+        return errno == ENOENT;
+    }
+
+    if ((static_cast<unsigned long long>(info.st_ino) == m_indexInode) && (mtimeOf(info) == m_indexMtime))
+    {
+        return true;
+    }
+
+    void* mapping = nullptr;
+    size_t size = 0;
+    if (!loadIndex(mapping, size))
+    {
+        return false;
+    }
+
+    merge(mapping, size);
+    return true;
+}
+
+bool SymbolStore::flush()
+{
+    if (!m_valid)
+    {
+        return false;
+    }
+
+    const Lock indexLock(m_root + "/index.lock", true);
+    if (!indexLock.locked())
+    {
+        return false;
+    }
+
+    void* mapping = nullptr;
+    size_t size = 0;
+    if (loadIndex(mapping, size))
+    {
+        merge(mapping, size);
+    }
+
+    return writeIndex();
+}
+
+bool SymbolStore::evict()
+{
+    if (!m_valid)
+    {
+        return false;
+    }
+
+    const Lock indexLock(m_root + "/index.lock", true);
+    if (!indexLock.locked())
+    {
+        return false;
+    }
+
+    void* mapping = nullptr;
+    size_t size = 0;
+    if (loadIndex(mapping, size))
+    {
+        merge(mapping, size);
+    }
+
+    if (m_totalSize > m_budget)
+    {
+        std::vector<std::pair<Id, Entry>> candidates;
+        candidates.reserve(m_count);
+        for (unsigned int i = 0; i < m_index.count(); ++i)
+        {
+            const auto& record = m_index[i];
+            Id id{ m_index.name(record), record.key };
+            if (!m_delta.count(id) && !m_removed.count(id))
+            {
+                candidates.emplace_back(std::move(id), Entry{ record.size, record.lastAccess, false });
+            }
+        }
+
+        for (const auto& entry : m_delta)
+        {
+            candidates.emplace_back(entry.first, entry.second);
+        }
+
+        std::sort(candidates.begin(), candidates.end(), [](const std::pair<Id, Entry>& left, const std::pair<Id, Entry>& right)
+        {
+            return left.second.lastAccess < right.second.lastAccess;
+        });
+
+        unsigned long long totalSize = m_totalSize;
+        for (const auto& candidate : candidates)
+        {
+            if (totalSize <= m_budget)
+            {
+                break;
+            }
+
+            const auto& id = candidate.first;
+            const auto dir = entryDir(id.name.c_str(), id.key);
+            const auto lockPath = dir + "/.lock";
+
+            // Entries held by downloads and readers are skipped:
+            const Lock entryLock(lockPath, false);
+            if (!entryLock.locked() && (access(lockPath.c_str(), F_OK) == 0))
+            {
+                continue;
+            }
+
+            const auto target = dir + "/" + id.name;
+            if ((unlink(target.c_str()) != 0) && (errno != ENOENT))
+            {
+                continue;
+            }
+
+            unlink(lockPath.c_str());
+            rmdir(dir.c_str());
+            rmdir((m_root + "/" + id.name).c_str()); // Fails if there are other versions
+
+            const auto entrySize = candidate.second.size;
+            totalSize -= entrySize;
+            ++m_stats.evictedFiles;
+            m_stats.evictedBytes += entrySize;
+
+            m_delta.erase(id);
+            m_removed.insert(id);
+        }
+
+        recount();
+    }
+
+    return writeIndex();
+}
+
+
+
+} // namespace Corpus
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <Pe/Pe.hpp>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Corpus
+{
+
+
+
+// Relative path of a PDB in the symbol server layout: "name.pdb/KEY/name.pdb":
+std::string symbolPath(const char* pdbName, const Pe::CodeView::SymbolKey& key);
+
+namespace SymbolIndex
+{
+
+//
+// Fixed-layout index of the symbol store that is queried in place from a mapped file:
+//
+//   Header
+//   Record [count] - sorted by the key bytes, then by the name
+//   char   [stringsSize] - null-terminated names, offset zero is the empty string
+//
+
+using StrRef = unsigned int;
+
+struct Header
+{
+    static constexpr unsigned int k_magic = 0x59534550u; // "PESY"
+    static constexpr unsigned short k_major = 1;
+    static constexpr unsigned short k_minor = 0;
+
+    unsigned int magic;
+    unsigned short major;
+    unsigned short minor;
+    unsigned int headerSize;
+    unsigned int recordSize;
+    unsigned int count;
+    unsigned int stringsSize;
+    unsigned long long totalSize; // Sum of the file sizes
+};
+
+struct Record
+{
+    Pe::CodeView::SymbolKey key;
+    StrRef name;
+    unsigned long long size;
+    long long lastAccess; // Seconds since the epoch
+};
+
+static_assert(sizeof(Header) == 32, "Unexpected layout");
+static_assert(sizeof(Record) == 40, "Unexpected layout");
+
+class View
+{
+private:
+    const unsigned char* m_data;
+    size_t m_size;
+    const Header* m_header;
+    const char* m_strings;
+
+public:
+    View(const void* data, size_t size) noexcept;
+
+    bool valid() const noexcept;
+
+    unsigned int count() const noexcept;
+    unsigned long long totalSize() const noexcept;
+
+    const Record& operator [] (unsigned int index) const noexcept;
+    const char* name(const Record& record) const noexcept;
+
+    const Record* find(const char* name, const Pe::CodeView::SymbolKey& key) const noexcept;
+};
+
+// Serializes the records (their name fields are ignored) with the given names:
+std::vector<unsigned char> build(std::vector<Record> records, const std::vector<std::string>& names);
+
+} // namespace SymbolIndex
+
+
+
+//
+// Local symbol store in the symbol server layout: "root/name.pdb/KEY/name.pdb".
+// Lookups are answered without touching the filesystem: from the mapped "root/index.bin" in the SymbolIndex format
+// and from a small map of the entries published or looked up since it was mapped.
+//
+// Several processes may share one store:
+// * files are written to temporary files next to their final place and renamed atomically;
+// * the index is merged with the on-disk copy and replaced by rename under the "root/index.lock" flock;
+// * an entry being downloaded or read is held by its "name.pdb/KEY/.lock" flock,
+//   and eviction skips the held entries.
+// Eviction removes the least recently used files until the total size fits the budget.
+// Not thread-safe: use one instance per thread or an external mutex.
+//
+
+class SymbolStore
+{
+public:
+    struct Entry
+    {
+        unsigned long long size;
+        long long lastAccess;
+        bool added; // Published by this instance since the last flush
+    };
+
+    struct Stats
+    {
+        unsigned long long hits;
+        unsigned long long misses;
+        unsigned long long published;
+        unsigned long long evictedFiles;
+        unsigned long long evictedBytes;
+    };
+
+    // flock-based advisory lock across processes:
+    class Lock
+    {
+    private:
+        int m_fd;
+
+    public:
+        Lock() noexcept;
+        Lock(const std::string& path, bool wait) noexcept;
+        ~Lock();
+
+        Lock(const Lock&) = delete;
+        Lock& operator = (const Lock&) = delete;
+
+        Lock(Lock&& lock) noexcept;
+        Lock& operator = (Lock&& lock) noexcept;
+
+        bool locked() const noexcept;
+        void release() noexcept;
+    };
+
+private:
+    struct Id
+    {
+        std::string name;
+        Pe::CodeView::SymbolKey key;
+
+        bool operator == (const Id& id) const noexcept
+        {
+            return (key == id.key) && (name == id.name);
+        }
+    };
+
+    struct IdHasher
+    {
+        size_t operator () (const Id& id) const noexcept;
+    };
+
+private:
+    std::string m_root;
+    unsigned long long m_budget;
+    void* m_mapping; // The index as of the last load or flush
+    size_t m_mappingSize;
+    SymbolIndex::View m_index;
+    std::unordered_map<Id, Entry, IdHasher> m_delta; // Published or looked up since the mapping
+    std::unordered_set<Id, IdHasher> m_removed; // Hidden in the mapping
+    size_t m_count;
+    unsigned long long m_totalSize;
+    unsigned long long m_indexInode;
+    long long m_indexMtime; // Nanoseconds
+    unsigned long long m_tempCounter;
+    Stats m_stats;
+    bool m_valid;
+
+private:
+    static bool validName(const char* name) noexcept;
+
+    std::string indexPath() const;
+    std::string entryDir(const char* name, const Pe::CodeView::SymbolKey& key) const;
+
+    bool loadIndex(void*& mapping, size_t& size) noexcept;
+    void merge(void* mapping, size_t size);
+    void install(void* mapping, size_t size) noexcept;
+    bool writeIndex();
+    void recount() noexcept;
+
+public:
+    SymbolStore(const std::string& root, unsigned long long budget);
+    ~SymbolStore();
+
+    SymbolStore(const SymbolStore&) = delete;
+    SymbolStore& operator = (const SymbolStore&) = delete;
+
+    bool valid() const noexcept;
+
+    const std::string& root() const noexcept;
+    unsigned long long budget() const noexcept;
+    unsigned long long totalSize() const noexcept;
+    size_t size() const noexcept;
+    const Stats& stats() const noexcept;
+
+    // Absolute path of the entry, empty if the name isn't a plain file name:
+    std::string path(const char* name, const Pe::CodeView::SymbolKey& key) const;
+
+    // Checks the index only and refreshes the access time of the found entry:
+    const Entry* find(const char* name, const Pe::CodeView::SymbolKey& key) noexcept;
+
+    // Creates the entry directory and returns a unique temporary path in it to download to:
+    std::string prepare(const char* name, const Pe::CodeView::SymbolKey& key);
+
+    // Atomically moves the downloaded file into its place and indexes it:
+    bool publish(const char* name, const Pe::CodeView::SymbolKey& key, const std::string& tempPath);
+
+    bool remove(const char* name, const Pe::CodeView::SymbolKey& key);
+
+    // Holds the entry against concurrent downloads and eviction by other processes:
+    Lock lock(const char* name, const Pe::CodeView::SymbolKey& key, bool wait);
+
+    // Picks up the changes of other processes if the on-disk index was replaced:
+    bool refresh();
+
+    // Merges the index with the on-disk copy and replaces it:
+    bool flush();
+
+    // Removes the least recently used entries until the total size fits the budget, then flushes:
+    bool evict();
+};
+
+
+
+} // namespace Corpus
@@ -0,0 +1,943 @@
+#include "UringReader.h"
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <unordered_set>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace Corpus
+{
+
+namespace
+{
+
+constexpr unsigned int k_maxRead = 1024 * 1024; // Large sections are split to keep the queue balanced
+constexpr unsigned int k_minimalSectionAlignment = 512; // Pe::byRva aligns raw offsets down to it
+constexpr unsigned int k_maxRetries = 8; // Of a read interrupted with EINTR or EAGAIN
+constexpr unsigned int k_maxOps = 256; // IORING_REGISTER_PROBE reports at most this many opcodes
+
+// Retries are delayed for 1, 2, 4... milliseconds:
+std::chrono::milliseconds retryDelay(const unsigned int attempt) noexcept
+{
+    return std::chrono::milliseconds(1u << (attempt - 1));
+}
+
+} // namespace
+
+
+
+class UringReader::Ring
+{
+private:
+    int m_fd;
+    unsigned char* m_sq;
+    size_t m_sqSize;
+    unsigned char* m_cq;
+    size_t m_cqSize;
+    io_uring_sqe* m_sqes;
+    size_t m_sqesSize;
+
+    unsigned int* m_sqHead;
+    unsigned int* m_sqTail;
+    unsigned int m_sqMask;
+    unsigned int* m_sqArray;
+    unsigned int m_sqEntries;
+
+    unsigned int* m_cqHead;
+    unsigned int* m_cqTail;
+    unsigned int m_cqMask;
+    io_uring_cqe* m_cqes;
+
+    unsigned int m_pending; // Prepared but not submitted
+
+private:
+    bool enter(const unsigned int submit) noexcept
+    {
+        for (;;)
+        {
+            const long result = syscall(__NR_io_uring_enter, m_fd, submit, 1u, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (result >= 0)
+            {
+                m_pending -= static_cast<unsigned int>(result);
+                return true;
+            }
+
+            if (errno != EINTR)
+            {
+                return false;
+            }
+        }
+    }
+
+    // IORING_OP_READ appeared in 5.6, the ring itself in 5.1:
+    bool supportsRead() const noexcept
+    {
+        std::vector<unsigned char> buffer(sizeof(io_uring_probe) + k_maxOps * sizeof(io_uring_probe_op));
+        auto* const probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+        if (syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, k_maxOps) != 0)
+        {
+            return false; // The probe itself appeared in 5.6 too
+        }
+
+        return (probe->last_op >= IORING_OP_READ) && ((probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) != 0);
+    }
+
+public:
+    Ring() noexcept
+        : m_fd(-1), m_sq(nullptr), m_sqSize(0), m_cq(nullptr), m_cqSize(0), m_sqes(nullptr), m_sqesSize(0)
+        , m_sqHead(nullptr), m_sqTail(nullptr), m_sqMask(0), m_sqArray(nullptr), m_sqEntries(0)
+        , m_cqHead(nullptr), m_cqTail(nullptr), m_cqMask(0), m_cqes(nullptr), m_pending(0)
+    {
+    }
+
+    ~Ring()
+    {
+        if (m_sqes)
+        {
+            munmap(m_sqes, m_sqesSize);
+        }
+
+        if (m_cq && (m_cq != m_sq))
+        {
+            munmap(m_cq, m_cqSize);
+        }
+
+        if (m_sq)
+        {
+            munmap(m_sq, m_sqSize);
+        }
+
+        if (m_fd >= 0)
+        {
+            close(m_fd);
+        }
+    }
+
+    bool init(const unsigned int entries) noexcept
+    {
+        io_uring_params params{};
+        m_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if ((m_fd < 0) || !supportsRead())
+        {
+            return false;
+        }
+
+        m_sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+        m_cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap)
+        {
+            m_sqSize = m_cqSize = (m_sqSize > m_cqSize) ? m_sqSize : m_cqSize;
+        }
+
+        void* const sq = mmap(nullptr, m_sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        if (sq == MAP_FAILED)
+        {
+            return false;
+        }
+        m_sq = static_cast<unsigned char*>(sq);
+
+        if (singleMmap)
+        {
+            m_cq = m_sq;
+        }
+        else
+        {
+            void* const cq = mmap(nullptr, m_cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+            if (cq == MAP_FAILED)
+            {
+                return false;
+            }
+            m_cq = static_cast<unsigned char*>(cq);
+        }
+
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* const sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+        {
+            m_sqes = nullptr;
+            return false;
+        }
+        m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+        m_sqHead = reinterpret_cast<unsigned int*>(m_sq + params.sq_off.head);
+        m_sqTail = reinterpret_cast<unsigned int*>(m_sq + params.sq_off.tail);
+        m_sqMask = *reinterpret_cast<unsigned int*>(m_sq + params.sq_off.ring_mask);
+        m_sqArray = reinterpret_cast<unsigned int*>(m_sq + params.sq_off.array);
+        m_sqEntries = params.sq_entries;
+
+        m_cqHead = reinterpret_cast<unsigned int*>(m_cq + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned int*>(m_cq + params.cq_off.tail);
+        m_cqMask = *reinterpret_cast<unsigned int*>(m_cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(m_cq + params.cq_off.cqes);
+
+        return true;
+    }
+
+    unsigned int entries() const noexcept
+    {
+        return m_sqEntries;
+    }
+
+    bool prepareRead(const int fd, void* const buf, const unsigned int size, const unsigned long long offset, const unsigned long long userData) noexcept
+    {
+        const unsigned int tail = *m_sqTail;
+        if (tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries)
+        {
+            return false;
+        }
+
+        const unsigned int index = tail & m_sqMask;
+        io_uring_sqe& sqe = m_sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<unsigned long long>(buf);
+        sqe.len = size;
+        sqe.off = offset;
+        sqe.user_data = userData;
+
+        m_sqArray[index] = index;
+        __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++m_pending;
+        return true;
+    }
+
+    // Submits the prepared reads and waits for at least one completion:
+    bool submitAndWait() noexcept
+    {
+        return enter(m_pending);
+    }
+
+    // Waits for a completion of the submitted reads without submitting new ones:
+    bool wait() noexcept
+    {
+        return enter(0);
+    }
+
+    // Takes back the prepared reads that the kernel hasn't consumed, the last one first:
+    template <typename Callback>
+    void withdraw(Callback&& callback)
+    {
+        const unsigned int head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        unsigned int tail = *m_sqTail;
+        while (tail != head)
+        {
+            --tail;
+            callback(m_sqes[m_sqArray[tail & m_sqMask]].user_data);
+        }
+
+        __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+        m_pending = 0;
+    }
+
+    template <typename Callback>
+    void drain(Callback&& callback)
+    {
+        unsigned int head = *m_cqHead;
+        while (head != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+        {
+            const io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+            const auto userData = cqe.user_data;
+            const auto result = cqe.res;
+            ++head;
+            __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+            callback(userData, result);
+        }
+    }
+};
+
+
+
+struct UringReader::File
+{
+    enum class Stage
+    {
+        headers,
+        sections
+    };
+
+    std::string path;
+    int fd;
+    unsigned long long size;
+    unsigned char* buffer;
+    size_t mappedSize;
+    unsigned long long headersRead; // Bytes at the beginning of the buffer
+    unsigned int pendingReads;
+    unsigned int inRing; // Submitted to the kernel and not completed yet
+    Stage stage;
+    Pe::Arch arch;
+    bool failed;
+
+    ~File()
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+
+        if (buffer)
+        {
+            munmap(buffer, mappedSize);
+        }
+    }
+};
+
+struct UringReader::Read
+{
+    File* file;
+    unsigned long long offset;
+    unsigned int size;
+    unsigned int retries;
+};
+
+
+
+class UringReader::Session
+{
+private:
+    const Options& m_options;
+    Ring* m_ring; // Null without io_uring or after it has failed
+    bool m_ringFailed;
+    const Handler& m_handler;
+    Stats m_stats;
+
+    std::unordered_set<File*> m_open; // Being read
+    std::deque<Read*> m_backlog;
+    std::multimap<std::chrono::steady_clock::time_point, Read*> m_retries;
+    unsigned int m_inFlight;
+    std::vector<std::pair<Read*, int>> m_syncCompletions; // Without io_uring
+
+    // Shared with the workers:
+    std::mutex m_mutex;
+    std::condition_variable m_ready;
+    std::condition_variable m_space;
+    std::deque<File*> m_queue;
+    unsigned int m_filesInMemory;
+    bool m_finished;
+    unsigned long long m_delivered;
+    unsigned long long m_handlerFailures;
+
+private:
+    void worker()
+    {
+        for (;;)
+        {
+            File* file = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_ready.wait(lock, [this]() { return !m_queue.empty() || m_finished; });
+                if (m_queue.empty())
+                {
+                    return;
+                }
+
+                file = m_queue.front();
+                m_queue.pop_front();
+            }
+
+            bool handled = true;
+            try
+            {
+                const Image image{ file->path.c_str(), file->buffer, file->size, file->arch };
+                m_handler(image);
+            }
+            catch (...)
+            {
+                handled = false;
+            }
+
+            delete file;
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                --m_filesInMemory;
+                ++(handled ? m_delivered : m_handlerFailures);
+            }
+            m_space.notify_one();
+        }
+    }
+
+    void release(File* const file)
+    {
+        m_open.erase(file);
+        delete file;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_filesInMemory;
+        }
+    }
+
+    void deliver(File* const file)
+    {
+        m_open.erase(file);
+        close(file->fd);
+        file->fd = -1;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.push_back(file);
+        }
+        m_ready.notify_one();
+    }
+
+    void enqueueRead(File& file, const unsigned long long offset, const unsigned long long size)
+    {
+        for (unsigned long long pos = 0; pos < size; pos += k_maxRead)
+        {
+            const auto chunk = static_cast<unsigned int>(((size - pos) < k_maxRead) ? (size - pos) : k_maxRead);
+            m_backlog.push_back(new Read{ &file, offset + pos, chunk, 0 });
+            ++file.pendingReads;
+        }
+    }
+
+    bool open(const std::string& path)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        struct stat info{};
+        if ((fstat(fd, &info) != 0) || !S_ISREG(info.st_mode) || (info.st_size < static_cast<off_t>(sizeof(IMAGE_DOS_HEADER))))
+        {
+            close(fd);
+            return false;
+        }
+
+        const auto size = static_cast<unsigned long long>(info.st_size);
+        void* const buffer = mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (buffer == MAP_FAILED)
+        {
+            close(fd);
+            return false;
+        }
+
+        auto* const file = new File{ path, fd, size, static_cast<unsigned char*>(buffer), static_cast<size_t>(size), 0, 0, 0, File::Stage::headers, Pe::Arch::unknown, false };
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_filesInMemory;
+        }
+        m_open.insert(file);
+
+        const auto first = (size < m_options.headerSize) ? size : m_options.headerSize;
+        enqueueRead(*file, 0, first);
+        file->headersRead = first;
+        return true;
+    }
+
+    // Size of the headers up to the end of the section table, zero if it isn't a PE:
+    static unsigned long long headersSize(const unsigned char* const buffer, const unsigned long long available, const unsigned long long fileSize, Pe::Arch& arch) noexcept
+    {
+        const auto* const dos = reinterpret_cast<const IMAGE_DOS_HEADER*>(buffer);
+        if ((available < sizeof(*dos)) || (dos->e_magic != 0x5A4D) || (dos->e_lfanew < 0))
+        {
+            return 0;
+        }
+
+        const auto ntOffset = static_cast<unsigned long long>(dos->e_lfanew);
+        const auto optOffset = ntOffset + offsetof(IMAGE_NT_HEADERS32, OptionalHeader);
+        if (optOffset + sizeof(unsigned short) > fileSize)
+        {
+            return 0;
+        }
+
+        if (optOffset + sizeof(unsigned short) > available)
+        {
+            return optOffset + sizeof(unsigned short); // Read more to find out
+        }
+
+        const auto* const nt = reinterpret_cast<const IMAGE_NT_HEADERS32*>(buffer + ntOffset);
+        const auto magic = *reinterpret_cast<const unsigned short*>(buffer + optOffset);
+        if (nt->Signature != 0x00004550)
+        {
+            return 0;
+        }
+
+        unsigned long long minimalOptSize = 0;
+        switch (magic)
+        {
+        case Pe::Types<Pe::Arch::x32>::k_magic:
+        {
+            arch = Pe::Arch::x32;
+            minimalOptSize = sizeof(IMAGE_OPTIONAL_HEADER32);
+            break;
+        }
+        case Pe::Types<Pe::Arch::x64>::k_magic:
+        {
+            arch = Pe::Arch::x64;
+            minimalOptSize = sizeof(IMAGE_OPTIONAL_HEADER64);
+            break;
+        }
+        default:
+        {
+            return 0;
+        }
+        }
+
+        const auto sectionsOffset = optOffset + nt->FileHeader.SizeOfOptionalHeader;
+        const auto size = sectionsOffset + static_cast<unsigned long long>(nt->FileHeader.NumberOfSections) * sizeof(IMAGE_SECTION_HEADER);
+        if ((nt->FileHeader.SizeOfOptionalHeader < minimalOptSize) || (size > fileSize))
+        {
+            return 0;
+        }
+
+        return size;
+    }
+
+    template <Pe::Arch arch>
+    void scheduleSections(File& file)
+    {
+        const auto pe = Pe::Pe<arch>::fromFile(file.buffer);
+        const auto* const optHdr = pe.headers().opt();
+        const auto sections = pe.sections();
+
+        std::vector<bool> needed(sections.count());
+        const unsigned int directories = (optHdr->NumberOfRvaAndSizes < IMAGE_NUMBEROF_DIRECTORY_ENTRIES)
+            ? optHdr->NumberOfRvaAndSizes
+            : IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+
+        for (unsigned int id = 0; id < directories; ++id)
+        {
+            // The security directory is addressed by a file offset and isn't mapped:
+            if (!(m_options.directories & (1u << id)) || (id == IMAGE_DIRECTORY_ENTRY_SECURITY))
+            {
+                continue;
+            }
+
+            const auto& dir = optHdr->DataDirectory[id];
+            if (!dir.VirtualAddress || !dir.Size)
+            {
+                continue;
+            }
+
+            unsigned int index = 0;
+            for (const auto& sec : sections)
+            {
+                const auto extent = (sec.Misc.VirtualSize > sec.SizeOfRawData) ? sec.Misc.VirtualSize : sec.SizeOfRawData;
+                if ((dir.VirtualAddress >= sec.VirtualAddress) && (dir.VirtualAddress < sec.VirtualAddress + static_cast<unsigned long long>(extent)))
+                {
+                    needed[index] = true;
+                }
+                ++index;
+            }
+        }
+
+        unsigned int index = 0;
+        for (const auto& sec : sections)
+        {
+            if (needed[index++] && sec.SizeOfRawData)
+            {
+                const unsigned long long begin = (optHdr->SectionAlignment >= k_minimalSectionAlignment)
+                    ? (sec.PointerToRawData & ~static_cast<unsigned long long>(k_minimalSectionAlignment - 1))
+                    : sec.PointerToRawData;
+
+                const unsigned long long end = static_cast<unsigned long long>(sec.PointerToRawData) + sec.SizeOfRawData;
+                const unsigned long long clampedBegin = (begin > file.headersRead) ? begin : file.headersRead;
+                const unsigned long long clampedEnd = (end < file.size) ? end : file.size;
+                if (clampedBegin < clampedEnd)
+                {
+                    enqueueRead(file, clampedBegin, clampedEnd - clampedBegin);
+                }
+            }
+        }
+    }
+
+    void advance(File& file)
+    {
+        if (file.failed)
+        {
+            ++m_stats.failed;
+            release(&file);
+            return;
+        }
+
+        if (file.stage == File::Stage::headers)
+        {
+            const auto size = headersSize(file.buffer, file.headersRead, file.size, file.arch);
+            if (!size)
+            {
+                ++m_stats.failed;
+                release(&file);
+                return;
+            }
+
+            if (size > file.headersRead)
+            {
+                enqueueRead(file, file.headersRead, size - file.headersRead);
+                file.headersRead = size;
+                return;
+            }
+
+            file.stage = File::Stage::sections;
+            if (file.arch == Pe::Arch::x32)
+            {
+                scheduleSections<Pe::Arch::x32>(file);
+            }
+            else
+            {
+                scheduleSections<Pe::Arch::x64>(file);
+            }
+
+            if (file.pendingReads)
+            {
+                return;
+            }
+        }
+
+        deliver(&file);
+    }
+
+    void complete(Read* const read, const int result)
+    {
+        File& file = *read->file;
+        if (((result == -EINTR) || (result == -EAGAIN)) && (read->retries < k_maxRetries))
+        {
+            ++read->retries;
+            m_retries.emplace(std::chrono::steady_clock::now() + retryDelay(read->retries), read);
+            return;
+        }
+
+        if (result > 0)
+        {
+            ++m_stats.reads;
+            m_stats.bytesRead += static_cast<unsigned int>(result);
+        }
+
+        if ((result > 0) && (static_cast<unsigned int>(result) < read->size))
+        {
+            // Short read, ask for the rest:
+            read->offset += static_cast<unsigned int>(result);
+            read->size -= static_cast<unsigned int>(result);
+            m_backlog.push_front(read);
+            return;
+        }
+
+        if (result <= 0)
+        {
+            file.failed = true; // An error or the file was truncated
+        }
+
+        delete read;
+        if (--file.pendingReads == 0)
+        {
+            advance(file);
+        }
+    }
+
+    void submitBacklog()
+    {
+        while (!m_backlog.empty() && (m_inFlight < m_options.queueDepth))
+        {
+            Read* const read = m_backlog.front();
+            if (m_ring)
+            {
+                const auto userData = static_cast<unsigned long long>(reinterpret_cast<size_t>(read));
+                if (!m_ring->prepareRead(read->file->fd, read->file->buffer + read->offset, read->size, read->offset, userData))
+                {
+                    break;
+                }
+                ++m_inFlight;
+                ++read->file->inRing;
+            }
+            else
+            {
+                const auto result = pread(read->file->fd, read->file->buffer + read->offset, read->size, static_cast<off_t>(read->offset));
+                m_syncCompletions.emplace_back(read, (result < 0) ? -errno : static_cast<int>(result));
+            }
+            m_backlog.pop_front();
+        }
+    }
+
+    void reap(const unsigned long long userData, const int result)
+    {
+        Read* const read = reinterpret_cast<Read*>(static_cast<size_t>(userData));
+        --m_inFlight;
+        --read->file->inRing;
+        complete(read, result);
+    }
+
+    // Moves the retries whose delay has passed to the backlog:
+    void promoteRetries()
+    {
+        const auto now = std::chrono::steady_clock::now();
+        while (!m_retries.empty() && (m_retries.begin()->first <= now))
+        {
+            m_backlog.push_back(m_retries.begin()->second);
+            m_retries.erase(m_retries.begin());
+        }
+    }
+
+    // The ring has failed: waits for the submitted reads and goes on over pread.
+    // Files whose reads can't be reaped are failed and their buffers are leaked,
+    // as the kernel may still write to them:
+    void fallBack()
+    {
+        m_ring->withdraw([this](const unsigned long long userData)
+        {
+            Read* const read = reinterpret_cast<Read*>(static_cast<size_t>(userData));
+            --m_inFlight;
+            --read->file->inRing;
+            m_backlog.push_front(read);
+        });
+
+        do
+        {
+            m_ring->drain([this](const unsigned long long userData, const int result)
+            {
+                reap(userData, result);
+            });
+        } while (m_inFlight && m_ring->wait());
+
+        m_ring = nullptr;
+        m_ringFailed = true;
+        if (!m_inFlight)
+        {
+            return;
+        }
+
+        std::unordered_set<File*> abandoned;
+        for (File* const file : m_open)
+        {
+            if (file->inRing)
+            {
+                abandoned.insert(file);
+            }
+        }
+
+        const auto isAbandoned = [&abandoned](const Read* const read) -> bool
+        {
+            return abandoned.count(read->file) != 0;
+        };
+
+        for (auto it = m_backlog.begin(); it != m_backlog.end();)
+        {
+            if (isAbandoned(*it))
+            {
+                delete *it;
+                it = m_backlog.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        for (auto it = m_retries.begin(); it != m_retries.end();)
+        {
+            if (isAbandoned(it->second))
+            {
+                delete it->second;
+                it = m_retries.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        for (File* const file : abandoned)
+        {
+            file->buffer = nullptr;
+            ++m_stats.failed;
+            release(file);
+        }
+
+        m_inFlight = 0;
+    }
+
+    bool hasSpace()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_filesInMemory < m_options.maxFiles;
+    }
+
+public:
+    Session(const Options& options, Ring* const ring, const Handler& handler)
+        : m_options(options), m_ring(ring), m_ringFailed(false), m_handler(handler), m_stats{}, m_inFlight(0)
+        , m_filesInMemory(0), m_finished(false), m_delivered(0), m_handlerFailures(0)
+    {
+    }
+
+    Stats run(const std::vector<std::string>& paths)
+    {
+        const unsigned int workerCount = m_options.workers
+            ? m_options.workers
+            : ((std::thread::hardware_concurrency() > 0) ? std::thread::hardware_concurrency() : 1);
+
+        std::vector<std::thread> workers;
+        workers.reserve(workerCount);
+        for (unsigned int i = 0; i < workerCount; ++i)
+        {
+            workers.emplace_back(&Session::worker, this);
+        }
+
+        size_t next = 0;
+        for (;;)
+        {
+            // Open new files while there are free slots:
+            while ((next < paths.size()) && (m_backlog.size() + m_inFlight < m_options.queueDepth) && hasSpace())
+            {
+                if (!open(paths[next++]))
+                {
+                    ++m_stats.failed;
+                }
+            }
+
+            promoteRetries();
+            submitBacklog();
+
+            if (!m_inFlight && m_syncCompletions.empty())
+            {
+                if (!m_backlog.empty())
+                {
+                    continue;
+                }
+
+                if (!m_retries.empty())
+                {
+                    std::this_thread::sleep_until(m_retries.begin()->first);
+                    continue;
+                }
+
+                if (next == paths.size())
+                {
+                    break;
+                }
+
+                // Every slot is taken by the files waiting for the workers:
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_space.wait(lock, [this]() { return m_filesInMemory < m_options.maxFiles; });
+                continue;
+            }
+
+            if (m_ring)
+            {
+                if (m_inFlight && !m_ring->submitAndWait())
+                {
+                    fallBack();
+                    continue;
+                }
+
+                m_ring->drain([this](const unsigned long long userData, const int result)
+                {
+                    reap(userData, result);
+                });
+            }
+
+            auto completions = std::move(m_syncCompletions);
+            m_syncCompletions.clear();
+            for (const auto& completion : completions)
+            {
+                complete(completion.first, completion.second);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_finished = true;
+        }
+        m_ready.notify_all();
+
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+
+        m_stats.delivered = m_delivered;
+        m_stats.failed += m_handlerFailures;
+        return m_stats;
+    }
+
+    bool ringFailed() const noexcept
+    {
+        return m_ringFailed;
+    }
+};
+
+
+
+UringReader::Options UringReader::Options::defaults() noexcept
+{
+    Options options{};
+    options.queueDepth = 128;
+    options.headerSize = 4096;
+    options.directories = (1u << IMAGE_DIRECTORY_ENTRY_EXPORT)
+        | (1u << IMAGE_DIRECTORY_ENTRY_IMPORT)
+        | (1u << IMAGE_DIRECTORY_ENTRY_DEBUG)
+        | (1u << IMAGE_DIRECTORY_ENTRY_TLS)
+        | (1u << IMAGE_DIRECTORY_ENTRY_IAT)
+        | (1u << IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT)
+        | (1u << IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR);
+    options.workers = 0;
+    options.maxFiles = 256;
+    return options;
+}
+
+UringReader::UringReader(const Options& options) : m_options(options)
+{
+    if (!m_options.queueDepth)
+    {
+        m_options.queueDepth = Options::defaults().queueDepth;
+    }
+
+    if (m_options.headerSize < sizeof(IMAGE_DOS_HEADER))
+    {
+        m_options.headerSize = Options::defaults().headerSize;
+    }
+
+    if (m_options.maxFiles < 1)
+    {
+        m_options.maxFiles = 1;
+    }
+
+    std::unique_ptr<Ring> ring(new Ring());
+    if (ring->init(m_options.queueDepth))
+    {
+        // The kernel may round the queue up, never submit more than it has:
+        if (m_options.queueDepth > ring->entries())
+        {
+            m_options.queueDepth = ring->entries();
+        }
+        m_ring = std::move(ring);
+    }
+}
+
+UringReader::~UringReader() = default;
+
+bool UringReader::async() const noexcept
+{
+    return m_ring != nullptr;
+}
+
+const UringReader::Options& UringReader::options() const noexcept
+{
+    return m_options;
+}
+
+UringReader::Stats UringReader::run(const std::vector<std::string>& paths, const Handler& handler)
+{
+    Session session(m_options, m_ring.get(), handler);
+    const auto stats = session.run(paths);
+    if (session.ringFailed())
+    {
+        m_ring.reset(); // The next runs go over pread
+    }
+    return stats;
+}
+
+} // namespace Corpus
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <Pe/Pe.hpp>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+namespace Corpus
+{
+
+
+
+//
+// Linux-only asynchronous corpus reader for cold-cache scans:
+// keeps up to queueDepth reads in flight through io_uring, reads the headers of every file first,
+// then reads only the sections that contain the requested data directories
+// and hands the file to a pool of parser threads.
+// A delivered image has the file layout (use Pe::fromFile): the bytes that weren't read are zeroes
+// and don't consume memory as the buffer is an anonymous mapping.
+// If io_uring isn't available (old kernel or seccomp) or fails during a run, the same pipeline works over pread.
+// Reads interrupted with EINTR or EAGAIN are retried a few times with a growing delay.
+//
+
+class UringReader
+{
+public:
+    struct Options
+    {
+        unsigned int queueDepth;  // Reads in flight
+        unsigned int headerSize;  // Size of the first read of every file
+        unsigned int directories; // Mask of (1 << IMAGE_DIRECTORY_ENTRY_*) to read
+        unsigned int workers;     // Parser threads, zero means the number of CPUs
+        unsigned int maxFiles;    // Files in memory: being read and waiting for a worker
+
+        static Options defaults() noexcept;
+    };
+
+    struct Image
+    {
+        const char* path;
+        const void* data;
+        unsigned long long size;
+        Pe::Arch arch;
+    };
+
+    // Called from the worker threads, the image is valid only inside the handler:
+    using Handler = std::function<void(const Image& image)>;
+
+    struct Stats
+    {
+        unsigned long long delivered;
+        unsigned long long failed;  // Unreadable files and non-PE files
+        unsigned long long reads;
+        unsigned long long bytesRead;
+    };
+
+private:
+    class Ring;
+    struct File;
+    struct Read;
+    class Session;
+
+private:
+    Options m_options;
+    std::unique_ptr<Ring> m_ring;
+
+public:
+    explicit UringReader(const Options& options = Options::defaults());
+    ~UringReader();
+
+    UringReader(const UringReader&) = delete;
+    UringReader& operator = (const UringReader&) = delete;
+
+    // False if the reader works over pread:
+    bool async() const noexcept;
+
+    const Options& options() const noexcept;
+
+    // Blocks until all files are read and handled:
+    Stats run(const std::vector<std::string>& paths, const Handler& handler);
+};
+
+
+
+} // namespace Corpus
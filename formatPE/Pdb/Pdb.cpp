@@ -5,9 +5,6 @@
 #include <DbgHelp.h>
 #pragma comment(lib, "dbghelp.lib")
 
-#include <sstream>
-#include <iomanip>
-
 namespace Pdb
 {
 
@@ -83,59 +80,17 @@ const PdbInfo::IndexInfo& PdbInfo::info() const noexcept
     return m_info;
 }
 
-std::wstring PdbInfo::makeFullPath(const wchar_t delimiter) const
+Pe::CodeView::SymbolKey PdbInfo::key() const noexcept
 {
-    const size_t pathLength = wcslen(m_info.pdbFile);
-    if (!pathLength)
-    {
-        return {};
-    }
-
-    const wchar_t* const pdbPath = m_info.pdbFile;
-    const wchar_t* const pdbName = extractFileName(pdbPath, pathLength);
-    const unsigned int age = m_info.age;
-
     switch (m_type)
     {
     case Type::pdb70:
     {
-        const auto& guid = m_info.guid;
-
-        std::wstringstream stream;
-        stream << std::uppercase << std::hex << std::setfill(L'0')
-            << pdbName
-            << delimiter
-            << std::setw(8) << guid.Data1
-            << std::setw(4) << guid.Data2
-            << std::setw(4) << guid.Data3
-            << std::setw(2) << guid.Data4[0]
-            << std::setw(2) << guid.Data4[1]
-            << std::setw(2) << guid.Data4[2]
-            << std::setw(2) << guid.Data4[3]
-            << std::setw(2) << guid.Data4[4]
-            << std::setw(2) << guid.Data4[5]
-            << std::setw(2) << guid.Data4[6]
-            << std::setw(2) << guid.Data4[7]
-            << std::setw(1) << age
-            << delimiter
-            << pdbPath;
-
-        return stream.str();
+        return Pe::CodeView::SymbolKey(m_info.guid, m_info.age);
     }
     case Type::pdb20:
     {
-        const auto sig = m_info.signature;
-
-        std::wstringstream stream;
-        stream << std::uppercase << std::hex << std::setfill(L'0')
-            << pdbName
-            << delimiter
-            << std::setw(8) << sig
-            << std::setw(1) << age
-            << delimiter
-            << pdbPath;
-
-        return stream.str();
+        return Pe::CodeView::SymbolKey(m_info.signature, m_info.age);
     }
     default:
     {
@@ -146,51 +101,43 @@ std::wstring PdbInfo::makeFullPath(const wchar_t delimiter) const
     return {};
 }
 
-std::wstring PdbInfo::pdbSig() const
+std::wstring PdbInfo::makeFullPath(const wchar_t delimiter) const
 {
-    const unsigned int age = m_info.age;
-
-    switch (m_type)
-    {
-    case Type::pdb70:
+    const size_t pathLength = wcslen(m_info.pdbFile);
+    if (!pathLength || (m_type == Type::unknown))
     {
-        const auto& guid = m_info.guid;
-
-        std::wstringstream stream;
-        stream << std::uppercase << std::hex << std::setfill(L'0')
-            << std::setw(8) << guid.Data1
-            << std::setw(4) << guid.Data2
-            << std::setw(4) << guid.Data3
-            << std::setw(2) << guid.Data4[0]
-            << std::setw(2) << guid.Data4[1]
-            << std::setw(2) << guid.Data4[2]
-            << std::setw(2) << guid.Data4[3]
-            << std::setw(2) << guid.Data4[4]
-            << std::setw(2) << guid.Data4[5]
-            << std::setw(2) << guid.Data4[6]
-            << std::setw(2) << guid.Data4[7]
-            << std::setw(1) << age;
-
-        return stream.str();
+        return {};
     }
-    case Type::pdb20:
-    {
-        const auto sig = m_info.signature;
 
-        std::wstringstream stream;
-        stream << std::uppercase << std::hex << std::setfill(L'0')
-            << std::setw(8) << sig
-            << std::setw(1) << age;
+    const wchar_t* const pdbPath = m_info.pdbFile;
+    const wchar_t* const pdbName = extractFileName(pdbPath, pathLength);
+    const size_t nameLength = pathLength - static_cast<size_t>(pdbName - pdbPath);
 
-        return stream.str();
-    }
-    default:
+    wchar_t sig[Pe::CodeView::SymbolKey::k_maxLength + 1]{};
+    const unsigned int sigLength = key().format(sig);
+
+    std::wstring fullPath;
+    fullPath.reserve(nameLength + sigLength + pathLength + 2);
+    fullPath.append(pdbName, nameLength)
+        .append(1, delimiter)
+        .append(sig, sigLength)
+        .append(1, delimiter)
+        .append(pdbPath, pathLength);
+
+    return fullPath;
+}
+
+std::wstring PdbInfo::pdbSig() const
+{
+    if (m_type == Type::unknown)
     {
-        break;
-    }
+        return {};
     }
 
-    return {};
+    wchar_t sig[Pe::CodeView::SymbolKey::k_maxLength + 1]{};
+    const unsigned int sigLength = key().format(sig);
+
+    return std::wstring(sig, sigLength);
 }
 
 std::wstring PdbInfo::pdbPath() const
@@ -2,6 +2,8 @@
 
 #include <Windows.h>
 
+#include <Pe/Pe.hpp>
+
 #include <string>
 #include <array>
 
@@ -137,6 +139,8 @@ public:
     Type type() const noexcept;
     const IndexInfo& info() const noexcept;
 
+    Pe::CodeView::SymbolKey key() const noexcept;
+
     std::wstring pdbSig() const; // XXXX..XXX
 
     std::wstring pdbPath() const; // file.pdb\XXXX..XXX\path\to\file.pdb
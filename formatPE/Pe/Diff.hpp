@@ -0,0 +1,657 @@
+#pragma once
+
+#include "Pe.hpp"
+#include "Summary.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+
+
+namespace Pe
+{
+
+
+
+//
+// Structural difference between two versions of an image: sections, imports, exports,
+// TLS callbacks and the CodeView identity. Both sides may have different bitness.
+// Named exports are merged in one pass over the sorted export name tables,
+// ordinal-only exports are merged in the ordinal order. Imports aren't sorted in the image,
+// so they are collected and sorted by (module, name, ordinal) before the merge.
+// Names in the reported changes point into the images.
+//
+
+namespace DiffTypes
+{
+    enum class Category : unsigned char
+    {
+        section,
+        importFunction,
+        exportFunction,
+        tlsCallback,
+        debugIdentity
+    };
+
+    enum class Kind : unsigned char
+    {
+        added,
+        removed,
+        changed
+    };
+
+    // What is changed, for Kind::changed:
+    enum Field : unsigned int
+    {
+        rva             = 1u << 0, // Section, export
+        size            = 1u << 1, // Section virtual or raw size
+        characteristics = 1u << 2, // Section
+        content         = 1u << 3, // Section data
+        ordinal         = 1u << 4, // Export with the same name
+        forwarder       = 1u << 5, // Export
+        identity        = 1u << 6, // PDB GUID or signature
+        age             = 1u << 7, // PDB age
+        path            = 1u << 8  // PDB path
+    };
+
+    enum Categories : unsigned int
+    {
+        sections      = 1u << static_cast<unsigned int>(Category::section),
+        imports       = 1u << static_cast<unsigned int>(Category::importFunction),
+        exports       = 1u << static_cast<unsigned int>(Category::exportFunction),
+        tlsCallbacks  = 1u << static_cast<unsigned int>(Category::tlsCallback),
+        debugIdentity = 1u << static_cast<unsigned int>(Category::debugIdentity),
+        all           = sections | imports | exports | tlsCallbacks | debugIdentity
+    };
+
+    struct Change
+    {
+        Category category;
+        Kind kind;
+        unsigned int fields;  // Set of Field for Kind::changed
+        const char* module;   // Imported module
+        const char* name;     // Section, function or PDB path, nullptr for ordinals
+        unsigned int ordinal; // Imports and exports by ordinal, biased for exports
+        Rva oldRva;           // Sections, exports and TLS callbacks
+        Rva newRva;
+    };
+} // namespace DiffTypes
+
+template <Arch leftArch, Arch rightArch>
+class Diff
+{
+public:
+    using Category = DiffTypes::Category;
+    using Kind = DiffTypes::Kind;
+    using Field = DiffTypes::Field;
+    using Categories = DiffTypes::Categories;
+    using Change = DiffTypes::Change;
+
+private:
+    struct Import
+    {
+        const char* module;
+        const char* name; // nullptr if imported by ordinal
+        unsigned int ordinal;
+    };
+
+    struct OrdinalExport
+    {
+        unsigned int ordinal;
+        Rva rva;
+        const char* forwarder;
+    };
+
+private:
+    const Pe<leftArch> m_left;
+    const Pe<rightArch> m_right;
+
+private:
+    static int compareModules(const char* left, const char* right) noexcept
+    {
+        // Module names are case-insensitive:
+        for (;; ++left, ++right)
+        {
+            const auto l = static_cast<unsigned char>(((*left >= 'A') && (*left <= 'Z')) ? (*left - 'A' + 'a') : *left);
+            const auto r = static_cast<unsigned char>(((*right >= 'A') && (*right <= 'Z')) ? (*right - 'A' + 'a') : *right);
+            if ((l != r) || !l)
+            {
+                return static_cast<int>(l) - static_cast<int>(r);
+            }
+        }
+    }
+
+    static int compareStrings(const char* const left, const char* const right) noexcept
+    {
+        if (!left || !right)
+        {
+            return (left ? 1 : 0) - (right ? 1 : 0);
+        }
+
+        return strcmp(left, right);
+    }
+
+    static bool sameSectionName(const typename GenericTypes::SecHeader& left, const typename GenericTypes::SecHeader& right) noexcept
+    {
+        return memcmp(left.Name, right.Name, sizeof(left.Name)) == 0;
+    }
+
+    static const char* sectionName(const typename GenericTypes::SecHeader& sec) noexcept
+    {
+        return reinterpret_cast<const char*>(sec.Name); // Not null-terminated if all 8 chars are used
+    }
+
+    template <Arch arch>
+    static std::vector<Import> collectImports(const Pe<arch>& pe)
+    {
+        std::vector<Import> imports;
+
+        const auto addFunction = [&imports](const char* const module, const auto& fn)
+        {
+            switch (fn.type())
+            {
+            case ImportType::name:
+            {
+                const auto* const name = fn.name();
+                imports.push_back(Import{ module, name ? reinterpret_cast<const char*>(name->Name) : nullptr, 0 });
+                break;
+            }
+            case ImportType::ordinal:
+            {
+                imports.push_back(Import{ module, nullptr, static_cast<unsigned int>(fn.ordinal()) });
+                break;
+            }
+            default:
+            {
+                break;
+            }
+            }
+        };
+
+        for (const auto& lib : pe.imports())
+        {
+            const char* const module = lib.libName();
+            for (const auto& fn : lib)
+            {
+                addFunction(module ? module : "", fn);
+            }
+        }
+
+        for (const auto& lib : pe.delayedImports())
+        {
+            const char* const module = lib.moduleName();
+            for (const auto& fn : lib)
+            {
+                addFunction(module ? module : "", fn);
+            }
+        }
+
+        std::sort(imports.begin(), imports.end(), [](const Import& left, const Import& right)
+        {
+            return importOrder(left, right) < 0;
+        });
+
+        return imports;
+    }
+
+    static int importOrder(const Import& left, const Import& right) noexcept
+    {
+        const int modules = compareModules(left.module, right.module);
+        if (modules)
+        {
+            return modules;
+        }
+
+        const int names = compareStrings(left.name, right.name);
+        if (names)
+        {
+            return names;
+        }
+
+        return (left.ordinal < right.ordinal) ? -1 : ((left.ordinal > right.ordinal) ? 1 : 0);
+    }
+
+    template <Arch arch>
+    static std::vector<OrdinalExport> collectOrdinalExports(const Exports<arch>& exports)
+    {
+        std::vector<OrdinalExport> result;
+        if (!exports.valid() || !exports.tables().exportAddressTable)
+        {
+            return result;
+        }
+
+        const auto count = exports.count();
+        std::vector<bool> named(count);
+
+        const auto* const nameOrdinals = exports.tables().nameOrdinalTable;
+        const auto namesCount = exports.namesCount();
+        for (unsigned int i = 0; i < namesCount; ++i)
+        {
+            if (nameOrdinals[i] < count)
+            {
+                named[nameOrdinals[i]] = true;
+            }
+        }
+
+        for (unsigned int index = 0; index < count; ++index)
+        {
+            const auto& entry = exports.tables().exportAddressTable[index];
+            if (named[index] || !entry.address)
+            {
+                continue;
+            }
+
+            const bool forwarder = exports.contains(entry.forwarderString);
+            result.push_back(OrdinalExport{
+                exports.ordinalBase() + index,
+                forwarder ? 0 : entry.address,
+                forwarder ? exports.pe().template byRva<char>(entry.forwarderString) : nullptr
+            });
+        }
+
+        return result;
+    }
+
+    template <Arch arch>
+    static void exportByName(const Exports<arch>& exports, const unsigned int index, unsigned int& ordinal, Rva& rva, const char*& forwarder) noexcept
+    {
+        const Ordinal unbiased = exports.tables().nameOrdinalTable[index];
+        ordinal = exports.ordinalBase() + unbiased;
+        rva = 0;
+        forwarder = nullptr;
+
+        if (unbiased >= exports.count())
+        {
+            return;
+        }
+
+        const auto& entry = exports.tables().exportAddressTable[unbiased];
+        if (exports.contains(entry.forwarderString))
+        {
+            forwarder = exports.pe().template byRva<char>(entry.forwarderString);
+        }
+        else
+        {
+            rva = entry.address;
+        }
+    }
+
+    template <Arch arch>
+    static unsigned int namesCount(const Exports<arch>& exports) noexcept
+    {
+        const auto& tables = exports.tables();
+        return tables.exportAddressTable ? exports.namesCount() : 0;
+    }
+
+    template <Arch arch>
+    static std::vector<Rva> collectTlsCallbacks(const Pe<arch>& pe)
+    {
+        using Va = decltype(Types<arch>::TlsDir::AddressOfCallBacks);
+
+        std::vector<Rva> callbacks;
+
+        const auto tls = pe.tls();
+        if (!tls.valid() || !tls.descriptor().ptr->AddressOfCallBacks)
+        {
+            return callbacks;
+        }
+
+        const auto imageBase = pe.imageBase();
+        const auto* callback = pe.template byRva<Va>(static_cast<Rva>(tls.descriptor().ptr->AddressOfCallBacks - imageBase));
+        for (; callback && *callback; ++callback)
+        {
+            callbacks.push_back(static_cast<Rva>(*callback - imageBase));
+        }
+
+        std::sort(callbacks.begin(), callbacks.end());
+        return callbacks;
+    }
+
+    template <typename Callback>
+    void compareSections(Callback&& callback) const
+    {
+        const auto leftSections = m_left.sections();
+        const auto rightSections = m_right.sections();
+
+        // Sections are matched by name in the order of appearance, there are few of them:
+        std::vector<bool> matched(rightSections.count());
+
+        for (const auto& left : leftSections)
+        {
+            unsigned int index = 0;
+            const typename GenericTypes::SecHeader* right = nullptr;
+            for (const auto& candidate : rightSections)
+            {
+                if (!matched[index] && sameSectionName(left, candidate))
+                {
+                    matched[index] = true;
+                    right = &candidate;
+                    break;
+                }
+                ++index;
+            }
+
+            if (!right)
+            {
+                callback(Change{ Category::section, Kind::removed, 0, nullptr, sectionName(left), 0, left.VirtualAddress, 0 });
+                continue;
+            }
+
+            unsigned int fields = 0;
+            if (left.VirtualAddress != right->VirtualAddress)
+            {
+                fields |= Field::rva;
+            }
+
+            if ((left.Misc.VirtualSize != right->Misc.VirtualSize) || (left.SizeOfRawData != right->SizeOfRawData))
+            {
+                fields |= Field::size;
+            }
+
+            if (left.Characteristics != right->Characteristics)
+            {
+                fields |= Field::characteristics;
+            }
+
+            const auto leftData = m_left.sectionData(left);
+            const auto rightData = m_right.sectionData(*right);
+            if ((leftData.size != rightData.size) || (leftData.data != rightData.data
+                && (!leftData.data || !rightData.data || (memcmp(leftData.data, rightData.data, leftData.size) != 0))))
+            {
+                fields |= Field::content;
+            }
+
+            if (fields)
+            {
+                callback(Change{ Category::section, Kind::changed, fields, nullptr, sectionName(*right), 0, left.VirtualAddress, right->VirtualAddress });
+            }
+        }
+
+        unsigned int index = 0;
+        for (const auto& right : rightSections)
+        {
+            if (!matched[index++])
+            {
+                callback(Change{ Category::section, Kind::added, 0, nullptr, sectionName(right), 0, 0, right.VirtualAddress });
+            }
+        }
+    }
+
+    template <typename Callback>
+    void compareImports(Callback&& callback) const
+    {
+        const auto left = collectImports(m_left);
+        const auto right = collectImports(m_right);
+
+        size_t l = 0;
+        size_t r = 0;
+        while ((l < left.size()) || (r < right.size()))
+        {
+            const int cmp = (l == left.size()) ? 1 : ((r == right.size()) ? -1 : importOrder(left[l], right[r]));
+            if (cmp < 0)
+            {
+                callback(Change{ Category::importFunction, Kind::removed, 0, left[l].module, left[l].name, left[l].ordinal, 0, 0 });
+                ++l;
+            }
+            else if (cmp > 0)
+            {
+                callback(Change{ Category::importFunction, Kind::added, 0, right[r].module, right[r].name, right[r].ordinal, 0, 0 });
+                ++r;
+            }
+            else
+            {
+                ++l;
+                ++r;
+            }
+        }
+    }
+
+    template <typename Callback>
+    void compareExports(Callback&& callback) const
+    {
+        const auto leftExports = m_left.exports();
+        const auto rightExports = m_right.exports();
+
+        // The name pointer tables are sorted lexically:
+        const unsigned int leftNames = namesCount(leftExports);
+        const unsigned int rightNames = namesCount(rightExports);
+
+        unsigned int l = 0;
+        unsigned int r = 0;
+        while ((l < leftNames) || (r < rightNames))
+        {
+            const char* const leftName = (l < leftNames) ? m_left.template byRva<char>(leftExports.tables().namePointerTable[l]) : nullptr;
+            const char* const rightName = (r < rightNames) ? m_right.template byRva<char>(rightExports.tables().namePointerTable[r]) : nullptr;
+            if (((l < leftNames) && !leftName) || ((r < rightNames) && !rightName))
+            {
+                // Broken name, skip it to keep the merge going:
+                l += ((l < leftNames) && !leftName) ? 1 : 0;
+                r += ((r < rightNames) && !rightName) ? 1 : 0;
+                continue;
+            }
+
+            const int cmp = (l == leftNames) ? 1 : ((r == rightNames) ? -1 : strcmp(leftName, rightName));
+
+            unsigned int leftOrdinal = 0;
+            unsigned int rightOrdinal = 0;
+            Rva leftRva = 0;
+            Rva rightRva = 0;
+            const char* leftForwarder = nullptr;
+            const char* rightForwarder = nullptr;
+
+            if (cmp <= 0)
+            {
+                exportByName(leftExports, l, leftOrdinal, leftRva, leftForwarder);
+            }
+
+            if (cmp >= 0)
+            {
+                exportByName(rightExports, r, rightOrdinal, rightRva, rightForwarder);
+            }
+
+            if (cmp < 0)
+            {
+                callback(Change{ Category::exportFunction, Kind::removed, 0, nullptr, leftName, leftOrdinal, leftRva, 0 });
+                ++l;
+                continue;
+            }
+
+            if (cmp > 0)
+            {
+                callback(Change{ Category::exportFunction, Kind::added, 0, nullptr, rightName, rightOrdinal, 0, rightRva });
+                ++r;
+                continue;
+            }
+
+            unsigned int fields = 0;
+            if (leftRva != rightRva)
+            {
+                fields |= Field::rva;
+            }
+
+            if (leftOrdinal != rightOrdinal)
+            {
+                fields |= Field::ordinal;
+            }
+
+            if (compareStrings(leftForwarder, rightForwarder) != 0)
+            {
+                fields |= Field::forwarder;
+            }
+
+            if (fields)
+            {
+                callback(Change{ Category::exportFunction, Kind::changed, fields, nullptr, rightName, rightOrdinal, leftRva, rightRva });
+            }
+
+            ++l;
+            ++r;
+        }
+
+        // Ordinal-only exports in the ordinal order:
+        const auto leftOrdinals = collectOrdinalExports(leftExports);
+        const auto rightOrdinals = collectOrdinalExports(rightExports);
+
+        size_t lo = 0;
+        size_t ro = 0;
+        while ((lo < leftOrdinals.size()) || (ro < rightOrdinals.size()))
+        {
+            const bool takeLeft = (ro == rightOrdinals.size()) || ((lo < leftOrdinals.size()) && (leftOrdinals[lo].ordinal < rightOrdinals[ro].ordinal));
+            const bool takeRight = (lo == leftOrdinals.size()) || ((ro < rightOrdinals.size()) && (rightOrdinals[ro].ordinal < leftOrdinals[lo].ordinal));
+            if (takeLeft)
+            {
+                const auto& entry = leftOrdinals[lo++];
+                callback(Change{ Category::exportFunction, Kind::removed, 0, nullptr, nullptr, entry.ordinal, entry.rva, 0 });
+            }
+            else if (takeRight)
+            {
+                const auto& entry = rightOrdinals[ro++];
+                callback(Change{ Category::exportFunction, Kind::added, 0, nullptr, nullptr, entry.ordinal, 0, entry.rva });
+            }
+            else
+            {
+                const auto& leftEntry = leftOrdinals[lo++];
+                const auto& rightEntry = rightOrdinals[ro++];
+
+                unsigned int fields = 0;
+                if (leftEntry.rva != rightEntry.rva)
+                {
+                    fields |= Field::rva;
+                }
+
+                if (compareStrings(leftEntry.forwarder, rightEntry.forwarder) != 0)
+                {
+                    fields |= Field::forwarder;
+                }
+
+                if (fields)
+                {
+                    callback(Change{ Category::exportFunction, Kind::changed, fields, nullptr, nullptr, rightEntry.ordinal, leftEntry.rva, rightEntry.rva });
+                }
+            }
+        }
+    }
+
+    template <typename Callback>
+    void compareTlsCallbacks(Callback&& callback) const
+    {
+        const auto left = collectTlsCallbacks(m_left);
+        const auto right = collectTlsCallbacks(m_right);
+
+        size_t l = 0;
+        size_t r = 0;
+        while ((l < left.size()) || (r < right.size()))
+        {
+            if ((r == right.size()) || ((l < left.size()) && (left[l] < right[r])))
+            {
+                callback(Change{ Category::tlsCallback, Kind::removed, 0, nullptr, nullptr, 0, left[l], 0 });
+                ++l;
+            }
+            else if ((l == left.size()) || (right[r] < left[l]))
+            {
+                callback(Change{ Category::tlsCallback, Kind::added, 0, nullptr, nullptr, 0, 0, right[r] });
+                ++r;
+            }
+            else
+            {
+                ++l;
+                ++r;
+            }
+        }
+    }
+
+    template <typename Callback>
+    void compareDebugIdentity(Callback&& callback) const
+    {
+        using Type = Summary::DebugIdentity::Type;
+
+        const auto left = Summary::debugIdentity(m_left);
+        const auto right = Summary::debugIdentity(m_right);
+
+        if ((left.type == Type::none) && (right.type == Type::none))
+        {
+            return;
+        }
+
+        if (right.type == Type::none)
+        {
+            callback(Change{ Category::debugIdentity, Kind::removed, 0, nullptr, left.pdbPath.c_str(), 0, 0, 0 });
+            return;
+        }
+
+        if (left.type == Type::none)
+        {
+            callback(Change{ Category::debugIdentity, Kind::added, 0, nullptr, right.pdbPath.c_str(), 0, 0, 0 });
+            return;
+        }
+
+        unsigned int fields = 0;
+        if ((left.type != right.type)
+            || (left.signature != right.signature)
+            || (memcmp(&left.guid, &right.guid, sizeof(left.guid)) != 0))
+        {
+            fields |= Field::identity;
+        }
+
+        if (left.age != right.age)
+        {
+            fields |= Field::age;
+        }
+
+        if (left.pdbPath != right.pdbPath)
+        {
+            fields |= Field::path;
+        }
+
+        if (fields)
+        {
+            callback(Change{ Category::debugIdentity, Kind::changed, fields, nullptr, right.pdbPath.c_str(), 0, 0, 0 });
+        }
+    }
+
+public:
+    Diff(const Pe<leftArch>& left, const Pe<rightArch>& right) noexcept : m_left(left), m_right(right)
+    {
+    }
+
+    // Callback: void(const Change&), the debug identity name is valid only inside the callback:
+    template <typename Callback>
+    void compare(Callback&& callback, const unsigned int categories = Categories::all) const
+    {
+        if (categories & Categories::sections)
+        {
+            compareSections(callback);
+        }
+
+        if (categories & Categories::imports)
+        {
+            compareImports(callback);
+        }
+
+        if (categories & Categories::exports)
+        {
+            compareExports(callback);
+        }
+
+        if (categories & Categories::tlsCallbacks)
+        {
+            compareTlsCallbacks(callback);
+        }
+
+        if (categories & Categories::debugIdentity)
+        {
+            compareDebugIdentity(callback);
+        }
+    }
+};
+
+template <Arch leftArch, Arch rightArch>
+Diff<leftArch, rightArch> makeDiff(const Pe<leftArch>& left, const Pe<rightArch>& right) noexcept
+{
+    return Diff<leftArch, rightArch>(left, right);
+}
+
+
+
+} // namespace Pe
@@ -0,0 +1,224 @@
+#pragma once
+
+#include "Pe.hpp"
+
+
+
+namespace Pe
+{
+
+
+
+//
+// Visits the data directories of an image in the order of their placement:
+// extents of all requested directories are collected first and sorted by the file offset
+// (by the RVA for loaded modules), so dumping the whole image is one forward sweep
+// over the file instead of jumps between the directories, which keeps the readahead working.
+// Only the directory tables are ordered: names and thunks they refer to may lie elsewhere.
+//
+// The visitor is called with the extent and the typed view of the directory:
+//
+//     struct Dumper
+//     {
+//         void operator () (const Pe::DirectoryExtent& extent, const Pe::Imports<arch>& imports);
+//         void operator () (const Pe::DirectoryExtent& extent, const Pe::Exports<arch>& exports);
+//         template <typename View>
+//         void operator () (const Pe::DirectoryExtent& extent, const View& view); // Everything else
+//     };
+//
+// Directories without a view here (resources, certificates, load config, IAT, ...) come as RawDirectory.
+// The certificate table isn't mapped into memory, so it is visited only in files.
+//
+
+struct DirectoryExtent
+{
+    unsigned int id;             // IMAGE_DIRECTORY_ENTRY_*
+    Rva rva;                     // File offset for IMAGE_DIRECTORY_ENTRY_SECURITY
+    unsigned int size;
+    unsigned long long position; // File offset for files, RVA for modules
+    const void* data;
+};
+
+struct RawDirectory
+{
+    const void* data;
+    unsigned int size;
+};
+
+template <Arch arch>
+class DirectoryWalk
+{
+public:
+    static constexpr unsigned int k_maxDirectories = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+    static constexpr unsigned int k_allDirectories = (1u << IMAGE_NUMBEROF_DIRECTORY_ENTRIES) - 1u;
+
+private:
+    Pe<arch> m_pe;
+    DirectoryExtent m_extents[k_maxDirectories];
+    unsigned int m_count;
+
+private:
+    bool locate(const unsigned int id, DirectoryExtent& extent) const noexcept
+    {
+        const auto* const dir = m_pe.directory(id);
+        if (!dir->VirtualAddress || !dir->Size)
+        {
+            return false;
+        }
+
+        const auto* const base = static_cast<const unsigned char*>(m_pe.headers().mod());
+
+        if (id == IMAGE_DIRECTORY_ENTRY_SECURITY)
+        {
+            if (m_pe.type() != ImgType::file)
+            {
+                return false;
+            }
+
+            extent = DirectoryExtent{ id, dir->VirtualAddress, dir->Size, dir->VirtualAddress, base + dir->VirtualAddress };
+            return true;
+        }
+
+        const auto* const data = m_pe.template byRva<unsigned char>(dir->VirtualAddress);
+        if (!data)
+        {
+            return false;
+        }
+
+        const unsigned long long position = (m_pe.type() == ImgType::file)
+            ? static_cast<unsigned long long>(data - base)
+            : dir->VirtualAddress;
+
+        extent = DirectoryExtent{ id, dir->VirtualAddress, dir->Size, position, data };
+        return true;
+    }
+
+public:
+    explicit DirectoryWalk(const Pe<arch>& pe, const unsigned int directories = k_allDirectories) noexcept
+        : m_pe(pe)
+        , m_extents{}
+        , m_count(0)
+    {
+        const auto available = pe.headers().opt()->NumberOfRvaAndSizes;
+        for (unsigned int id = 0; (id < k_maxDirectories) && (id < available); ++id)
+        {
+            if (!(directories & (1u << id)))
+            {
+                continue;
+            }
+
+            DirectoryExtent extent{};
+            if (!locate(id, extent))
+            {
+                continue;
+            }
+
+            // Insertion sort, there are 16 directories at most:
+            unsigned int pos = m_count;
+            while ((pos > 0) && (m_extents[pos - 1].position > extent.position))
+            {
+                m_extents[pos] = m_extents[pos - 1];
+                --pos;
+            }
+
+            m_extents[pos] = extent;
+            ++m_count;
+        }
+    }
+
+    const Pe<arch>& pe() const noexcept
+    {
+        return m_pe;
+    }
+
+    unsigned int count() const noexcept
+    {
+        return m_count;
+    }
+
+    const DirectoryExtent& operator [] (const unsigned int index) const noexcept
+    {
+        return m_extents[index];
+    }
+
+    const DirectoryExtent* begin() const noexcept
+    {
+        return m_extents;
+    }
+
+    const DirectoryExtent* end() const noexcept
+    {
+        return m_extents + m_count;
+    }
+
+    template <typename Visitor>
+    void walk(Visitor&& visitor) const
+    {
+        for (const auto& extent : *this)
+        {
+            switch (extent.id)
+            {
+            case IMAGE_DIRECTORY_ENTRY_EXPORT:
+            {
+                visitor(extent, m_pe.exports());
+                break;
+            }
+            case IMAGE_DIRECTORY_ENTRY_IMPORT:
+            {
+                visitor(extent, m_pe.imports());
+                break;
+            }
+            case IMAGE_DIRECTORY_ENTRY_EXCEPTION:
+            {
+                visitor(extent, m_pe.exceptions());
+                break;
+            }
+            case IMAGE_DIRECTORY_ENTRY_BASERELOC:
+            {
+                visitor(extent, m_pe.relocs());
+                break;
+            }
+            case IMAGE_DIRECTORY_ENTRY_DEBUG:
+            {
+                visitor(extent, m_pe.debug());
+                break;
+            }
+            case IMAGE_DIRECTORY_ENTRY_TLS:
+            {
+                visitor(extent, m_pe.tls());
+                break;
+            }
+            case IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT:
+            {
+                visitor(extent, m_pe.boundImports());
+                break;
+            }
+            case IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT:
+            {
+                visitor(extent, m_pe.delayedImports());
+                break;
+            }
+            case IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR:
+            {
+                visitor(extent, m_pe.clr());
+                break;
+            }
+            default:
+            {
+                visitor(extent, RawDirectory{ extent.data, extent.size });
+                break;
+            }
+            }
+        }
+    }
+};
+
+template <Arch arch>
+DirectoryWalk<arch> makeDirectoryWalk(const Pe<arch>& pe, const unsigned int directories = DirectoryWalk<arch>::k_allDirectories) noexcept
+{
+    return DirectoryWalk<arch>(pe, directories);
+}
+
+
+
+} // namespace Pe
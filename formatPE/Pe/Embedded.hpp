@@ -0,0 +1,370 @@
+#pragma once
+
+#include "Pe.hpp"
+
+
+
+namespace Pe
+{
+
+
+
+//
+// Compile-time reader of raw PE files embedded as byte arrays (e.g. generated by bin2c or #embed):
+//
+//     constexpr unsigned char k_payload[] = { ... };
+//     constexpr auto k_exports = Pe::EmbeddedPe(k_payload);
+//     static_assert(k_exports.valid(), "Broken payload");
+//     constexpr auto k_entry = k_exports.findExport("Entry"); // RVA is known at compile time
+//
+// Pe<arch> overlays the winnt.h structures with reinterpret_cast that isn't allowed in constant expressions,
+// so this reader assembles every field from bytes at the offsets of the same structures.
+// Reads are bounds-checked: out-of-range fields are zeroes, so a truncated payload fails the validation.
+// Large images may require raising the evaluation limits (/constexpr:steps, -fconstexpr-steps, -fconstexpr-ops-limit).
+//
+
+class EmbeddedPe
+{
+public:
+    static constexpr unsigned long long k_invalidOffset = ~0ull;
+
+    struct Section
+    {
+        char name[8]; // Not null-terminated if all 8 chars are used
+        Rva rva;
+        unsigned int virtualSize;
+        unsigned int rawOffset;
+        unsigned int rawSize;
+        unsigned int characteristics;
+    };
+
+    struct Export
+    {
+        Rva rva; // Address or forwarder string
+        unsigned int ordinal;
+        ExportType type; // ExportType::unknown if not found
+
+        constexpr bool found() const noexcept
+        {
+            return type != ExportType::unknown;
+        }
+    };
+
+private:
+    const unsigned char* m_data;
+    unsigned long long m_size;
+
+private:
+    constexpr bool x64() const noexcept
+    {
+        return u16(optOffset()) == Types<Arch::x64>::k_magic;
+    }
+
+    constexpr unsigned int optOffset() const noexcept
+    {
+        return ntOffset() + static_cast<unsigned int>(offsetof(IMAGE_NT_HEADERS32, OptionalHeader));
+    }
+
+    constexpr unsigned int optField(const unsigned int offset32, const unsigned int offset64) const noexcept
+    {
+        return optOffset() + (x64() ? offset64 : offset32);
+    }
+
+    constexpr int compareString(const unsigned long long offset, const char* const str) const noexcept
+    {
+        if (offset >= m_size)
+        {
+            return -1;
+        }
+
+        unsigned int i = 0;
+        while (u8(offset + i) && (u8(offset + i) == static_cast<unsigned char>(str[i])))
+        {
+            ++i;
+        }
+
+        return static_cast<int>(u8(offset + i)) - static_cast<int>(static_cast<unsigned char>(str[i]));
+    }
+
+public:
+    template <unsigned long long size>
+    constexpr explicit EmbeddedPe(const unsigned char (&data)[size]) noexcept : m_data(data), m_size(size)
+    {
+    }
+
+    constexpr EmbeddedPe(const unsigned char* const data, const unsigned long long size) noexcept : m_data(data), m_size(size)
+    {
+    }
+
+    constexpr const unsigned char* data() const noexcept
+    {
+        return m_data;
+    }
+
+    constexpr unsigned long long size() const noexcept
+    {
+        return m_size;
+    }
+
+    constexpr unsigned int u8(const unsigned long long offset) const noexcept
+    {
+        return (offset < m_size) ? m_data[offset] : 0u;
+    }
+
+    constexpr unsigned int u16(const unsigned long long offset) const noexcept
+    {
+        return u8(offset) | (u8(offset + 1) << 8u);
+    }
+
+    constexpr unsigned int u32(const unsigned long long offset) const noexcept
+    {
+        return u16(offset) | (u16(offset + 2) << 16u);
+    }
+
+    constexpr unsigned long long u64(const unsigned long long offset) const noexcept
+    {
+        return u32(offset) | (static_cast<unsigned long long>(u32(offset + 4)) << 32u);
+    }
+
+    constexpr unsigned int ntOffset() const noexcept
+    {
+        return u32(offsetof(IMAGE_DOS_HEADER, e_lfanew));
+    }
+
+    constexpr bool valid() const noexcept
+    {
+        if ((m_size < sizeof(IMAGE_DOS_HEADER)) || (u16(0) != 0x5A4Du))
+        {
+            return false;
+        }
+
+        if (u32(ntOffset()) != 0x00004550u)
+        {
+            return false;
+        }
+
+        const auto magic = u16(optOffset());
+        if ((magic != Types<Arch::x32>::k_magic) && (magic != Types<Arch::x64>::k_magic))
+        {
+            return false;
+        }
+
+        const unsigned long long sectionsEnd = sectionsOffset() + static_cast<unsigned long long>(sectionsCount()) * sizeof(IMAGE_SECTION_HEADER);
+        return sectionsEnd <= m_size;
+    }
+
+    constexpr Arch arch() const noexcept
+    {
+        if (!valid())
+        {
+            return Arch::unknown;
+        }
+
+        return x64() ? Arch::x64 : Arch::x32;
+    }
+
+    constexpr unsigned int machine() const noexcept
+    {
+        return u16(ntOffset() + offsetof(IMAGE_NT_HEADERS32, FileHeader) + offsetof(IMAGE_FILE_HEADER, Machine));
+    }
+
+    constexpr unsigned int characteristics() const noexcept
+    {
+        return u16(ntOffset() + offsetof(IMAGE_NT_HEADERS32, FileHeader) + offsetof(IMAGE_FILE_HEADER, Characteristics));
+    }
+
+    constexpr unsigned long long imageBase() const noexcept
+    {
+        return x64()
+            ? u64(optField(0, offsetof(IMAGE_OPTIONAL_HEADER64, ImageBase)))
+            : u32(optField(offsetof(IMAGE_OPTIONAL_HEADER32, ImageBase), 0));
+    }
+
+    constexpr unsigned int imageSize() const noexcept
+    {
+        return u32(optField(offsetof(IMAGE_OPTIONAL_HEADER32, SizeOfImage), offsetof(IMAGE_OPTIONAL_HEADER64, SizeOfImage)));
+    }
+
+    constexpr Rva entryPoint() const noexcept
+    {
+        return u32(optField(offsetof(IMAGE_OPTIONAL_HEADER32, AddressOfEntryPoint), offsetof(IMAGE_OPTIONAL_HEADER64, AddressOfEntryPoint)));
+    }
+
+    constexpr unsigned int subsystem() const noexcept
+    {
+        return u16(optField(offsetof(IMAGE_OPTIONAL_HEADER32, Subsystem), offsetof(IMAGE_OPTIONAL_HEADER64, Subsystem)));
+    }
+
+    constexpr unsigned int dllCharacteristics() const noexcept
+    {
+        return u16(optField(offsetof(IMAGE_OPTIONAL_HEADER32, DllCharacteristics), offsetof(IMAGE_OPTIONAL_HEADER64, DllCharacteristics)));
+    }
+
+    constexpr IMAGE_DATA_DIRECTORY directory(const unsigned int id) const noexcept
+    {
+        const auto count = u32(optField(offsetof(IMAGE_OPTIONAL_HEADER32, NumberOfRvaAndSizes), offsetof(IMAGE_OPTIONAL_HEADER64, NumberOfRvaAndSizes)));
+        if (id >= count)
+        {
+            return IMAGE_DATA_DIRECTORY{ 0, 0 };
+        }
+
+        const auto offset = optField(offsetof(IMAGE_OPTIONAL_HEADER32, DataDirectory), offsetof(IMAGE_OPTIONAL_HEADER64, DataDirectory)) + id * sizeof(IMAGE_DATA_DIRECTORY);
+        return IMAGE_DATA_DIRECTORY{ u32(offset), u32(offset + sizeof(DWORD)) };
+    }
+
+    constexpr unsigned int sectionsCount() const noexcept
+    {
+        return u16(ntOffset() + offsetof(IMAGE_NT_HEADERS32, FileHeader) + offsetof(IMAGE_FILE_HEADER, NumberOfSections));
+    }
+
+    constexpr unsigned int sectionsOffset() const noexcept
+    {
+        return optOffset() + u16(ntOffset() + offsetof(IMAGE_NT_HEADERS32, FileHeader) + offsetof(IMAGE_FILE_HEADER, SizeOfOptionalHeader));
+    }
+
+    constexpr Section section(const unsigned int index) const noexcept
+    {
+        const unsigned long long offset = sectionsOffset() + static_cast<unsigned long long>(index) * sizeof(IMAGE_SECTION_HEADER);
+
+        Section sec{};
+        for (unsigned int i = 0; i < sizeof(sec.name); ++i)
+        {
+            sec.name[i] = static_cast<char>(u8(offset + i));
+        }
+
+        sec.rva = u32(offset + offsetof(IMAGE_SECTION_HEADER, VirtualAddress));
+        sec.virtualSize = u32(offset + offsetof(IMAGE_SECTION_HEADER, Misc));
+        sec.rawOffset = u32(offset + offsetof(IMAGE_SECTION_HEADER, PointerToRawData));
+        sec.rawSize = u32(offset + offsetof(IMAGE_SECTION_HEADER, SizeOfRawData));
+        sec.characteristics = u32(offset + offsetof(IMAGE_SECTION_HEADER, Characteristics));
+        return sec;
+    }
+
+    // The same translation as Pe<arch>::byRva for files, k_invalidOffset if the RVA isn't backed by the file:
+    constexpr unsigned long long offsetByRva(const Rva rva) const noexcept
+    {
+        const unsigned long long fileAlignment = u32(optField(offsetof(IMAGE_OPTIONAL_HEADER32, FileAlignment), offsetof(IMAGE_OPTIONAL_HEADER64, FileAlignment)));
+        const unsigned long long sectionAlignment = u32(optField(offsetof(IMAGE_OPTIONAL_HEADER32, SectionAlignment), offsetof(IMAGE_OPTIONAL_HEADER64, SectionAlignment)));
+
+        constexpr unsigned long long k_minimalSectionAlignment = 512u;
+
+        const auto count = sectionsCount();
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            const auto sec = section(i);
+
+            unsigned long long sectionBase = 0;
+            unsigned long long sectionSize = 0;
+            unsigned long long sectionOffset = 0;
+            if ((sectionAlignment >= k_minimalSectionAlignment) && fileAlignment)
+            {
+                sectionBase = Align::alignDown<unsigned long long>(sec.rva, sectionAlignment);
+                const auto alignedFileSize = Align::alignUp<unsigned long long>(sec.rawSize, fileAlignment);
+                const auto alignedSectionSize = Align::alignUp<unsigned long long>(sec.virtualSize, sectionAlignment);
+                sectionSize = (alignedFileSize > alignedSectionSize) ? alignedSectionSize : alignedFileSize;
+                sectionOffset = Align::alignDown<unsigned long long>(sec.rawOffset, k_minimalSectionAlignment);
+            }
+            else
+            {
+                sectionBase = sec.rva;
+                sectionSize = (sec.rawSize > sec.virtualSize) ? sec.virtualSize : sec.rawSize;
+                sectionOffset = sec.rawOffset;
+            }
+
+            if ((rva >= sectionBase) && (rva < sectionBase + sectionSize))
+            {
+                const auto offset = sectionOffset + (rva - sectionBase);
+                return (offset < m_size) ? offset : k_invalidOffset;
+            }
+        }
+
+        return k_invalidOffset;
+    }
+
+    constexpr unsigned int exportsCount() const noexcept
+    {
+        const auto dir = directory(IMAGE_DIRECTORY_ENTRY_EXPORT);
+        const auto descriptor = dir.Size ? offsetByRva(dir.VirtualAddress) : k_invalidOffset;
+        if (descriptor == k_invalidOffset)
+        {
+            return 0;
+        }
+
+        return u32(descriptor + offsetof(IMAGE_EXPORT_DIRECTORY, NumberOfFunctions));
+    }
+
+    // Biased ordinal:
+    constexpr Export findExport(const unsigned int ordinal) const noexcept
+    {
+        const auto dir = directory(IMAGE_DIRECTORY_ENTRY_EXPORT);
+        const auto descriptor = dir.Size ? offsetByRva(dir.VirtualAddress) : k_invalidOffset;
+        if (descriptor == k_invalidOffset)
+        {
+            return Export{ 0, 0, ExportType::unknown };
+        }
+
+        const auto base = u32(descriptor + offsetof(IMAGE_EXPORT_DIRECTORY, Base));
+        const auto count = u32(descriptor + offsetof(IMAGE_EXPORT_DIRECTORY, NumberOfFunctions));
+        const unsigned int unbiasedOrdinal = ordinal - base;
+        if (unbiasedOrdinal >= count)
+        {
+            return Export{ 0, 0, ExportType::unknown };
+        }
+
+        const auto functions = offsetByRva(u32(descriptor + offsetof(IMAGE_EXPORT_DIRECTORY, AddressOfFunctions)));
+        if (functions == k_invalidOffset)
+        {
+            return Export{ 0, 0, ExportType::unknown };
+        }
+
+        const Rva rva = u32(functions + unbiasedOrdinal * sizeof(Rva));
+        const bool forwarder = (rva >= dir.VirtualAddress) && (rva < dir.VirtualAddress + dir.Size);
+        return Export{ rva, ordinal, forwarder ? ExportType::forwarder : ExportType::exact };
+    }
+
+    constexpr Export findExport(const char* const name) const noexcept
+    {
+        const auto dir = directory(IMAGE_DIRECTORY_ENTRY_EXPORT);
+        const auto descriptor = dir.Size ? offsetByRva(dir.VirtualAddress) : k_invalidOffset;
+        if (!name || (descriptor == k_invalidOffset))
+        {
+            return Export{ 0, 0, ExportType::unknown };
+        }
+
+        const auto names = offsetByRva(u32(descriptor + offsetof(IMAGE_EXPORT_DIRECTORY, AddressOfNames)));
+        const auto ordinals = offsetByRva(u32(descriptor + offsetof(IMAGE_EXPORT_DIRECTORY, AddressOfNameOrdinals)));
+        if ((names == k_invalidOffset) || (ordinals == k_invalidOffset))
+        {
+            return Export{ 0, 0, ExportType::unknown };
+        }
+
+        // [left, right):
+        unsigned int left = 0;
+        unsigned int right = u32(descriptor + offsetof(IMAGE_EXPORT_DIRECTORY, NumberOfNames));
+        while (left < right)
+        {
+            const unsigned int pos = (left + right) / 2;
+            const auto nameOffset = offsetByRva(u32(names + pos * sizeof(Rva)));
+            const int cmpRes = compareString(nameOffset, name);
+            if (cmpRes > 0)
+            {
+                right = pos;
+            }
+            else if (cmpRes < 0)
+            {
+                left = pos + 1;
+            }
+            else
+            {
+                const auto base = u32(descriptor + offsetof(IMAGE_EXPORT_DIRECTORY, Base));
+                return findExport(base + u16(ordinals + pos * sizeof(Ordinal)));
+            }
+        }
+
+        return Export{ 0, 0, ExportType::unknown };
+    }
+};
+
+
+
+} // namespace Pe
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "Pe.hpp"
+#include "ImportIndex.hpp"
+#include "Simd.hpp"
+
+#include <vector>
+
+
+
+namespace Pe
+{
+
+
+
+//
+// Finds indirect calls and jumps through the import address tables in the executable sections:
+//     FF 15 XX XX XX XX    call [X]
+//     FF 25 XX XX XX XX    jmp  [X]
+// X is a RIP-relative displacement on x64 and an absolute address on x86.
+// Candidates are found with a vectorized search of the opcode pair,
+// their targets are validated and resolved through the ImportIndex.
+//
+
+template <Arch arch>
+class ImportCallScanner
+{
+public:
+    static constexpr unsigned char k_opcode = 0xFF;
+    static constexpr unsigned char k_modRmCall = 0x15; // FF /2 with [disp32] or [rip+disp32]
+    static constexpr unsigned char k_modRmJump = 0x25; // FF /4 with [disp32] or [rip+disp32]
+    static constexpr unsigned int k_instructionSize = 6;
+
+    struct CallSite
+    {
+        Rva rva;              // RVA of the instruction
+        Rva slot;             // RVA of the IAT slot
+        unsigned int section; // Index of the section with the instruction
+        bool jump;            // "jmp [X]" if true, "call [X]" otherwise
+        typename ImportIndex<arch>::Symbol symbol;
+    };
+
+private:
+    const ImportIndex<arch> m_index;
+
+private:
+    static int readDisplacement(const unsigned char* const ptr) noexcept
+    {
+        const unsigned int value = static_cast<unsigned int>(ptr[0])
+            | (static_cast<unsigned int>(ptr[1]) << 8u)
+            | (static_cast<unsigned int>(ptr[2]) << 16u)
+            | (static_cast<unsigned int>(ptr[3]) << 24u);
+        return static_cast<int>(value);
+    }
+
+    // Base address that absolute operands of x86 code are relative to:
+    unsigned long long actualBase() const noexcept
+    {
+        const auto& pe = m_index.pe();
+        return (pe.type() == ImgType::module)
+            ? static_cast<unsigned long long>(reinterpret_cast<size_t>(pe.headers().mod()))
+            : pe.imageBase();
+    }
+
+    template <typename Callback>
+    void checkCandidate(const SectionData& section, const unsigned int sectionIndex, const unsigned int offset, const unsigned long long base, Callback& callback) const
+    {
+        const unsigned char* const instruction = section.data + offset;
+        const Rva rva = section.rva + offset;
+        const int displacement = readDisplacement(instruction + 2);
+
+        Rva slot = 0;
+        if (arch == Arch::x64)
+        {
+            slot = static_cast<Rva>(rva + k_instructionSize + displacement);
+        }
+        else
+        {
+            const unsigned long long address = static_cast<unsigned int>(displacement);
+            if (address < base)
+            {
+                return;
+            }
+            slot = static_cast<Rva>(address - base);
+        }
+
+        const auto symbol = m_index.find(slot);
+        if (!symbol.valid())
+        {
+            return;
+        }
+
+        callback(CallSite{ rva, slot, sectionIndex, instruction[1] == k_modRmJump, symbol });
+    }
+
+    template <typename Callback>
+    void scanSection(const SectionData& section, const unsigned int sectionIndex, const unsigned long long base, Callback& callback) const
+    {
+        if (section.size < k_instructionSize)
+        {
+            return;
+        }
+
+        // The last position where a whole instruction fits:
+        const unsigned int lastCandidate = section.size - k_instructionSize;
+        unsigned int pos = 0;
+
+#ifdef PE_SIMD_SSE2
+        const __m128i opcode = _mm_set1_epi8(static_cast<char>(k_opcode));
+        const __m128i modRmCall = _mm_set1_epi8(k_modRmCall);
+        const __m128i modRmJump = _mm_set1_epi8(k_modRmJump);
+
+        // Each iteration checks 16 candidate positions, the ModRM byte is loaded with the shifted load:
+        while (pos + Simd::k_width <= lastCandidate)
+        {
+            const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(section.data + pos));
+            const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(section.data + pos + 1));
+
+            const __m128i isOpcode = _mm_cmpeq_epi8(first, opcode);
+            const __m128i isModRm = _mm_or_si128(_mm_cmpeq_epi8(second, modRmCall), _mm_cmpeq_epi8(second, modRmJump));
+            const unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_and_si128(isOpcode, isModRm)));
+
+            Simd::forEachBit(mask, [&](const unsigned int bit)
+            {
+                checkCandidate(section, sectionIndex, pos + bit, base, callback);
+            });
+
+            pos += Simd::k_width;
+        }
+#endif
+
+        for (; pos <= lastCandidate; ++pos)
+        {
+            const unsigned char* const ptr = section.data + pos;
+            if ((ptr[0] == k_opcode) && ((ptr[1] == k_modRmCall) || (ptr[1] == k_modRmJump)))
+            {
+                checkCandidate(section, sectionIndex, pos, base, callback);
+            }
+        }
+    }
+
+public:
+    explicit ImportCallScanner(const Pe<arch>& pe) : m_index(pe)
+    {
+    }
+
+    const ImportIndex<arch>& index() const noexcept
+    {
+        return m_index;
+    }
+
+    // Callback: void(const CallSite& site):
+    template <typename Callback>
+    void scan(Callback&& callback) const
+    {
+        if (m_index.empty())
+        {
+            return;
+        }
+
+        const auto& pe = m_index.pe();
+        const auto base = actualBase();
+
+        unsigned int sectionIndex = 0;
+        for (const auto& sec : pe.sections())
+        {
+            if (sec.Characteristics & (IMAGE_SCN_MEM_EXECUTE | IMAGE_SCN_CNT_CODE))
+            {
+                scanSection(pe.sectionData(sec), sectionIndex, base, callback);
+            }
+            ++sectionIndex;
+        }
+    }
+
+    std::vector<CallSite> scan() const
+    {
+        std::vector<CallSite> sites;
+        scan([&sites](const CallSite& site)
+        {
+            sites.push_back(site);
+        });
+        return sites;
+    }
+};
+
+using ImportCallScanner32 = ImportCallScanner<Arch::x32>;
+using ImportCallScanner64 = ImportCallScanner<Arch::x64>;
+using ImportCallScannerNative = ImportCallScanner<Arch::native>;
+
+
+
+} // namespace Pe
@@ -0,0 +1,242 @@
+#pragma once
+
+#include "Pe.hpp"
+
+#include <vector>
+#include <algorithm>
+
+
+
+namespace Pe
+{
+
+
+
+//
+// Reverse index over the import address tables of both regular and delayed imports:
+// maps an IAT slot (e.g. the memory operand of "call [rip+X]") to the imported symbol.
+// The lookup is a binary search over the IAT ranges, one range per imported module.
+//
+
+template <Arch arch>
+class ImportIndex
+{
+public:
+    using ImportLookupTableEntry = typename Types<arch>::ImportLookupTableEntry;
+
+    enum class Source : unsigned char
+    {
+        imports,
+        delayedImports
+    };
+
+    struct Range
+    {
+        Rva begin; // RVA of the first IAT slot
+        Rva end;   // RVA past the last IAT slot
+        const char* moduleName;
+        const ImportLookupTableEntry* lookupTable; // ILT for imports or INT for delayed imports
+        Source source;
+
+        unsigned int count() const noexcept
+        {
+            return (end - begin) / sizeof(ImportLookupTableEntry);
+        }
+    };
+
+    class Symbol
+    {
+    private:
+        const ImportIndex* m_index;
+        const Range* m_range;
+        unsigned int m_slot;
+
+    public:
+        Symbol() noexcept : m_index(nullptr), m_range(nullptr), m_slot(0)
+        {
+        }
+
+        Symbol(const ImportIndex& index, const Range& range, const unsigned int slot) noexcept
+            : m_index(&index)
+            , m_range(&range)
+            , m_slot(slot)
+        {
+        }
+
+        bool valid() const noexcept
+        {
+            return m_range != nullptr;
+        }
+
+        const Range* range() const noexcept
+        {
+            return m_range;
+        }
+
+        // Index of the function in the module's IAT:
+        unsigned int slot() const noexcept
+        {
+            return m_slot;
+        }
+
+        Source source() const noexcept
+        {
+            return m_range->source;
+        }
+
+        const char* moduleName() const noexcept
+        {
+            return m_range->moduleName;
+        }
+
+        const ImportLookupTableEntry* lookupTableEntry() const noexcept
+        {
+            return &m_range->lookupTable[m_slot];
+        }
+
+        ImportType type() const noexcept
+        {
+            return valid() ? lookupTableEntry()->type() : ImportType::unknown;
+        }
+
+        const typename GenericTypes::ImgImportByName* name() const noexcept
+        {
+            if (type() != ImportType::name)
+            {
+                return nullptr;
+            }
+
+            return m_index->pe().template byRva<typename GenericTypes::ImgImportByName>(lookupTableEntry()->name.hintNameRva);
+        }
+
+        Ordinal ordinal() const noexcept
+        {
+            if (type() != ImportType::ordinal)
+            {
+                return 0;
+            }
+
+            return static_cast<Ordinal>(lookupTableEntry()->ordinal.ord);
+        }
+    };
+
+private:
+    const Pe<arch> m_pe;
+    std::vector<Range> m_ranges;
+
+private:
+    static unsigned int countFunctions(const ImportLookupTableEntry* const lookupTable) noexcept
+    {
+        if (!lookupTable)
+        {
+            return 0;
+        }
+
+        unsigned int count = 0;
+        while (lookupTable[count].valid())
+        {
+            ++count;
+        }
+
+        return count;
+    }
+
+    void addRange(const Rva iat, const ImportLookupTableEntry* const lookupTable, const char* const moduleName, const Source source)
+    {
+        const unsigned int count = countFunctions(lookupTable);
+        if (!iat || !count)
+        {
+            return;
+        }
+
+        m_ranges.push_back(Range{ iat, static_cast<Rva>(iat + count * sizeof(ImportLookupTableEntry)), moduleName, lookupTable, source });
+    }
+
+public:
+    explicit ImportIndex(const Pe<arch>& pe) : m_pe(pe)
+    {
+        for (const auto& lib : pe.imports())
+        {
+            const auto* const descriptor = lib.descriptor();
+
+            // Some linkers omit the ILT: the IAT of a file contains the same entries until it is bound:
+            const auto* const lookupTable = descriptor->OriginalFirstThunk
+                ? lib.importLookupTable()
+                : ((pe.type() == ImgType::file) ? lib.importAddressTable() : nullptr);
+
+            addRange(descriptor->FirstThunk, lookupTable, lib.libName(), Source::imports);
+        }
+
+        for (const auto& lib : pe.delayedImports())
+        {
+            addRange(lib.descriptor()->ImportAddressTableRVA, lib.importNameTable(), lib.moduleName(), Source::delayedImports);
+        }
+
+        std::sort(m_ranges.begin(), m_ranges.end(), [](const Range& left, const Range& right) -> bool
+        {
+            return left.begin < right.begin;
+        });
+    }
+
+    const Pe<arch>& pe() const noexcept
+    {
+        return m_pe;
+    }
+
+    const std::vector<Range>& ranges() const noexcept
+    {
+        return m_ranges;
+    }
+
+    bool empty() const noexcept
+    {
+        return m_ranges.empty();
+    }
+
+    const Range* findRange(const Rva rva) const noexcept
+    {
+        // The first range that begins after the rva:
+        const auto next = std::upper_bound(m_ranges.cbegin(), m_ranges.cend(), rva, [](const Rva value, const Range& range) -> bool
+        {
+            return value < range.begin;
+        });
+
+        if (next == m_ranges.cbegin())
+        {
+            return nullptr;
+        }
+
+        const auto& range = *(next - 1);
+        return (rva < range.end) ? &range : nullptr;
+    }
+
+    bool contains(const Rva rva) const noexcept
+    {
+        return findRange(rva) != nullptr;
+    }
+
+    Symbol find(const Rva slotRva) const noexcept
+    {
+        const auto* const range = findRange(slotRva);
+        if (!range)
+        {
+            return {};
+        }
+
+        const auto offset = slotRva - range->begin;
+        if (offset % sizeof(ImportLookupTableEntry))
+        {
+            return {}; // Points into the middle of a slot
+        }
+
+        return Symbol(*this, *range, static_cast<unsigned int>(offset / sizeof(ImportLookupTableEntry)));
+    }
+};
+
+using ImportIndex32 = ImportIndex<Arch::x32>;
+using ImportIndex64 = ImportIndex<Arch::x64>;
+using ImportIndexNative = ImportIndex<Arch::native>;
+
+
+
+} // namespace Pe
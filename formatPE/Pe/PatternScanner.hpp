@@ -0,0 +1,453 @@
+#pragma once
+
+#include "Pe.hpp"
+#include "Simd.hpp"
+
+#include <vector>
+#include <algorithm>
+
+
+
+namespace Pe
+{
+
+
+
+//
+// A set of byte patterns with wildcards, e.g. "48 8B 05 ?? ?? ?? ?? E8 ?? ?? ?? ??".
+// Nibble wildcards are supported too: "4? 8B".
+// Pattern ids are assigned in the order of addition.
+//
+
+class PatternSet
+{
+public:
+    static constexpr unsigned int k_invalidId = ~0u;
+
+    struct Pattern
+    {
+        std::vector<unsigned char> bytes; // Already masked
+        std::vector<unsigned char> mask;  // 0xFF for exact bytes, 0x00 for wildcards
+
+        size_t size() const noexcept
+        {
+            return bytes.size();
+        }
+
+        bool exact(const size_t pos) const noexcept
+        {
+            return mask[pos] == 0xFF;
+        }
+    };
+
+private:
+    std::vector<Pattern> m_patterns;
+
+private:
+    static int hexDigit(const char sym) noexcept
+    {
+        if ((sym >= '0') && (sym <= '9')) return sym - '0';
+        if ((sym >= 'a') && (sym <= 'f')) return sym - 'a' + 10;
+        if ((sym >= 'A') && (sym <= 'F')) return sym - 'A' + 10;
+        return -1;
+    }
+
+public:
+    // Returns the id of the pattern or k_invalidId if the pattern has no exact bytes:
+    unsigned int add(const unsigned char* const bytes, const unsigned char* const mask, const size_t size)
+    {
+        if (!bytes || !size)
+        {
+            return k_invalidId;
+        }
+
+        Pattern pattern;
+        pattern.bytes.resize(size);
+        pattern.mask.resize(size);
+
+        bool hasExactBytes = false;
+        for (size_t i = 0; i < size; ++i)
+        {
+            const unsigned char byteMask = mask ? mask[i] : 0xFF;
+            pattern.mask[i] = byteMask;
+            pattern.bytes[i] = bytes[i] & byteMask;
+            hasExactBytes |= (byteMask == 0xFF);
+        }
+
+        if (!hasExactBytes)
+        {
+            return k_invalidId;
+        }
+
+        m_patterns.emplace_back(std::move(pattern));
+        return static_cast<unsigned int>(m_patterns.size() - 1);
+    }
+
+    // Returns the id of the pattern or k_invalidId if the signature is malformed:
+    unsigned int add(const char* const signature)
+    {
+        if (!signature)
+        {
+            return k_invalidId;
+        }
+
+        std::vector<unsigned char> bytes;
+        std::vector<unsigned char> mask;
+
+        const char* sym = signature;
+        while (*sym)
+        {
+            if (*sym == ' ')
+            {
+                ++sym;
+                continue;
+            }
+
+            unsigned char value = 0;
+            unsigned char byteMask = 0;
+            for (unsigned int nibble = 0; nibble < 2; ++nibble)
+            {
+                const char ch = sym[nibble];
+                const unsigned int shift = nibble ? 0 : 4;
+                if (ch == '?')
+                {
+                    continue;
+                }
+
+                const int digit = hexDigit(ch);
+                if (digit < 0)
+                {
+                    return k_invalidId;
+                }
+
+                value |= static_cast<unsigned char>(digit << shift);
+                byteMask |= static_cast<unsigned char>(0x0F << shift);
+            }
+
+            bytes.push_back(value);
+            mask.push_back(byteMask);
+            sym += 2;
+
+            if (*sym && (*sym != ' '))
+            {
+                return k_invalidId;
+            }
+        }
+
+        return add(bytes.data(), mask.data(), bytes.size());
+    }
+
+    const std::vector<Pattern>& patterns() const noexcept
+    {
+        return m_patterns;
+    }
+
+    size_t count() const noexcept
+    {
+        return m_patterns.size();
+    }
+
+    bool empty() const noexcept
+    {
+        return m_patterns.empty();
+    }
+};
+
+
+
+//
+// Scans sections for all patterns of a set in one pass.
+// Every pattern is anchored on its least common exact byte pair (or a single exact byte),
+// candidates are prefiltered with SSE2 comparisons of the anchor leading bytes
+// (or with a lookup table if there are too many distinct ones), then confirmed
+// with a bitmap of the anchor pairs and verified against the full pattern.
+//
+
+class PatternScanner
+{
+public:
+    struct Match
+    {
+        Rva rva;              // RVA of the first byte of the match
+        unsigned int section; // Index of the section
+        unsigned int pattern; // Id of the pattern in the set
+    };
+
+private:
+    static constexpr unsigned int k_maxSimdLeadBytes = 8;
+
+    struct Anchor
+    {
+        unsigned int key;     // Lead byte | (second byte << 8) for pairs, lead byte for singles
+        unsigned int pattern;
+        unsigned int offset;  // Offset of the anchor in the pattern
+    };
+
+    const PatternSet m_set;
+    std::vector<Anchor> m_pairs;   // Sorted by the key
+    std::vector<Anchor> m_singles; // Sorted by the key
+    std::vector<unsigned char> m_pairBitmap; // 65536 bits
+    bool m_leadBytes[256];
+    unsigned char m_simdLeadBytes[k_maxSimdLeadBytes];
+    unsigned int m_simdLeadBytesCount;
+
+private:
+    // Rough frequency of bytes in code and data: the less the better anchor:
+    static unsigned int byteScore(const unsigned char value) noexcept
+    {
+        switch (value)
+        {
+        case 0x00: return 8;
+        case 0xFF: return 6;
+        case 0xCC: case 0x90: return 5;
+        case 0x48: case 0x8B: case 0x89: return 4;
+        case 0x4C: case 0x24: case 0x0F: case 0xE8: return 3;
+        default:
+            return 1;
+        }
+    }
+
+    void compile()
+    {
+        for (unsigned int id = 0; id < m_set.count(); ++id)
+        {
+            const auto& pattern = m_set.patterns()[id];
+
+            unsigned int bestScore = ~0u;
+            Anchor bestPair{ 0, id, 0 };
+            for (size_t i = 0; i + 1 < pattern.size(); ++i)
+            {
+                if (!pattern.exact(i) || !pattern.exact(i + 1))
+                {
+                    continue;
+                }
+
+                const unsigned int score = byteScore(pattern.bytes[i]) + byteScore(pattern.bytes[i + 1]);
+                if (score < bestScore)
+                {
+                    bestScore = score;
+                    bestPair = Anchor{ pattern.bytes[i] | (static_cast<unsigned int>(pattern.bytes[i + 1]) << 8u), id, static_cast<unsigned int>(i) };
+                }
+            }
+
+            if (bestScore != ~0u)
+            {
+                m_pairs.push_back(bestPair);
+                m_leadBytes[bestPair.key & 0xFF] = true;
+                m_pairBitmap[bestPair.key / 8] |= static_cast<unsigned char>(1u << (bestPair.key % 8));
+                continue;
+            }
+
+            // No exact pairs, use the least common exact byte:
+            Anchor bestSingle{ 0, id, 0 };
+            for (size_t i = 0; i < pattern.size(); ++i)
+            {
+                if (!pattern.exact(i))
+                {
+                    continue;
+                }
+
+                const unsigned int score = byteScore(pattern.bytes[i]);
+                if (score < bestScore)
+                {
+                    bestScore = score;
+                    bestSingle = Anchor{ pattern.bytes[i], id, static_cast<unsigned int>(i) };
+                }
+            }
+
+            m_singles.push_back(bestSingle);
+            m_leadBytes[bestSingle.key] = true;
+        }
+
+        const auto byKey = [](const Anchor& left, const Anchor& right) -> bool
+        {
+            return left.key < right.key;
+        };
+
+        std::sort(m_pairs.begin(), m_pairs.end(), byKey);
+        std::sort(m_singles.begin(), m_singles.end(), byKey);
+
+        m_simdLeadBytesCount = 0;
+        for (unsigned int value = 0; value < 256; ++value)
+        {
+            if (!m_leadBytes[value])
+            {
+                continue;
+            }
+
+            if (m_simdLeadBytesCount == k_maxSimdLeadBytes)
+            {
+                m_simdLeadBytesCount = 0; // Too many for the SIMD prefilter
+                break;
+            }
+
+            m_simdLeadBytes[m_simdLeadBytesCount++] = static_cast<unsigned char>(value);
+        }
+    }
+
+    bool verify(const SectionData& section, const Anchor& anchor, const unsigned int anchorPos, Match& match) const noexcept
+    {
+        if (anchorPos < anchor.offset)
+        {
+            return false;
+        }
+
+        const auto& pattern = m_set.patterns()[anchor.pattern];
+        const unsigned int start = anchorPos - anchor.offset;
+        if (pattern.size() > section.size - start)
+        {
+            return false;
+        }
+
+        const unsigned char* const data = section.data + start;
+        for (size_t i = 0; i < pattern.size(); ++i)
+        {
+            if ((data[i] & pattern.mask[i]) != pattern.bytes[i])
+            {
+                return false;
+            }
+        }
+
+        match.rva = section.rva + start;
+        match.pattern = anchor.pattern;
+        return true;
+    }
+
+    template <typename Callback>
+    void checkAnchors(const std::vector<Anchor>& anchors, const unsigned int key, const SectionData& section, const unsigned int pos, Match& match, Callback& callback) const
+    {
+        const auto range = std::equal_range(anchors.cbegin(), anchors.cend(), Anchor{ key, 0, 0 }, [](const Anchor& left, const Anchor& right) -> bool
+        {
+            return left.key < right.key;
+        });
+
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (verify(section, *it, pos, match))
+            {
+                callback(static_cast<const Match&>(match));
+            }
+        }
+    }
+
+    template <typename Callback>
+    void checkCandidate(const SectionData& section, const unsigned int pos, Match& match, Callback& callback) const
+    {
+        const unsigned int lead = section.data[pos];
+
+        if (!m_singles.empty())
+        {
+            checkAnchors(m_singles, lead, section, pos, match, callback);
+        }
+
+        if (pos + 1 < section.size)
+        {
+            const unsigned int pair = lead | (static_cast<unsigned int>(section.data[pos + 1]) << 8u);
+            if (m_pairBitmap[pair / 8] & (1u << (pair % 8)))
+            {
+                checkAnchors(m_pairs, pair, section, pos, match, callback);
+            }
+        }
+    }
+
+public:
+    explicit PatternScanner(const PatternSet& set)
+        : m_set(set)
+        , m_pairBitmap(65536 / 8)
+        , m_leadBytes{}
+        , m_simdLeadBytes{}
+        , m_simdLeadBytesCount(0)
+    {
+        compile();
+    }
+
+    const PatternSet& patterns() const noexcept
+    {
+        return m_set;
+    }
+
+    // Callback: void(const Match& match):
+    template <typename Callback>
+    void scanSection(const SectionData& section, const unsigned int sectionIndex, Callback&& callback) const
+    {
+        if (!section.valid() || m_set.empty())
+        {
+            return;
+        }
+
+        Match match{ 0, sectionIndex, 0 };
+        unsigned int pos = 0;
+
+#ifdef PE_SIMD_SSE2
+        if (m_simdLeadBytesCount)
+        {
+            __m128i leads[k_maxSimdLeadBytes];
+            for (unsigned int i = 0; i < m_simdLeadBytesCount; ++i)
+            {
+                leads[i] = _mm_set1_epi8(static_cast<char>(m_simdLeadBytes[i]));
+            }
+
+            for (; pos + Simd::k_width <= section.size; pos += Simd::k_width)
+            {
+                const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(section.data + pos));
+                __m128i candidates = _mm_cmpeq_epi8(chunk, leads[0]);
+                for (unsigned int i = 1; i < m_simdLeadBytesCount; ++i)
+                {
+                    candidates = _mm_or_si128(candidates, _mm_cmpeq_epi8(chunk, leads[i]));
+                }
+
+                const unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(candidates));
+                Simd::forEachBit(mask, [&](const unsigned int bit)
+                {
+                    checkCandidate(section, pos + bit, match, callback);
+                });
+            }
+        }
+#endif
+
+        for (; pos < section.size; ++pos)
+        {
+            if (m_leadBytes[section.data[pos]])
+            {
+                checkCandidate(section, pos, match, callback);
+            }
+        }
+    }
+
+    // Filter: bool(const SecHeader& section, unsigned int sectionIndex),
+    // Callback: void(const Match& match):
+    template <Arch arch, typename Filter, typename Callback>
+    void scan(const Pe<arch>& pe, Filter&& filter, Callback&& callback) const
+    {
+        unsigned int sectionIndex = 0;
+        for (const auto& sec : pe.sections())
+        {
+            if (filter(sec, sectionIndex))
+            {
+                scanSection(pe.sectionData(sec), sectionIndex, callback);
+            }
+            ++sectionIndex;
+        }
+    }
+
+    template <Arch arch, typename Callback>
+    void scan(const Pe<arch>& pe, Callback&& callback) const
+    {
+        scan(pe, [](const typename GenericTypes::SecHeader&, unsigned int) -> bool { return true; }, callback);
+    }
+
+    template <Arch arch>
+    std::vector<Match> scan(const Pe<arch>& pe) const
+    {
+        std::vector<Match> matches;
+        scan(pe, [&matches](const Match& match)
+        {
+            matches.push_back(match);
+        });
+        return matches;
+    }
+};
+
+
+
+} // namespace Pe
@@ -4,6 +4,7 @@
 #include <ntimage.h>
 #else
 #include <winnt.h>
+#include <iterator>
 #endif
 
 
@@ -59,12 +60,139 @@ namespace tr
 
 
 
+//
+// Opt-in instrumentation of the hot paths: define PE_INSTRUMENTATION for the whole project (compiler options),
+// not before an inclusion: it changes the inline bodies, every translation unit of a binary must agree on it.
+// Counters are thread-local, Instrumentation::Scope attributes them to a piece of work (e.g. one image).
+// Compiled out by default.
+//
+
+#ifdef PE_INSTRUMENTATION
+
+#ifdef _KERNEL_MODE
+#error "PE_INSTRUMENTATION uses thread_local and is not supported in the kernel mode"
+#endif
+
+namespace Instrumentation
+{
+    enum class Counter : unsigned int
+    {
+        byRva,
+        byRvaSectionWalk, // Sections visited to translate an RVA in a raw file
+        byRvaFailed,      // RVAs not found in any section
+        sectionStep,      // Including the walks of byRva
+        importModuleStep,
+        importFunctionStep,
+        delayedImportModuleStep,
+        delayedImportFunctionStep,
+        boundImportModuleStep,
+        boundImportForwarderStep,
+        exportStep,
+        relocPageStep,
+        relocStep,
+        exceptionStep,
+        tlsCallbackStep,
+        debugStep,
+        clrRowStep,
+        count
+    };
+
+    inline const char* name(const Counter counter) noexcept
+    {
+        constexpr const char* k_names[] = {
+            "byRva",
+            "byRvaSectionWalk",
+            "byRvaFailed",
+            "sectionStep",
+            "importModuleStep",
+            "importFunctionStep",
+            "delayedImportModuleStep",
+            "delayedImportFunctionStep",
+            "boundImportModuleStep",
+            "boundImportForwarderStep",
+            "exportStep",
+            "relocPageStep",
+            "relocStep",
+            "exceptionStep",
+            "tlsCallbackStep",
+            "debugStep",
+            "clrRowStep"
+        };
+        static_assert(sizeof(k_names) / sizeof(*k_names) == static_cast<unsigned int>(Counter::count), "Names mismatch");
+
+        return (counter < Counter::count) ? k_names[static_cast<unsigned int>(counter)] : nullptr;
+    }
+
+    struct Counters
+    {
+        unsigned long long values[static_cast<unsigned int>(Counter::count)];
+
+        unsigned long long operator [] (const Counter counter) const noexcept
+        {
+            return values[static_cast<unsigned int>(counter)];
+        }
+
+        Counters operator - (const Counters& counters) const noexcept
+        {
+            Counters result{};
+            for (unsigned int i = 0; i < static_cast<unsigned int>(Counter::count); ++i)
+            {
+                result.values[i] = values[i] - counters.values[i];
+            }
+            return result;
+        }
+    };
+
+    inline Counters& counters() noexcept
+    {
+        static thread_local Counters s_counters{};
+        return s_counters;
+    }
+
+    inline void count(const Counter counter) noexcept
+    {
+        ++counters().values[static_cast<unsigned int>(counter)];
+    }
+
+    inline void reset() noexcept
+    {
+        counters() = Counters{};
+    }
+
+    // Counters of the current thread since the construction:
+    class Scope
+    {
+    private:
+        const Counters m_start;
+
+    public:
+        Scope() noexcept : m_start(counters())
+        {
+        }
+
+        Counters delta() const noexcept
+        {
+            return counters() - m_start;
+        }
+    };
+} // namespace Instrumentation
+
+#define PE_COUNT(counter) ::Pe::Instrumentation::count(::Pe::Instrumentation::Counter::counter)
+
+#else
+
+#define PE_COUNT(counter) static_cast<void>(0)
+
+#endif // PE_INSTRUMENTATION
+
+
+
 enum class Arch : unsigned char
 {
     unknown,
     x32,
     x64,
-    native = (sizeof(size_t) == sizeof(unsigned long) ? x32 : x64),
+    native = (sizeof(void*) == 4 ? x32 : x64),
     inverse = (native == x32 ? x64 : x32)
 };
 
@@ -277,6 +405,7 @@ using DirExports = Dir<IMAGE_EXPORT_DIRECTORY, IMAGE_DIRECTORY_ENTRY_EXPORT>;
 using DirRelocs  = Dir<IMAGE_BASE_RELOCATION, IMAGE_DIRECTORY_ENTRY_BASERELOC>;
 using DirExceptions = Dir<GenericTypes::RUNTIME_FUNCTION, IMAGE_DIRECTORY_ENTRY_EXCEPTION>;
 using DirDebug = Dir<IMAGE_DEBUG_DIRECTORY, IMAGE_DIRECTORY_ENTRY_DEBUG>;
+using DirClr = Dir<IMAGE_COR20_HEADER, IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR>;
 
 template <Arch arch>
 using DirTls = Dir<typename Types<arch>::TlsDir, IMAGE_DIRECTORY_ENTRY_TLS>;
@@ -300,6 +429,23 @@ struct DirectoryDescriptor
     }
 };
 
+struct SectionData
+{
+    const unsigned char* data; // Contents of the section in the file or in the memory
+    unsigned int size;         // Available bytes: the uninitialized tail of a file section isn't included
+    Rva rva;
+
+    bool valid() const noexcept
+    {
+        return data && size;
+    }
+
+    bool contains(const Rva addr) const noexcept
+    {
+        return (addr >= rva) && (addr - rva < size);
+    }
+};
+
 class Sections; // Arch-independent
 template <Arch> class Imports;
 template <Arch> class DelayedImports;
@@ -309,6 +455,7 @@ template <Arch> class Relocs;
 template <Arch> class Exceptions;
 template <Arch> class Tls;
 template <Arch> class Debug;
+template <Arch> class Clr;
 
 
 struct PeMagic
@@ -330,7 +477,7 @@ public:
     static constexpr auto k_magic = Types::k_magic;
 
 private:
-    const void* const m_base;
+    const void* m_base;
 
 public:
     explicit PeHeaders(const void* const base) noexcept : m_base(base)
@@ -428,11 +575,17 @@ class Pe
 public:
     using ImgDataDir = typename GenericTypes::ImgDataDir;
 
+    static constexpr Arch k_arch = arch;
+
 private:
-    const void* const m_base;
-    const ImgType m_type;
+    const void* m_base;
+    ImgType m_type;
 
 public:
+    Pe() noexcept : m_base(nullptr), m_type(ImgType::module)
+    {
+    }
+
     Pe(const ImgType type, const void* const base) noexcept : m_base(base), m_type(type)
     {
     }
@@ -452,14 +605,10 @@ public:
         return PeHeaders<arch>(m_base);
     }
 
-    template <typename Type>
-    const Type* byRva(const Rva rva) const noexcept
+private:
+    // Offset of the rva in the raw file and the bytes of its section that follow it on disk:
+    bool locate(const Rva rva, unsigned long long& offset, unsigned long long& available) const noexcept
     {
-        if (m_type == ImgType::module)
-        {
-            return reinterpret_cast<const Type*>(static_cast<const unsigned char*>(m_base) + rva);
-        }
-
         const auto* const optHdr = headers().opt();
         const auto fileAlignment = optHdr->FileAlignment;
         const auto sectionAlignment = optHdr->SectionAlignment;
@@ -467,6 +616,8 @@ public:
         constexpr auto k_minimalSectionAlignment = 512u;
         for (const auto& sec : sections())
         {
+            PE_COUNT(byRvaSectionWalk);
+
             const auto sizeOnDisk = sec.SizeOfRawData;
             const auto sizeInMem = sec.Misc.VirtualSize;
 
@@ -490,13 +641,53 @@ public:
 
             if ((rva >= sectionBase) && (rva < sectionBase + sectionSize))
             {
-                return reinterpret_cast<const Type*>(static_cast<const unsigned char*>(m_base) + (sectionOffset + (rva - sectionBase)));
+                offset = sectionOffset + (rva - sectionBase);
+                available = sectionBase + sectionSize - rva;
+                return true;
             }
         }
-        
+
+        return false;
+    }
+
+public:
+    template <typename Type>
+    const Type* byRva(const Rva rva) const noexcept
+    {
+        PE_COUNT(byRva);
+
+        if (m_type == ImgType::module)
+        {
+            return reinterpret_cast<const Type*>(static_cast<const unsigned char*>(m_base) + rva);
+        }
+
+        unsigned long long offset = 0;
+        unsigned long long available = 0;
+        if (locate(rva, offset, available))
+        {
+            return reinterpret_cast<const Type*>(static_cast<const unsigned char*>(m_base) + offset);
+        }
+
+        PE_COUNT(byRvaFailed);
         return nullptr;
     }
 
+    // How many elements of the Type fit at the rva: up to the end of its section's raw data in a file,
+    // up to the end of the image in a module:
+    template <typename Type>
+    unsigned long long capacity(const Rva rva) const noexcept
+    {
+        if (m_type == ImgType::module)
+        {
+            const auto size = imageSize();
+            return (rva < size) ? (size - rva) / sizeof(Type) : 0;
+        }
+
+        unsigned long long offset = 0;
+        unsigned long long available = 0;
+        return locate(rva, offset, available) ? available / sizeof(Type) : 0;
+    }
+
     template <typename Type>
     const Type* byOffset(const unsigned int offset) const noexcept
     {
@@ -534,6 +725,17 @@ public:
         return headers().opt()->SizeOfImage;
     }
 
+    SectionData sectionData(const typename GenericTypes::SecHeader& sec) const noexcept
+    {
+        const auto sizeInMem = sec.Misc.VirtualSize ? sec.Misc.VirtualSize : sec.SizeOfRawData;
+        const auto size = (m_type == ImgType::module)
+            ? sizeInMem
+            : ((sec.SizeOfRawData < sizeInMem) ? sec.SizeOfRawData : sizeInMem);
+
+        const auto* const data = size ? byRva<unsigned char>(sec.VirtualAddress) : nullptr;
+        return SectionData{ data, data ? static_cast<unsigned int>(size) : 0u, sec.VirtualAddress };
+    }
+
     unsigned long long entryPoint() const noexcept
     {
         return static_cast<unsigned long long>(reinterpret_cast<size_t>(byRva<void>(headers().opt()->AddressOfEntryPoint)));
@@ -558,6 +760,7 @@ public:
     Exceptions<arch> exceptions() const noexcept;
     Tls<arch> tls() const noexcept;
     Debug<arch> debug() const noexcept;
+    Clr<arch> clr() const noexcept;
 };
 
 using Pe32 = Pe<Arch::x32>;
@@ -566,29 +769,141 @@ using PeNative = Pe<Arch::native>;
 
 
 
+//
+// Image of an architecture that isn't known in advance: it is classified once and kept along with the view.
+// visit() invokes a generic callable with the typed view, so there are no per-architecture branches on the caller side:
+//
+//     const auto count = Pe::visit(buffer, [](const auto& pe) { return pe.exports().count(); });
+//
+
+class PeAny
+{
+private:
+    const void* m_base;
+    ImgType m_type;
+    Arch m_arch;
+
+public:
+    PeAny() noexcept : m_base(nullptr), m_type(ImgType::module), m_arch(Arch::unknown)
+    {
+    }
+
+    PeAny(const ImgType type, const void* const base) noexcept
+        : m_base(base)
+        , m_type(type)
+        , m_arch(base ? PeArch::classify(base) : Arch::unknown)
+    {
+    }
+
+    static PeAny fromFile(const void* const buffer) noexcept
+    {
+        return PeAny(ImgType::file, buffer);
+    }
+
+    static PeAny fromModule(const void* const base) noexcept
+    {
+        return PeAny(ImgType::module, base);
+    }
+
+    const void* base() const noexcept
+    {
+        return m_base;
+    }
+
+    ImgType type() const noexcept
+    {
+        return m_type;
+    }
+
+    Arch arch() const noexcept
+    {
+        return m_arch;
+    }
+
+    bool valid() const noexcept
+    {
+        return m_arch != Arch::unknown;
+    }
+
+    template <Arch arch>
+    Pe<arch> as() const noexcept
+    {
+        return Pe<arch>(m_type, m_base);
+    }
+
+    // Returns a value-initialized result of the callable if the image isn't valid:
+    template <typename Fn>
+    auto visit(Fn&& fn) const
+    {
+        switch (m_arch)
+        {
+        case Arch::x32:
+        {
+            return fn(as<Arch::x32>());
+        }
+        case Arch::x64:
+        {
+            return fn(as<Arch::x64>());
+        }
+        default:
+        {
+            break;
+        }
+        }
+
+        return decltype(fn(as<Arch::x32>()))();
+    }
+};
+
+// Classifies a raw file and invokes the callable with Pe32 or Pe64:
+template <typename Fn>
+auto visit(const void* const buffer, Fn&& fn)
+{
+    return PeAny::fromFile(buffer).visit(tr::forward<Fn>(fn));
+}
+
+
+
 class Sections
 {
 public:
     class Iterator
     {
+    public:
+#ifndef _KERNEL_MODE
+        using iterator_concept = std::random_access_iterator_tag;
+        using iterator_category = std::random_access_iterator_tag;
+#endif
+        using value_type = typename GenericTypes::SecHeader;
+        using difference_type = long long;
+        using pointer = const typename GenericTypes::SecHeader*;
+        using reference = const typename GenericTypes::SecHeader&;
+
     private:
-        const Sections& m_owner;
+        const typename GenericTypes::SecHeader* m_sections;
+        unsigned int m_count;
         unsigned int m_pos;
 
     public:
+        Iterator() noexcept : m_sections(nullptr), m_count(0), m_pos(0)
+        {
+        }
+
         Iterator(const Sections& owner, const unsigned int pos) noexcept
-            : m_owner(owner)
+            : m_sections(owner.sections())
+            , m_count(owner.count())
             , m_pos(pos)
         {
-            if (m_pos > m_owner.count())
+            if (m_pos > m_count)
             {
-                m_pos = m_owner.count();
+                m_pos = m_count;
             }
         }
 
         Iterator& operator ++ () noexcept
         {
-            if (m_pos < m_owner.count())
+            PE_COUNT(sectionStep);
+            if (m_pos < m_count)
             {
                 ++m_pos;
             }
@@ -603,6 +918,50 @@ public:
             return it;
         }
 
+        Iterator& operator -- () noexcept
+        {
+            --m_pos;
+            return *this;
+        }
+
+        Iterator operator -- (int) noexcept
+        {
+            const auto it = *this;
+            --(*this);
+            return it;
+        }
+
+        Iterator& operator += (const difference_type offset) noexcept
+        {
+            m_pos = static_cast<unsigned int>(m_pos + offset);
+            return *this;
+        }
+
+        Iterator& operator -= (const difference_type offset) noexcept
+        {
+            return operator += (-offset);
+        }
+
+        friend Iterator operator + (Iterator it, const difference_type offset) noexcept
+        {
+            return it += offset;
+        }
+
+        friend Iterator operator + (const difference_type offset, Iterator it) noexcept
+        {
+            return it += offset;
+        }
+
+        friend Iterator operator - (Iterator it, const difference_type offset) noexcept
+        {
+            return it -= offset;
+        }
+
+        friend difference_type operator - (const Iterator& left, const Iterator& right) noexcept
+        {
+            return static_cast<difference_type>(left.m_pos) - static_cast<difference_type>(right.m_pos);
+        }
+
         bool operator == (const Iterator& it) const noexcept
         {
             return m_pos == it.m_pos;
@@ -613,20 +972,45 @@ public:
             return !operator == (it);
         }
 
-        const typename GenericTypes::SecHeader& operator * () const noexcept
+        bool operator < (const Iterator& it) const noexcept
+        {
+            return m_pos < it.m_pos;
+        }
+
+        bool operator > (const Iterator& it) const noexcept
+        {
+            return it < *this;
+        }
+
+        bool operator <= (const Iterator& it) const noexcept
+        {
+            return !(it < *this);
+        }
+
+        bool operator >= (const Iterator& it) const noexcept
+        {
+            return !(*this < it);
+        }
+
+        reference operator * () const noexcept
         {
             return *operator -> ();
         }
 
-        const typename GenericTypes::SecHeader* operator -> () const noexcept
+        pointer operator -> () const noexcept
+        {
+            return &m_sections[m_pos];
+        }
+
+        reference operator [] (const difference_type offset) const noexcept
         {
-            return &m_owner.sections()[m_pos];
+            return m_sections[m_pos + offset];
         }
     };
 
 private:
-    const typename GenericTypes::SecHeader* const m_sections;
-    const unsigned int m_count;
+    const typename GenericTypes::SecHeader* m_sections;
+    unsigned int m_count;
 
 public:
     Sections(const typename GenericTypes::SecHeader* const sections, const unsigned int count) noexcept
@@ -745,49 +1129,196 @@ public:
 
 
 
-template <Arch arch>
-class Imports
+// Iterator over array-like tables (exports, exceptions, debug entries, import thunks).
+// Entry provides operators ++, += (offset), - (distance) and ==.
+// Dereferencing yields a copy of the entry: entries are lightweight values.
+// A prvalue reference doesn't meet the Cpp17 forward iterator requirements, so the legacy category is input
+// and only the C++20 concept is random access: the parallel algorithms need forward iterators,
+// run them over the indices and subscript the begin iterator, it is O(1).
+template <typename Entry>
+class RandomAccessIterator
 {
 public:
-    class ModuleEntry;
+#ifndef _KERNEL_MODE
+    using iterator_concept = std::random_access_iterator_tag;
+    using iterator_category = std::input_iterator_tag;
+#endif
+    using value_type = Entry;
+    using difference_type = long long;
+    using pointer = const Entry*;
+    using reference = Entry;
 
-    class FunctionEntry
+private:
+    Entry m_entry;
+
+public:
+    RandomAccessIterator() noexcept : m_entry()
     {
-    private:
-        const ModuleEntry& m_lib;
-        unsigned int m_index;
+    }
 
-    public:
-        FunctionEntry(const ModuleEntry& lib, const unsigned int index) noexcept : m_lib(lib), m_index(index)
-        {
-        }
+    explicit RandomAccessIterator(const Entry& entry) noexcept : m_entry(entry)
+    {
+    }
 
-        const ModuleEntry& lib() const noexcept
-        {
-            return m_lib;
-        }
+    reference operator * () const noexcept
+    {
+        return m_entry;
+    }
 
-        unsigned int index() const noexcept
-        {
-            return m_index;
-        }
+    pointer operator -> () const noexcept
+    {
+        return &m_entry;
+    }
 
-        const typename Types<arch>::ImportAddressTableEntry* importAddressTableEntry() const noexcept // Import Address Table
-        {
-            return &m_lib.importAddressTable()[m_index];
-        }
+    reference operator [] (const difference_type offset) const noexcept
+    {
+        return *(*this + offset);
+    }
 
-        const typename Types<arch>::ImportLookupTableEntry* importLookupTableEntry() const noexcept // Import Lookup Table
-        {
-            return &m_lib.importLookupTable()[m_index];
-        }
+    RandomAccessIterator& operator ++ () noexcept
+    {
+        ++m_entry;
+        return *this;
+    }
 
-        bool valid() const noexcept
-        {
-            return importLookupTableEntry()->valid();
-        }
+    RandomAccessIterator operator ++ (int) noexcept
+    {
+        const auto prev = *this;
+        ++m_entry;
+        return prev;
+    }
 
-        ImportType type() const noexcept
+    RandomAccessIterator& operator -- () noexcept
+    {
+        m_entry += -1;
+        return *this;
+    }
+
+    RandomAccessIterator operator -- (int) noexcept
+    {
+        const auto prev = *this;
+        m_entry += -1;
+        return prev;
+    }
+
+    RandomAccessIterator& operator += (const difference_type offset) noexcept
+    {
+        m_entry += offset;
+        return *this;
+    }
+
+    RandomAccessIterator& operator -= (const difference_type offset) noexcept
+    {
+        m_entry += -offset;
+        return *this;
+    }
+
+    friend RandomAccessIterator operator + (RandomAccessIterator it, const difference_type offset) noexcept
+    {
+        return it += offset;
+    }
+
+    friend RandomAccessIterator operator + (const difference_type offset, RandomAccessIterator it) noexcept
+    {
+        return it += offset;
+    }
+
+    friend RandomAccessIterator operator - (RandomAccessIterator it, const difference_type offset) noexcept
+    {
+        return it -= offset;
+    }
+
+    friend difference_type operator - (const RandomAccessIterator& left, const RandomAccessIterator& right) noexcept
+    {
+        return left.m_entry - right.m_entry;
+    }
+
+    bool operator == (const RandomAccessIterator& it) const noexcept
+    {
+        return m_entry == it.m_entry;
+    }
+
+    bool operator != (const RandomAccessIterator& it) const noexcept
+    {
+        return !operator == (it);
+    }
+
+    bool operator < (const RandomAccessIterator& it) const noexcept
+    {
+        return (m_entry - it.m_entry) < 0;
+    }
+
+    bool operator > (const RandomAccessIterator& it) const noexcept
+    {
+        return it < *this;
+    }
+
+    bool operator <= (const RandomAccessIterator& it) const noexcept
+    {
+        return !(it < *this);
+    }
+
+    bool operator >= (const RandomAccessIterator& it) const noexcept
+    {
+        return !(*this < it);
+    }
+};
+
+
+
+template <Arch arch>
+class Imports
+{
+public:
+    class ModuleEntry;
+
+    class FunctionEntry
+    {
+    private:
+        Pe<arch> m_pe;
+        const typename DirImports::Type* m_descriptor;
+        const typename Types<arch>::ImportAddressTableEntry* m_importAddressTable;
+        const typename Types<arch>::ImportLookupTableEntry* m_importLookupTable;
+        unsigned int m_index;
+
+    public:
+        FunctionEntry() noexcept = default;
+
+        FunctionEntry(const ModuleEntry& lib, const unsigned int index) noexcept
+            : m_pe(lib.pe())
+            , m_descriptor(lib.descriptor())
+            , m_importAddressTable(lib.importAddressTable())
+            , m_importLookupTable(lib.importLookupTable())
+            , m_index(index)
+        {
+        }
+
+        ModuleEntry lib() const noexcept
+        {
+            return ModuleEntry(m_pe, m_descriptor);
+        }
+
+        unsigned int index() const noexcept
+        {
+            return m_index;
+        }
+
+        const typename Types<arch>::ImportAddressTableEntry* importAddressTableEntry() const noexcept // Import Address Table
+        {
+            return &m_importAddressTable[m_index];
+        }
+
+        const typename Types<arch>::ImportLookupTableEntry* importLookupTableEntry() const noexcept // Import Lookup Table
+        {
+            return &m_importLookupTable[m_index];
+        }
+
+        bool valid() const noexcept
+        {
+            return importLookupTableEntry()->valid();
+        }
+
+        ImportType type() const noexcept
         {
             return importLookupTableEntry()->type();
         }
@@ -800,12 +1331,12 @@ public:
             }
 
             const Rva rva = importLookupTableEntry()->name.hintNameRva;
-            return m_lib.pe().byRva<typename GenericTypes::ImgImportByName>(rva);
+            return m_pe.byRva<typename GenericTypes::ImgImportByName>(rva);
         }
 
         unsigned long long address() const noexcept
         {
-            if ((m_lib.pe().type() == ImgType::file) && !m_lib.bound())
+            if ((m_pe.type() == ImgType::file) && !m_descriptor->TimeDateStamp)
             {
                 return 0;
             }
@@ -828,24 +1359,31 @@ public:
             return index() == entry.index();
         }
 
-        bool operator == (typename Iterator<FunctionEntry>::TheEnd) const noexcept
+        FunctionEntry& operator ++ () noexcept
         {
-            return !valid();
+            PE_COUNT(importFunctionStep);
+            ++m_index;
+            return *this;
         }
 
-        FunctionEntry& operator ++ () noexcept
+        FunctionEntry& operator += (const long long offset) noexcept
         {
-            ++m_index;
+            m_index = static_cast<unsigned int>(m_index + offset);
             return *this;
         }
+
+        long long operator - (const FunctionEntry& entry) const noexcept
+        {
+            return static_cast<long long>(m_index) - static_cast<long long>(entry.m_index);
+        }
     };
 
-    using FunctionIterator = Iterator<FunctionEntry>;
+    using FunctionIterator = RandomAccessIterator<FunctionEntry>;
 
     class ModuleEntry
     {
     private:
-        const Pe<arch>& m_pe;
+        Pe<arch> m_pe;
         const typename DirImports::Type* m_descriptor;
 
     public:
@@ -904,18 +1442,37 @@ public:
 
         ModuleEntry& operator ++ () noexcept
         {
+            PE_COUNT(importModuleStep);
             ++m_descriptor;
             return *this;
         }
 
+        // The thunk table is null-terminated:
+        unsigned int count() const noexcept
+        {
+            const auto* const table = importLookupTable();
+            if (!table)
+            {
+                return 0;
+            }
+
+            unsigned int count = 0;
+            while (table[count].valid())
+            {
+                ++count;
+            }
+
+            return count;
+        }
+
         FunctionIterator begin() const noexcept
         {
-            return FunctionIterator(*this, 0);
+            return FunctionIterator(FunctionEntry(*this, 0));
         }
 
-        typename FunctionIterator::TheEnd end() const noexcept
+        FunctionIterator end() const noexcept
         {
-            return {};
+            return FunctionIterator(FunctionEntry(*this, count()));
         }
     };
 
@@ -923,10 +1480,13 @@ public:
 
 
 private:
-    const Pe<arch>& m_pe;
+    Pe<arch> m_pe;
+    DirectoryDescriptor<DirImports> m_descriptor;
 
 public:
-    explicit Imports(const Pe<arch>& pe) noexcept : m_pe(pe)
+    explicit Imports(const Pe<arch>& pe) noexcept
+        : m_pe(pe)
+        , m_descriptor(pe.directory<DirImports>())
     {
     }
 
@@ -937,23 +1497,22 @@ public:
 
     DirectoryDescriptor<DirImports> descriptor() const noexcept
     {
-        return m_pe.directory<DirImports>();
+        return m_descriptor;
     }
 
     bool valid() const noexcept
     {
-        return descriptor().valid();
+        return m_descriptor.valid();
     }
 
     bool empty() const noexcept
     {
-        const auto importDescriptor = descriptor();
-        return importDescriptor.empty() || !importDescriptor.ptr->FirstThunk;
+        return m_descriptor.empty() || !m_descriptor.ptr->FirstThunk;
     }
 
     ModuleIterator begin() const noexcept
     {
-        return ModuleIterator(m_pe, descriptor().ptr);
+        return ModuleIterator(m_pe, m_descriptor.ptr);
     }
 
     typename ModuleIterator::TheEnd end() const noexcept
@@ -973,17 +1532,27 @@ public:
     class FunctionEntry
     {
     private:
-        const ModuleEntry& m_lib;
+        Pe<arch> m_pe;
+        const typename DirDelayedImports::Type* m_descriptor;
+        const typename Types<arch>::ImportAddressTableEntry* m_importAddressTable;
+        const typename Types<arch>::ImportNameTableEntry* m_importNameTable;
         unsigned int m_index;
 
     public:
-        FunctionEntry(const ModuleEntry& lib, const unsigned int index) noexcept : m_lib(lib), m_index(index)
+        FunctionEntry() noexcept = default;
+
+        FunctionEntry(const ModuleEntry& lib, const unsigned int index) noexcept
+            : m_pe(lib.pe())
+            , m_descriptor(lib.descriptor())
+            , m_importAddressTable(lib.importAddressTable())
+            , m_importNameTable(lib.importNameTable())
+            , m_index(index)
         {
         }
 
-        const ModuleEntry& lib() const noexcept
+        ModuleEntry lib() const noexcept
         {
-            return m_lib;
+            return ModuleEntry(m_pe, m_descriptor);
         }
 
         unsigned int index() const noexcept
@@ -993,12 +1562,12 @@ public:
 
         const typename Types<arch>::ImportAddressTableEntry* importAddressTableEntry() const noexcept
         {
-            return &m_lib.importAddressTable()[m_index];
+            return &m_importAddressTable[m_index];
         }
 
         const typename Types<arch>::ImportNameTableEntry* importNameTableEntry() const noexcept
         {
-            return &m_lib.importNameTable()[m_index];
+            return &m_importNameTable[m_index];
         }
 
         bool valid() const noexcept
@@ -1019,7 +1588,7 @@ public:
             }
 
             const Rva rva = importNameTableEntry()->name.hintNameRva;
-            return m_lib.pe().byRva<typename GenericTypes::ImgImportByName>(rva);
+            return m_pe.byRva<typename GenericTypes::ImgImportByName>(rva);
         }
 
         unsigned long long address() const noexcept
@@ -1042,24 +1611,31 @@ public:
             return index() == entry.index();
         }
 
-        bool operator == (typename Iterator<FunctionEntry>::TheEnd) const noexcept
+        FunctionEntry& operator ++ () noexcept
         {
-            return !valid();
+            PE_COUNT(delayedImportFunctionStep);
+            ++m_index;
+            return *this;
         }
 
-        FunctionEntry& operator ++ () noexcept
+        FunctionEntry& operator += (const long long offset) noexcept
         {
-            ++m_index;
+            m_index = static_cast<unsigned int>(m_index + offset);
             return *this;
         }
+
+        long long operator - (const FunctionEntry& entry) const noexcept
+        {
+            return static_cast<long long>(m_index) - static_cast<long long>(entry.m_index);
+        }
     };
 
-    using FunctionIterator = Iterator<FunctionEntry>;
+    using FunctionIterator = RandomAccessIterator<FunctionEntry>;
 
     class ModuleEntry
     {
     private:
-        const Pe<arch>& m_pe;
+        Pe<arch> m_pe;
         const typename DirDelayedImports::Type* m_descriptor;
 
     public:
@@ -1113,28 +1689,50 @@ public:
 
         ModuleEntry& operator ++ () noexcept
         {
+            PE_COUNT(delayedImportModuleStep);
             ++m_descriptor;
             return *this;
         }
 
+        // The thunk table is null-terminated:
+        unsigned int count() const noexcept
+        {
+            const auto* const table = importNameTable();
+            if (!table)
+            {
+                return 0;
+            }
+
+            unsigned int count = 0;
+            while (table[count].valid())
+            {
+                ++count;
+            }
+
+            return count;
+        }
+
         FunctionIterator begin() const noexcept
         {
-            return FunctionIterator(*this, 0);
+            return FunctionIterator(FunctionEntry(*this, 0));
         }
 
-        typename Iterator<ModuleEntry>::TheEnd end() const noexcept
+        FunctionIterator end() const noexcept
         {
-            return {};
+            return FunctionIterator(FunctionEntry(*this, count()));
         }
     };
 
     using ModuleIterator = Iterator<ModuleEntry>;
 
 private:
-    const Pe<arch>& m_pe;
+    Pe<arch> m_pe;
+    DirectoryDescriptor<DirDelayedImports> m_descriptor;
 
 public:
-    explicit DelayedImports(const Pe<arch>& pe) noexcept : m_pe(pe)
+    explicit DelayedImports(const Pe<arch>& pe) noexcept
+        : m_pe(pe)
+        , m_descriptor(pe.directory<DirDelayedImports>())
     {
     }
 
@@ -1145,23 +1743,22 @@ public:
 
     DirectoryDescriptor<DirDelayedImports> descriptor() const noexcept
     {
-        return m_pe.directory<DirDelayedImports>();
+        return m_descriptor;
     }
 
     bool valid() const noexcept
     {
-        return descriptor().valid();
+        return m_descriptor.valid();
     }
 
     bool empty() const noexcept
     {
-        const auto importDescriptor = descriptor();
-        return importDescriptor.empty() || !importDescriptor.ptr->DllNameRVA;
+        return m_descriptor.empty() || !m_descriptor.ptr->DllNameRVA;
     }
 
     ModuleIterator begin() const noexcept
     {
-        return ModuleIterator(m_pe, descriptor().ptr);
+        return ModuleIterator(m_pe, m_descriptor.ptr);
     }
 
     typename ModuleIterator::TheEnd end() const noexcept
@@ -1181,17 +1778,21 @@ public:
     class ForwarderEntry
     {
     private:
-        const ModuleEntry& m_lib;
+        const typename DirBoundImports::Type* m_directoryBase;
+        const typename DirBoundImports::Type* m_module;
         unsigned int m_index;
 
     public:
-        ForwarderEntry(const ModuleEntry& lib, const unsigned int index) noexcept : m_lib(lib), m_index(index)
+        ForwarderEntry(const ModuleEntry& lib, const unsigned int index) noexcept
+            : m_directoryBase(lib.directoryBase())
+            , m_module(lib.descriptor())
+            , m_index(index)
         {
         }
 
-        const ModuleEntry& lib() const noexcept
+        ModuleEntry lib() const noexcept
         {
-            return m_lib;
+            return ModuleEntry(m_directoryBase, m_module);
         }
 
         unsigned int index() const noexcept
@@ -1201,7 +1802,7 @@ public:
 
         const typename GenericTypes::BoundForwarderRef* descriptor() const noexcept
         {
-            return &m_lib.forwarders()[m_index];
+            return &reinterpret_cast<const typename GenericTypes::BoundForwarderRef*>(m_module + 1)[m_index];
         }
 
         bool valid() const noexcept
@@ -1211,7 +1812,7 @@ public:
 
         const char* libName() const noexcept
         {
-            return reinterpret_cast<const char*>(m_lib.directoryBase()) + descriptor()->OffsetModuleName;
+            return reinterpret_cast<const char*>(m_directoryBase) + descriptor()->OffsetModuleName;
         }
 
         unsigned int timestamp() const noexcept
@@ -1226,6 +1827,7 @@ public:
 
         ForwarderEntry& operator ++ () noexcept
         {
+            PE_COUNT(boundImportForwarderStep);
             ++m_index;
             return *this;
         }
@@ -1237,7 +1839,7 @@ public:
     class ModuleEntry
     {
     private:
-        const typename DirBoundImports::Type* const m_directoryBase;
+        const typename DirBoundImports::Type* m_directoryBase;
         const typename DirBoundImports::Type* m_descriptor;
 
     public:
@@ -1247,6 +1849,12 @@ public:
         {
         }
 
+        ModuleEntry(const typename DirBoundImports::Type* const directoryBase, const typename DirBoundImports::Type* const descriptor) noexcept
+            : m_directoryBase(directoryBase)
+            , m_descriptor(descriptor)
+        {
+        }
+
         const typename DirBoundImports::Type* directoryBase() const noexcept
         {
             return m_directoryBase;
@@ -1303,13 +1911,14 @@ public:
             return descriptor() == entry.descriptor();
         }
 
-        bool operator == (typename Iterator<ForwarderEntry>::TheEnd) const noexcept
+        bool operator == (typename Iterator<ModuleEntry>::TheEnd) const noexcept
         {
             return !valid();
         }
 
-        ForwarderEntry& operator ++ () noexcept
+        ModuleEntry& operator ++ () noexcept
         {
+            PE_COUNT(boundImportModuleStep);
             m_descriptor = reinterpret_cast<const typename DirBoundImports::Type*>(reinterpret_cast<const unsigned char*>(forwarders()) + forwardersCount() * sizeof(typename GenericTypes::BoundForwarderRef));
             return *this;
         }
@@ -1328,7 +1937,7 @@ public:
     using ModuleIterator = Iterator<ModuleEntry>;
 
 private:
-    const Pe<arch>& m_pe;
+    Pe<arch> m_pe;
 
 public:
     explicit BoundImports(const Pe<arch>& pe) noexcept : m_pe(pe)
@@ -1370,20 +1979,60 @@ public:
     class FunctionEntry
     {
     private:
-        const Exports& m_exports;
-        const typename GenericTypes::ExportAddressTableEntry* const m_exportAddressTable;
-        const Rva* m_name;
-        const Ordinal* m_nameOrdinal;
+        Pe<arch> m_pe;
+        Rva m_directoryRva;
+        unsigned int m_directorySize;
+        unsigned int m_ordinalBase;
+        unsigned int m_count;
+        const typename GenericTypes::ExportAddressTableEntry* m_exportAddressTable;
+        const Rva* m_names;
+        const Ordinal* m_nameOrdinals;
+        unsigned int m_namesCount;
+        unsigned int m_namePos; // The first name with the ordinal not less than the index
         unsigned int m_index;
 
+    private:
+        // Name ordinals are expected to grow along with the names:
+        void seekName() noexcept
+        {
+            unsigned int left = 0;
+            unsigned int right = m_namesCount;
+            while (left < right)
+            {
+                const unsigned int pos = (left + right) / 2;
+                if (m_nameOrdinals[pos] < m_index)
+                {
+                    left = pos + 1;
+                }
+                else
+                {
+                    right = pos;
+                }
+            }
+
+            m_namePos = left;
+        }
+
     public:
+        FunctionEntry() noexcept = default;
+
         FunctionEntry(const Exports& exports, const unsigned int index) noexcept
-            : m_exports(exports)
+            : m_pe(exports.pe())
+            , m_directoryRva(exports.directoryRva())
+            , m_directorySize(exports.directorySize())
+            , m_ordinalBase(exports.valid() ? exports.ordinalBase() : 0)
+            , m_count(exports.count())
             , m_exportAddressTable(exports.tables().exportAddressTable)
-            , m_name(exports.tables().namePointerTable)
-            , m_nameOrdinal(exports.tables().nameOrdinalTable)
+            , m_names(exports.tables().namePointerTable)
+            , m_nameOrdinals(exports.tables().nameOrdinalTable)
+            , m_namesCount(exports.namesCount())
+            , m_namePos(0)
             , m_index(index)
         {
+            if (m_index)
+            {
+                seekName();
+            }
         }
 
         unsigned int index() const noexcept
@@ -1403,26 +2052,27 @@ public:
                 return ExportType::unknown;
             }
 
-            return !m_exports.contains(exportAddressTableEntry()->forwarderString)
+            const Rva rva = exportAddressTableEntry()->forwarderString;
+            return !((rva >= m_directoryRva) && (rva < (m_directoryRva + m_directorySize)))
                 ? ExportType::exact
                 : ExportType::forwarder;
         }
 
         bool hasName() const noexcept
         {
-            return m_index == *m_nameOrdinal;
+            return (m_namePos < m_namesCount) && (m_index == m_nameOrdinals[m_namePos]);
         }
 
         const char* name() const noexcept
         {
             return hasName()
-                ? m_exports.pe().byRva<char>(*m_name)
+                ? m_pe.byRva<char>(m_names[m_namePos])
                 : nullptr;
         }
 
         unsigned int ordinal() const noexcept
         {
-            return m_exports.ordinalBase() + m_index;
+            return m_ordinalBase + m_index;
         }
 
         const void* address() const noexcept
@@ -1432,7 +2082,7 @@ public:
                 return nullptr;
             }
 
-            return m_exports.pe().byRva<void>(exportAddressTableEntry()->address);
+            return m_pe.byRva<void>(exportAddressTableEntry()->address);
         }
 
         const char* forwarder() const noexcept
@@ -1442,12 +2092,12 @@ public:
                 return nullptr;
             }
 
-            return m_exports.pe().byRva<char>(exportAddressTableEntry()->forwarderString);
+            return m_pe.byRva<char>(exportAddressTableEntry()->forwarderString);
         }
 
         bool valid() const noexcept
         {
-            return m_index < m_exports.count();
+            return m_index < m_count;
         }
 
         bool operator == (const FunctionEntry& entry) const noexcept
@@ -1457,17 +2107,29 @@ public:
 
         FunctionEntry& operator ++ () noexcept
         {
-            if (hasName())
+            PE_COUNT(exportStep);
+            ++m_index;
+            while ((m_namePos < m_namesCount) && (m_nameOrdinals[m_namePos] < m_index))
             {
-                ++m_name;
-                ++m_nameOrdinal;
+                ++m_namePos; // Also skips aliases of the previous function
             }
-            ++m_index;
             return *this;
         }
+
+        FunctionEntry& operator += (const long long offset) noexcept
+        {
+            m_index = static_cast<unsigned int>(m_index + offset);
+            seekName();
+            return *this;
+        }
+
+        long long operator - (const FunctionEntry& entry) const noexcept
+        {
+            return static_cast<long long>(m_index) - static_cast<long long>(entry.m_index);
+        }
     };
 
-    using FunctionIterator = Iterator<FunctionEntry>;
+    using FunctionIterator = RandomAccessIterator<FunctionEntry>;
 
 public:
     struct Tables
@@ -1526,10 +2188,19 @@ public:
     };
 
 private:
-    const Pe<arch>& m_pe;
-    const typename GenericTypes::ImgDataDir* const m_directory;
-    const typename DirExports::Type* const m_descriptor;
-    const Tables m_tables;
+    Pe<arch> m_pe;
+    const typename GenericTypes::ImgDataDir* m_directory;
+    const typename DirExports::Type* m_descriptor;
+    Tables m_tables;
+    unsigned int m_count;
+    unsigned int m_namesCount;
+
+private:
+    // The counts come from the file, so they are clamped to the tables that fit in their sections:
+    static unsigned int clamp(const unsigned int count, const unsigned long long capacity) noexcept
+    {
+        return (count < capacity) ? count : static_cast<unsigned int>(capacity);
+    }
 
 public:
     explicit Exports(const Pe<arch>& pe) noexcept
@@ -1544,7 +2215,21 @@ public:
                   pe.byRva<Ordinal>(m_descriptor->AddressOfNameOrdinals)
               }
             : Tables{})
+        , m_count(0)
+        , m_namesCount(0)
     {
+        if (m_tables.exportAddressTable)
+        {
+            m_count = clamp(m_descriptor->NumberOfFunctions,
+                pe.template capacity<typename GenericTypes::ExportAddressTableEntry>(m_descriptor->AddressOfFunctions));
+        }
+
+        if (m_tables.namePointerTable && m_tables.nameOrdinalTable)
+        {
+            m_namesCount = clamp(clamp(m_descriptor->NumberOfNames,
+                pe.template capacity<Rva>(m_descriptor->AddressOfNames)),
+                pe.template capacity<Ordinal>(m_descriptor->AddressOfNameOrdinals));
+        }
     }
 
     const Pe<arch>& pe() const noexcept
@@ -1584,9 +2269,12 @@ public:
 
     unsigned int count() const noexcept
     {
-        return valid()
-            ? descriptor()->NumberOfFunctions
-            : 0;
+        return m_count;
+    }
+
+    unsigned int namesCount() const noexcept
+    {
+        return m_namesCount;
     }
 
     const char* moduleName() const noexcept
@@ -1602,12 +2290,12 @@ public:
 
     FunctionIterator begin() const noexcept
     {
-        return FunctionIterator(*this, 0);
+        return FunctionIterator(FunctionEntry(*this, 0));
     }
 
     FunctionIterator end() const noexcept
     {
-        return FunctionIterator(*this, count());
+        return FunctionIterator(FunctionEntry(*this, count()));
     }
 
     Export find(const char* const funcName) const noexcept
@@ -1629,7 +2317,7 @@ public:
 
         // [left, right):
         unsigned int left = 0;
-        unsigned int right = m_descriptor->NumberOfNames;
+        unsigned int right = m_namesCount;
 
         while (left < right)
         {
@@ -1656,6 +2344,11 @@ public:
         }
 
         const Ordinal unbiasedOrdinal = m_tables.nameOrdinalTable[left];
+        if (unbiasedOrdinal >= m_count)
+        {
+            return {};
+        }
+
         const auto& exportEntry = m_tables.exportAddressTable[unbiasedOrdinal];
         if (!contains(exportEntry.address))
         {
@@ -1675,7 +2368,7 @@ public:
         }
 
         const unsigned int unbiasedOrdinal = ordinal - ordinalBase();
-        if (unbiasedOrdinal >= m_descriptor->NumberOfFunctions)
+        if (unbiasedOrdinal >= m_count)
         {
             return {};
         }
@@ -1703,33 +2396,41 @@ public:
     class RelocEntry
     {
     private:
-        const PageEntry& m_page;
+        Pe<arch> m_pe;
+        const typename DirRelocs::Type* m_entry;
+        const void* m_page;
+        unsigned int m_count;
         unsigned int m_index;
 
     public:
-        RelocEntry(const PageEntry& page, const unsigned int index) noexcept : m_page(page), m_index(index)
+        RelocEntry(const PageEntry& page, const unsigned int index) noexcept
+            : m_pe(page.pe())
+            , m_entry(page.descriptor())
+            , m_page(page.page())
+            , m_count(page.count())
+            , m_index(index)
         {
         }
 
-        const PageEntry& page() const noexcept
+        PageEntry page() const noexcept
         {
-            return m_page;
+            return PageEntry(m_pe, m_entry);
         }
 
         const Reloc* reloc() const noexcept
         {
-            const auto* const relocs = reinterpret_cast<const Reloc*>(m_page.descriptor() + 1);
+            const auto* const relocs = reinterpret_cast<const Reloc*>(m_entry + 1);
             return &relocs[m_index];
         }
 
         const void* addr() const noexcept
         {
-            return static_cast<const unsigned char*>(page().page()) + reloc()->offsetInPage;
+            return static_cast<const unsigned char*>(m_page) + reloc()->offsetInPage;
         }
 
         bool valid() const noexcept
         {
-            return m_index < m_page.count();
+            return m_index < m_count;
         }
 
         bool operator == (const RelocEntry& entry) const noexcept
@@ -1739,6 +2440,7 @@ public:
 
         RelocEntry& operator ++ () noexcept
         {
+            PE_COUNT(relocStep);
             ++m_index;
             return *this;
         }
@@ -1749,16 +2451,21 @@ public:
     class PageEntry
     {
     private:
-        const Relocs& m_relocs;
+        Pe<arch> m_pe;
         const typename DirRelocs::Type* m_entry;
 
     public:
-        PageEntry(const Relocs& relocs, const typename DirRelocs::Type* entry) noexcept
-            : m_relocs(relocs)
+        PageEntry(const Pe<arch>& pe, const typename DirRelocs::Type* entry) noexcept
+            : m_pe(pe)
             , m_entry(entry)
         {
         }
 
+        const Pe<arch>& pe() const noexcept
+        {
+            return m_pe;
+        }
+
         bool valid() const noexcept
         {
             return m_entry && m_entry->VirtualAddress && m_entry->SizeOfBlock;
@@ -1771,7 +2478,7 @@ public:
 
         const void* page() const noexcept
         {
-            return m_relocs.pe().byRva<void>(m_entry->VirtualAddress);
+            return m_pe.byRva<void>(m_entry->VirtualAddress);
         }
 
         unsigned int count() const noexcept
@@ -1796,6 +2503,7 @@ public:
 
         PageEntry& operator ++ () noexcept
         {
+            PE_COUNT(relocPageStep);
             m_entry = reinterpret_cast<const typename DirRelocs::Type*>(reinterpret_cast<const unsigned char*>(m_entry) + m_entry->SizeOfBlock);
             return *this;
         }
@@ -1814,8 +2522,8 @@ public:
     using PageIterator = Iterator<PageEntry>;
 
 private:
-    const Pe<arch>& m_pe;
-    const DirectoryDescriptor<DirRelocs> m_descriptor;
+    Pe<arch> m_pe;
+    DirectoryDescriptor<DirRelocs> m_descriptor;
 
 public:
     explicit Relocs(const Pe<arch>& pe) noexcept
@@ -1841,12 +2549,12 @@ public:
 
     PageIterator begin() const noexcept
     {
-        return PageIterator(*this, m_descriptor.ptr);
+        return PageIterator(m_pe, m_descriptor.ptr);
     }
 
     PageIterator end() const noexcept
     {
-        return PageIterator(*this, reinterpret_cast<const typename DirRelocs::Type*>(reinterpret_cast<const unsigned char*>(m_descriptor.ptr) + m_descriptor.size));
+        return PageIterator(m_pe, reinterpret_cast<const typename DirRelocs::Type*>(reinterpret_cast<const unsigned char*>(m_descriptor.ptr) + m_descriptor.size));
     }
 };
 
@@ -1862,6 +2570,8 @@ public:
         const typename DirExceptions::Type* m_runtimeFunction;
 
     public:
+        RuntimeFunctionEntry() noexcept = default;
+
         explicit RuntimeFunctionEntry(const typename DirExceptions::Type* runtimeFunction) noexcept
             : m_runtimeFunction(runtimeFunction)
         {
@@ -1884,15 +2594,27 @@ public:
 
         RuntimeFunctionEntry& operator ++ () noexcept
         {
+            PE_COUNT(exceptionStep);
             ++m_runtimeFunction;
             return *this;
         }
+
+        RuntimeFunctionEntry& operator += (const long long offset) noexcept
+        {
+            m_runtimeFunction += offset;
+            return *this;
+        }
+
+        long long operator - (const RuntimeFunctionEntry& entry) const noexcept
+        {
+            return m_runtimeFunction - entry.m_runtimeFunction;
+        }
     };
 
-    using RuntimeFunctionIterator = Iterator<RuntimeFunctionEntry>;
+    using RuntimeFunctionIterator = RandomAccessIterator<RuntimeFunctionEntry>;
 
 private:
-    const DirectoryDescriptor<DirExceptions> m_descriptor;
+    DirectoryDescriptor<DirExceptions> m_descriptor;
 
 public:
     explicit Exceptions(const Pe<arch>& pe) noexcept
@@ -1912,12 +2634,12 @@ public:
 
     RuntimeFunctionIterator begin() const noexcept
     {
-        return RuntimeFunctionIterator(m_descriptor.ptr);
+        return RuntimeFunctionIterator(RuntimeFunctionEntry(m_descriptor.ptr));
     }
 
     RuntimeFunctionIterator end() const noexcept
     {
-        return RuntimeFunctionIterator(reinterpret_cast<const typename DirExceptions::Type*>(reinterpret_cast<const unsigned char*>(m_descriptor.ptr) + m_descriptor.size));
+        return RuntimeFunctionIterator(RuntimeFunctionEntry(reinterpret_cast<const typename DirExceptions::Type*>(reinterpret_cast<const unsigned char*>(m_descriptor.ptr) + m_descriptor.size)));
     }
 };
 
@@ -1930,20 +2652,20 @@ public:
     class CallbackEntry
     {
     private:
-        const Tls& m_tls;
+        Pe<arch> m_pe;
         const typename GenericTypes::FnImageTlsCallback* m_callbackPointer;
 
     public:
         explicit CallbackEntry(const Tls& tls, const typename GenericTypes::FnImageTlsCallback* const callbacks)
-            : m_tls(tls)
+            : m_pe(tls.pe())
             , m_callbackPointer(callbacks)
         {
         }
 
         typename GenericTypes::FnImageTlsCallback callback() const noexcept
         {
-            const Rva rva = static_cast<Rva>(static_cast<unsigned long long>(reinterpret_cast<size_t>(*m_callbackPointer)) - m_tls.pe().imageBase());
-            return static_cast<typename GenericTypes::FnImageTlsCallback>(m_tls.pe().byRva<void>(rva));
+            const Rva rva = static_cast<Rva>(static_cast<unsigned long long>(reinterpret_cast<size_t>(*m_callbackPointer)) - m_pe.imageBase());
+            return static_cast<typename GenericTypes::FnImageTlsCallback>(m_pe.byRva<void>(rva));
         }
 
         bool operator == (const CallbackEntry& entry) const noexcept
@@ -1958,6 +2680,7 @@ public:
 
         CallbackEntry& operator ++ () noexcept
         {
+            PE_COUNT(tlsCallbackStep);
             ++m_callbackPointer;
             return *this;
         }
@@ -1966,8 +2689,8 @@ public:
     using CallbackIterator = Iterator<CallbackEntry>;
 
 private:
-    const Pe<arch>& m_pe;
-    const DirectoryDescriptor<DirTls<arch>> m_directory;
+    Pe<arch> m_pe;
+    DirectoryDescriptor<DirTls<arch>> m_directory;
 
 public:
     explicit Tls(const Pe<arch>& pe) noexcept
@@ -2077,105 +2800,1713 @@ union DebugInfo
     DebugInfoPdb70 pdb70;
 };
 
-} // namespace CodeView
+// Appends the uppercase hex digits and the null terminator, returns the new position:
+template <typename Char>
+unsigned int formatHex(Char* const buf, unsigned int pos, unsigned long long value, const unsigned int minDigits) noexcept
+{
+    Char digits[16]{};
+    unsigned int count = 0;
+    do
+    {
+        digits[count++] = static_cast<Char>("0123456789ABCDEF"[value & 0xF]);
+        value >>= 4;
+    } while (value || (count < minDigits));
 
+    while (count)
+    {
+        buf[pos++] = digits[--count];
+    }
 
+    buf[pos] = Char();
+    return pos;
+}
 
-template <Arch arch>
-class Debug
+//
+// Binary form of the symbol server key, 20 bytes to be used as a key of hash maps:
+//
+//     std::unordered_map<SymbolKey, Value, SymbolKey::Hasher>
+//
+// PDB 2.0 keys keep the signature in Data1 and zeros in the rest of the GUID,
+// as SymSrvGetFileIndexInfo reports them.
+//
+struct SymbolKey
 {
-public:
-    class DebugEntry
-    {
-    private:
-        const typename DirDebug::Type* m_debugEntry;
-
-    public:
-        explicit DebugEntry(const typename DirDebug::Type* const debugEntry) noexcept : m_debugEntry(debugEntry)
-        {
-        }
+    static constexpr unsigned int k_maxLength = 40; // 32 digits of the GUID and up to 8 digits of the age
 
-        const typename DirDebug::Type* debugEntry() const noexcept
-        {
-            return m_debugEntry;
-        }
+    GUID guid;
+    unsigned int age;
 
-        bool operator == (const DebugEntry& entry) const noexcept
+    struct Hasher
+    {
+        size_t operator () (const SymbolKey& key) const noexcept
         {
-            return m_debugEntry == entry.m_debugEntry;
-        }
+            // FNV-1a:
+            unsigned long long hash = 0xCBF29CE484222325ull;
+            const auto* const bytes = reinterpret_cast<const unsigned char*>(&key);
+            for (unsigned int i = 0; i < sizeof(SymbolKey); ++i)
+            {
+                hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+            }
 
-        DebugEntry& operator ++ () noexcept
-        {
-            ++m_debugEntry;
-            return *this;
+            return static_cast<size_t>(hash);
         }
     };
 
-    using DebugIterator = Iterator<DebugEntry>;
-
-private:
-    const Pe<arch>& m_pe;
-    const DirectoryDescriptor<DirDebug> m_descriptor;
-
-public:
-    explicit Debug(const Pe<arch>& pe) noexcept
-        : m_pe(pe)
-        , m_descriptor(pe.directory<DirDebug>())
+    SymbolKey() noexcept : guid(), age(0)
     {
     }
 
-    const DirectoryDescriptor<DirDebug>& debugTable() const noexcept
+    SymbolKey(const GUID& pdbGuid, const unsigned int pdbAge) noexcept : guid(pdbGuid), age(pdbAge)
     {
-        return m_descriptor;
     }
 
-    bool valid() const noexcept
+    SymbolKey(const unsigned int signature, const unsigned int pdbAge) noexcept : guid(), age(pdbAge)
     {
-        return m_descriptor.valid();
+        guid.Data1 = signature;
     }
 
-    unsigned int count() const noexcept
+    bool pdb20() const noexcept
     {
-        if (!valid())
+        if (guid.Data2 || guid.Data3)
         {
-            return 0;
+            return false;
         }
 
-        return m_descriptor.size / sizeof(typename DirDebug::Type);
+        for (const auto byte : guid.Data4)
+        {
+            if (byte)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    //
+    // Writes "%08X%04X%04X%02X..%02X%X" for PDB 7.0 and "%08X%X" for PDB 2.0 with the null terminator.
+    // Returns the length or zero if the buffer is shorter than k_maxLength + 1:
+    //
+    template <typename Char>
+    unsigned int format(Char* const buf, const unsigned int capacity) const noexcept
+    {
+        if (!buf || (capacity <= k_maxLength))
+        {
+            return 0;
+        }
+
+        unsigned int pos = formatHex(buf, 0, guid.Data1, 8);
+        if (!pdb20())
+        {
+            pos = formatHex(buf, pos, guid.Data2, 4);
+            pos = formatHex(buf, pos, guid.Data3, 4);
+            for (const auto byte : guid.Data4)
+            {
+                pos = formatHex(buf, pos, byte, 2);
+            }
+        }
+
+        return formatHex(buf, pos, age, 1);
+    }
+
+    template <typename Char, unsigned int capacity>
+    unsigned int format(Char (&buf)[capacity]) const noexcept
+    {
+        static_assert(capacity > k_maxLength, "The buffer is too small for the key");
+        return format(buf, capacity);
+    }
+
+    bool operator == (const SymbolKey& key) const noexcept
+    {
+        if ((age != key.age) || (guid.Data1 != key.guid.Data1) || (guid.Data2 != key.guid.Data2) || (guid.Data3 != key.guid.Data3))
+        {
+            return false;
+        }
+
+        for (unsigned int i = 0; i < sizeof(guid.Data4); ++i)
+        {
+            if (guid.Data4[i] != key.guid.Data4[i])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool operator != (const SymbolKey& key) const noexcept
+    {
+        return !operator == (key);
+    }
+};
+
+static_assert(sizeof(SymbolKey) == 20, "Invalid size of SymbolKey");
+
+// Identity of the PDB as the symbol servers know it, built from the CodeView record without DbgHelp:
+struct PdbIdentity
+{
+    static constexpr unsigned int k_maxKeyLength = SymbolKey::k_maxLength;
+
+    CodeViewMagic magic;          // Zero if there is no PDB record
+    GUID guid;                    // PDB 7.0
+    unsigned int signature;       // PDB 2.0
+    unsigned int age;
+    const char* pdbPath;          // Points into the image, isn't null-terminated if the record is truncated
+    unsigned int pdbPathLength;
+    char key[k_maxKeyLength + 1]; // The symbol store layout is "name.pdb/key/name.pdb"
+
+public:
+    PdbIdentity() noexcept
+        : magic()
+        , guid()
+        , signature(0)
+        , age(0)
+        , pdbPath(nullptr)
+        , pdbPathLength(0)
+        , key()
+    {
+    }
+
+    // The size is SizeOfData of the debug entry:
+    PdbIdentity(const DebugInfo& info, const unsigned int size) noexcept : PdbIdentity()
+    {
+        unsigned int nameOffset = 0;
+        switch (info.magic)
+        {
+        case CodeViewMagic::pdb20:
+        {
+            nameOffset = offsetof(DebugInfoPdb20, pdbName);
+            if (size < nameOffset)
+            {
+                return;
+            }
+
+            signature = info.pdb20.signature;
+            age = info.pdb20.age;
+            pdbPath = info.pdb20.pdbName;
+            break;
+        }
+        case CodeViewMagic::pdb70:
+        {
+            nameOffset = offsetof(DebugInfoPdb70, pdbName);
+            if (size < nameOffset)
+            {
+                return;
+            }
+
+            guid = info.pdb70.guid;
+            age = info.pdb70.age;
+            pdbPath = info.pdb70.pdbName;
+            break;
+        }
+        default:
+        {
+            return;
+        }
+        }
+
+        magic = info.magic;
+        symbolKey().format(key);
+
+        while ((nameOffset + pdbPathLength < size) && pdbPath[pdbPathLength])
+        {
+            ++pdbPathLength;
+        }
+    }
+
+    bool valid() const noexcept
+    {
+        return (magic == CodeViewMagic::pdb20) || (magic == CodeViewMagic::pdb70);
+    }
+
+    SymbolKey symbolKey() const noexcept
+    {
+        switch (magic)
+        {
+        case CodeViewMagic::pdb20:
+        {
+            return SymbolKey(signature, age);
+        }
+        case CodeViewMagic::pdb70:
+        {
+            return SymbolKey(guid, age);
+        }
+        }
+
+        return SymbolKey();
+    }
+
+    // The last component of the path:
+    const char* pdbName() const noexcept
+    {
+        unsigned int pos = pdbPathLength;
+        while (pos && (pdbPath[pos - 1] != '\\') && (pdbPath[pos - 1] != '/'))
+        {
+            --pos;
+        }
+
+        return pdbPath + pos;
+    }
+
+    unsigned int pdbNameLength() const noexcept
+    {
+        return pdbPathLength - static_cast<unsigned int>(pdbName() - pdbPath);
+    }
+};
+
+} // namespace CodeView
+
+
+
+// Payloads of the debug entries emitted by link.exe besides CodeView:
+// https://github.com/llvm/llvm-project/blob/main/llvm/include/llvm/BinaryFormat/COFF.h
+namespace DebugData
+{
+
+enum Type : unsigned int
+{
+    vcFeature = 12,           // IMAGE_DEBUG_TYPE_VC_FEATURE
+    pogo = 13,                // IMAGE_DEBUG_TYPE_POGO
+    iltcg = 14,               // IMAGE_DEBUG_TYPE_ILTCG
+    repro = 16,               // IMAGE_DEBUG_TYPE_REPRO
+    exDllCharacteristics = 20 // IMAGE_DEBUG_TYPE_EX_DLLCHARACTERISTICS
+};
+
+// Numbers of object files compiled with the corresponding options:
+struct VcFeature
+{
+    unsigned int preVc11;
+    unsigned int cAndCpp;
+    unsigned int gs;
+    unsigned int sdl;
+    unsigned int guardN;
+};
+
+struct ExDllCharacteristics
+{
+    enum Flags : unsigned int
+    {
+        cetCompat = 0x01,
+        cetCompatStrictMode = 0x02,
+        cetSetContextIpValidationRelaxedMode = 0x04,
+        cetDynamicApisAllowInProc = 0x08,
+        forwardCfiCompat = 0x40,
+        hotpatchCompatible = 0x80,
+    };
+
+    unsigned int flags;
+};
+
+// Hash of the inputs for the deterministic (/Brepro) builds, empty if the linker didn't store it:
+class Repro
+{
+private:
+    const unsigned char* m_hash;
+    unsigned int m_size;
+
+public:
+    Repro() noexcept : m_hash(nullptr), m_size(0)
+    {
+    }
+
+    Repro(const void* const data, const unsigned int size) noexcept : Repro()
+    {
+        // unsigned int hashSize; unsigned char hash[hashSize];
+        if (!data || (size < sizeof(unsigned int)))
+        {
+            return;
+        }
+
+        const auto hashSize = *static_cast<const unsigned int*>(data);
+        if (hashSize > size - sizeof(unsigned int))
+        {
+            return;
+        }
+
+        m_hash = static_cast<const unsigned char*>(data) + sizeof(unsigned int);
+        m_size = hashSize;
+    }
+
+    const unsigned char* hash() const noexcept
+    {
+        return m_hash;
+    }
+
+    unsigned int size() const noexcept
+    {
+        return m_size;
+    }
+
+    bool empty() const noexcept
+    {
+        return m_size == 0;
+    }
+};
+
+//
+// Profile-guided optimization data: the signature followed by the contributions of COFF sections
+// to the image sections in the order of placement, so the ".text$mn", ".text$x" (cold), ".text$lp"
+// (loop) and others give the hot/cold layout of the code:
+//
+//     unsigned int signature;
+//     struct
+//     {
+//         Rva rva;
+//         unsigned int size;
+//         char name[]; // Null-terminated and padded to 4 bytes
+//     } records[];
+//
+class Pogo
+{
+public:
+    enum Signature : unsigned int
+    {
+        ltcg = 0x4C544347, // 'LTCG'
+        pgi = 0x50474900,  // 'PGI\0', instrumented build
+        pgo = 0x50474F00,  // 'PGO\0', optimized with the profile
+        pgu = 0x50475500,  // 'PGU\0', optimized with the profile collected for the older build
+    };
+
+    class RecordEntry
+    {
+    private:
+        static constexpr unsigned int k_header = sizeof(Rva) + sizeof(unsigned int);
+
+    private:
+        const unsigned char* m_data;
+        unsigned int m_size;
+        unsigned int m_offset;
+        unsigned int m_nameLength;
+
+    private:
+        void fetch() noexcept
+        {
+            if ((m_size < k_header) || (m_offset > m_size - k_header))
+            {
+                m_offset = m_size;
+                return;
+            }
+
+            const auto* const name = reinterpret_cast<const char*>(m_data + m_offset + k_header);
+            const unsigned int available = m_size - m_offset - k_header;
+            for (m_nameLength = 0; m_nameLength < available; ++m_nameLength)
+            {
+                if (!name[m_nameLength])
+                {
+                    return;
+                }
+            }
+
+            // Unterminated name:
+            m_offset = m_size;
+        }
+
+    public:
+        RecordEntry(const unsigned char* const data, const unsigned int size, const unsigned int offset) noexcept
+            : m_data(data)
+            , m_size(size)
+            , m_offset(offset)
+            , m_nameLength(0)
+        {
+            fetch();
+        }
+
+        Rva rva() const noexcept
+        {
+            return *reinterpret_cast<const Rva*>(m_data + m_offset);
+        }
+
+        unsigned int size() const noexcept
+        {
+            return *reinterpret_cast<const unsigned int*>(m_data + m_offset + sizeof(Rva));
+        }
+
+        const char* name() const noexcept
+        {
+            return reinterpret_cast<const char*>(m_data + m_offset + k_header);
+        }
+
+        unsigned int nameLength() const noexcept
+        {
+            return m_nameLength;
+        }
+
+        bool contains(const Rva rva) const noexcept
+        {
+            return (rva >= this->rva()) && (rva - this->rva() < size());
+        }
+
+        bool valid() const noexcept
+        {
+            return m_offset < m_size;
+        }
+
+        bool operator == (const RecordEntry& entry) const noexcept
+        {
+            return (m_data == entry.m_data) && (m_offset == entry.m_offset);
+        }
+
+        RecordEntry& operator ++ () noexcept
+        {
+            const unsigned int recordSize = (k_header + m_nameLength + 1 + 3) & ~3u;
+            m_offset = (recordSize < m_size - m_offset) ? m_offset + recordSize : m_size;
+            fetch();
+            return *this;
+        }
+    };
+
+    using RecordIterator = Iterator<RecordEntry>;
+
+private:
+    const unsigned char* m_data;
+    unsigned int m_size;
+
+public:
+    Pogo() noexcept : m_data(nullptr), m_size(0)
+    {
+    }
+
+    Pogo(const void* const data, const unsigned int size) noexcept
+        : m_data(static_cast<const unsigned char*>(data))
+        , m_size(data ? size : 0)
+    {
+    }
+
+    bool valid() const noexcept
+    {
+        return m_size >= sizeof(unsigned int);
+    }
+
+    unsigned int signature() const noexcept
+    {
+        return valid() ? *reinterpret_cast<const unsigned int*>(m_data) : 0;
+    }
+
+    RecordIterator begin() const noexcept
+    {
+        return RecordIterator(m_data, m_size, valid() ? static_cast<unsigned int>(sizeof(unsigned int)) : m_size);
+    }
+
+    RecordIterator end() const noexcept
+    {
+        return RecordIterator(m_data, m_size, m_size);
+    }
+};
+
+} // namespace DebugData
+
+
+
+template <Arch arch>
+class Debug
+{
+public:
+    class DebugEntry
+    {
+    private:
+        const typename DirDebug::Type* m_debugEntry;
+
+    public:
+        DebugEntry() noexcept = default;
+
+        explicit DebugEntry(const typename DirDebug::Type* const debugEntry) noexcept : m_debugEntry(debugEntry)
+        {
+        }
+
+        const typename DirDebug::Type* debugEntry() const noexcept
+        {
+            return m_debugEntry;
+        }
+
+        bool operator == (const DebugEntry& entry) const noexcept
+        {
+            return m_debugEntry == entry.m_debugEntry;
+        }
+
+        DebugEntry& operator ++ () noexcept
+        {
+            PE_COUNT(debugStep);
+            ++m_debugEntry;
+            return *this;
+        }
+
+        DebugEntry& operator += (const long long offset) noexcept
+        {
+            m_debugEntry += offset;
+            return *this;
+        }
+
+        long long operator - (const DebugEntry& entry) const noexcept
+        {
+            return m_debugEntry - entry.m_debugEntry;
+        }
+    };
+
+    using DebugIterator = RandomAccessIterator<DebugEntry>;
+
+private:
+    Pe<arch> m_pe;
+    DirectoryDescriptor<DirDebug> m_descriptor;
+
+public:
+    explicit Debug(const Pe<arch>& pe) noexcept
+        : m_pe(pe)
+        , m_descriptor(pe.directory<DirDebug>())
+    {
+    }
+
+    const DirectoryDescriptor<DirDebug>& debugTable() const noexcept
+    {
+        return m_descriptor;
+    }
+
+    bool valid() const noexcept
+    {
+        return m_descriptor.valid();
+    }
+
+    unsigned int count() const noexcept
+    {
+        if (!valid())
+        {
+            return 0;
+        }
+
+        return m_descriptor.size / sizeof(typename DirDebug::Type);
+    }
+
+    DebugIterator begin() const noexcept
+    {
+        return DebugIterator(DebugEntry(m_descriptor.ptr));
+    }
+
+    DebugIterator end() const noexcept
+    {
+        return DebugIterator(DebugEntry(m_descriptor.ptr + count()));
+    }
+
+    // The size receives SizeOfData of the found record:
+    const CodeView::DebugInfo* findPdbDebugInfo(unsigned int& size) const noexcept
+    {
+        for (const auto& entry : *this)
+        {
+            const auto* const debugEntry = entry.debugEntry();
+            if ((debugEntry->Type != IMAGE_DEBUG_TYPE_CODEVIEW) || (debugEntry->SizeOfData < sizeof(CodeView::CodeViewMagic)))
+            {
+                continue;
+            }
+
+            const auto* const codeView = static_cast<const CodeView::DebugInfo*>(data(debugEntry));
+            if (!codeView)
+            {
+                continue;
+            }
+
+            switch (codeView->magic)
+            {
+            case CodeView::CodeViewMagic::pdb20:
+            case CodeView::CodeViewMagic::pdb70:
+            {
+                size = debugEntry->SizeOfData;
+                return codeView;
+            }
+            }
+        }
+
+        return nullptr;
+    }
+
+    const CodeView::DebugInfo* findPdbDebugInfo() const noexcept
+    {
+        unsigned int size = 0;
+        return findPdbDebugInfo(size);
+    }
+
+    CodeView::PdbIdentity pdbIdentity() const noexcept
+    {
+        unsigned int size = 0;
+        const auto* const codeView = findPdbDebugInfo(size);
+        return codeView ? CodeView::PdbIdentity(*codeView, size) : CodeView::PdbIdentity();
+    }
+
+    const typename DirDebug::Type* find(const unsigned int type) const noexcept
+    {
+        for (const auto& entry : *this)
+        {
+            if (entry.debugEntry()->Type == type)
+            {
+                return entry.debugEntry();
+            }
+        }
+
+        return nullptr;
+    }
+
+    // The payload is referenced by AddressOfRawData in modules and by PointerToRawData in files,
+    // entries that aren't mapped into memory have zero AddressOfRawData:
+    const void* data(const typename DirDebug::Type* const entry) const noexcept
+    {
+        if (!entry || !entry->SizeOfData)
+        {
+            return nullptr;
+        }
+
+        const auto* const base = static_cast<const unsigned char*>(m_pe.headers().mod());
+        switch (m_pe.type())
+        {
+        case ImgType::file:
+        {
+            return entry->PointerToRawData ? base + entry->PointerToRawData : nullptr;
+        }
+        case ImgType::module:
+        {
+            return entry->AddressOfRawData ? base + entry->AddressOfRawData : nullptr;
+        }
+        }
+
+        return nullptr;
+    }
+
+    const void* data(const DebugEntry& entry) const noexcept
+    {
+        return data(entry.debugEntry());
+    }
+
+    DebugData::Pogo pogo() const noexcept
+    {
+        const auto* const entry = find(DebugData::pogo);
+        return entry ? DebugData::Pogo(data(entry), entry->SizeOfData) : DebugData::Pogo();
+    }
+
+    const DebugData::VcFeature* vcFeature() const noexcept
+    {
+        const auto* const entry = find(DebugData::vcFeature);
+        if (!entry || (entry->SizeOfData < sizeof(DebugData::VcFeature)))
+        {
+            return nullptr;
+        }
+
+        return static_cast<const DebugData::VcFeature*>(data(entry));
+    }
+
+    // The entry carries no data, its presence marks the incremental LTCG:
+    bool iltcg() const noexcept
+    {
+        return find(DebugData::iltcg) != nullptr;
+    }
+
+    bool reproducible() const noexcept
+    {
+        return find(DebugData::repro) != nullptr;
+    }
+
+    DebugData::Repro repro() const noexcept
+    {
+        const auto* const entry = find(DebugData::repro);
+        return entry ? DebugData::Repro(data(entry), entry->SizeOfData) : DebugData::Repro();
+    }
+
+    const DebugData::ExDllCharacteristics* exDllCharacteristics() const noexcept
+    {
+        const auto* const entry = find(DebugData::exDllCharacteristics);
+        if (!entry || (entry->SizeOfData < sizeof(DebugData::ExDllCharacteristics)))
+        {
+            return nullptr;
+        }
+
+        return static_cast<const DebugData::ExDllCharacteristics*>(data(entry));
+    }
+};
+
+
+
+// ECMA-335, Partition II, 24: "Metadata physical layout"
+namespace Cli
+{
+
+struct MetadataRoot
+{
+    static constexpr unsigned int k_signature = 0x424A5342u; // "BSJB"
+
+    unsigned int signature;
+    unsigned short majorVersion;
+    unsigned short minorVersion;
+    unsigned int reserved;
+    unsigned int versionLength; // Padded to 4 bytes
+    char version[1];
+};
+
+struct StreamHeader
+{
+    unsigned int offset; // Relative to the metadata root
+    unsigned int size;
+    char name[1]; // Null-terminated, padded to 4 bytes
+};
+
+struct TablesHeader
+{
+    unsigned int reserved0;
+    unsigned char majorVersion;
+    unsigned char minorVersion;
+    unsigned char heapSizes;
+    unsigned char reserved1;
+    unsigned long long valid;
+    unsigned long long sorted;
+    unsigned int rows[1]; // One entry for each bit set in 'valid'
+};
+
+enum class Table : unsigned char
+{
+    module,
+    typeRef,
+    typeDef,
+    fieldPtr,
+    field,
+    methodPtr,
+    methodDef,
+    paramPtr,
+    param,
+    interfaceImpl,
+    memberRef,
+    constant,
+    customAttribute,
+    fieldMarshal,
+    declSecurity,
+    classLayout,
+    fieldLayout,
+    standAloneSig,
+    eventMap,
+    eventPtr,
+    event,
+    propertyMap,
+    propertyPtr,
+    property,
+    methodSemantics,
+    methodImpl,
+    moduleRef,
+    typeSpec,
+    implMap,
+    fieldRva,
+    encLog,
+    encMap,
+    assembly,
+    assemblyProcessor,
+    assemblyOs,
+    assemblyRef,
+    assemblyRefProcessor,
+    assemblyRefOs,
+    file,
+    exportedType,
+    manifestResource,
+    nestedClass,
+    genericParam,
+    methodSpec,
+    genericParamConstraint,
+    count, // Also used as "not used" tag in coded indices
+};
+
+enum class CodedIndex : unsigned char
+{
+    typeDefOrRef,
+    hasConstant,
+    hasCustomAttribute,
+    hasFieldMarshal,
+    hasDeclSecurity,
+    memberRefParent,
+    hasSemantics,
+    methodDefOrRef,
+    memberForwarded,
+    implementation,
+    customAttributeType,
+    resolutionScope,
+    typeOrMethodDef,
+    count
+};
+
+// Reference to a row of a metadata table, the row id is 1-based (0 is a null reference):
+struct Token
+{
+    Table table;
+    unsigned int rid;
+
+    bool valid() const noexcept
+    {
+        return (table < Table::count) && (rid != 0);
+    }
+};
+
+struct Blob
+{
+    const unsigned char* data;
+    unsigned int size;
+};
+
+struct UserString
+{
+    const char16_t* str; // Not null-terminated
+    unsigned int length; // In characters
+};
+
+struct Schema
+{
+    // Column kinds: values below k_coded are simple indices into the table with the same number:
+    static constexpr unsigned char k_coded = 0x40; // k_coded + CodedIndex
+    static constexpr unsigned char k_u16 = 0x80;
+    static constexpr unsigned char k_u32 = 0x81;
+    static constexpr unsigned char k_string = 0x82;
+    static constexpr unsigned char k_guid = 0x83;
+    static constexpr unsigned char k_blob = 0x84;
+    static constexpr unsigned char k_end = 0xFF;
+
+    static constexpr unsigned int k_maxColumns = 9;
+
+    static constexpr unsigned char t(const Table table) noexcept
+    {
+        return static_cast<unsigned char>(table);
+    }
+
+    static constexpr unsigned char c(const CodedIndex index) noexcept
+    {
+        return static_cast<unsigned char>(k_coded + static_cast<unsigned char>(index));
+    }
+
+    static const unsigned char* columns(const Table table) noexcept
+    {
+        // ECMA-335, Partition II, 22: "Metadata logical format: tables"
+        static const unsigned char k_columns[static_cast<unsigned int>(Table::count)][k_maxColumns + 1] =
+        {
+            /* Module                 */ { k_u16, k_string, k_guid, k_guid, k_guid, k_end },
+            /* TypeRef                */ { c(CodedIndex::resolutionScope), k_string, k_string, k_end },
+            /* TypeDef                */ { k_u32, k_string, k_string, c(CodedIndex::typeDefOrRef), t(Table::field), t(Table::methodDef), k_end },
+            /* FieldPtr               */ { t(Table::field), k_end },
+            /* Field                  */ { k_u16, k_string, k_blob, k_end },
+            /* MethodPtr              */ { t(Table::methodDef), k_end },
+            /* MethodDef              */ { k_u32, k_u16, k_u16, k_string, k_blob, t(Table::param), k_end },
+            /* ParamPtr               */ { t(Table::param), k_end },
+            /* Param                  */ { k_u16, k_u16, k_string, k_end },
+            /* InterfaceImpl          */ { t(Table::typeDef), c(CodedIndex::typeDefOrRef), k_end },
+            /* MemberRef              */ { c(CodedIndex::memberRefParent), k_string, k_blob, k_end },
+            /* Constant               */ { k_u16, c(CodedIndex::hasConstant), k_blob, k_end }, // Type + padding byte
+            /* CustomAttribute        */ { c(CodedIndex::hasCustomAttribute), c(CodedIndex::customAttributeType), k_blob, k_end },
+            /* FieldMarshal           */ { c(CodedIndex::hasFieldMarshal), k_blob, k_end },
+            /* DeclSecurity           */ { k_u16, c(CodedIndex::hasDeclSecurity), k_blob, k_end },
+            /* ClassLayout            */ { k_u16, k_u32, t(Table::typeDef), k_end },
+            /* FieldLayout            */ { k_u32, t(Table::field), k_end },
+            /* StandAloneSig          */ { k_blob, k_end },
+            /* EventMap               */ { t(Table::typeDef), t(Table::event), k_end },
+            /* EventPtr               */ { t(Table::event), k_end },
+            /* Event                  */ { k_u16, k_string, c(CodedIndex::typeDefOrRef), k_end },
+            /* PropertyMap            */ { t(Table::typeDef), t(Table::property), k_end },
+            /* PropertyPtr            */ { t(Table::property), k_end },
+            /* Property               */ { k_u16, k_string, k_blob, k_end },
+            /* MethodSemantics        */ { k_u16, t(Table::methodDef), c(CodedIndex::hasSemantics), k_end },
+            /* MethodImpl             */ { t(Table::typeDef), c(CodedIndex::methodDefOrRef), c(CodedIndex::methodDefOrRef), k_end },
+            /* ModuleRef              */ { k_string, k_end },
+            /* TypeSpec               */ { k_blob, k_end },
+            /* ImplMap                */ { k_u16, c(CodedIndex::memberForwarded), k_string, t(Table::moduleRef), k_end },
+            /* FieldRVA               */ { k_u32, t(Table::field), k_end },
+            /* EncLog                 */ { k_u32, k_u32, k_end },
+            /* EncMap                 */ { k_u32, k_end },
+            /* Assembly               */ { k_u32, k_u16, k_u16, k_u16, k_u16, k_u32, k_blob, k_string, k_string, k_end },
+            /* AssemblyProcessor      */ { k_u32, k_end },
+            /* AssemblyOS             */ { k_u32, k_u32, k_u32, k_end },
+            /* AssemblyRef            */ { k_u16, k_u16, k_u16, k_u16, k_u32, k_blob, k_string, k_string, k_blob, k_end },
+            /* AssemblyRefProcessor   */ { k_u32, t(Table::assemblyRef), k_end },
+            /* AssemblyRefOS          */ { k_u32, k_u32, k_u32, t(Table::assemblyRef), k_end },
+            /* File                   */ { k_u32, k_string, k_blob, k_end },
+            /* ExportedType           */ { k_u32, k_u32, k_string, k_string, c(CodedIndex::implementation), k_end },
+            /* ManifestResource       */ { k_u32, k_u32, k_string, c(CodedIndex::implementation), k_end },
+            /* NestedClass            */ { t(Table::typeDef), t(Table::typeDef), k_end },
+            /* GenericParam           */ { k_u16, k_u16, c(CodedIndex::typeOrMethodDef), k_string, k_end },
+            /* MethodSpec             */ { c(CodedIndex::methodDefOrRef), k_blob, k_end },
+            /* GenericParamConstraint */ { t(Table::genericParam), c(CodedIndex::typeDefOrRef), k_end },
+        };
+
+        return k_columns[static_cast<unsigned int>(table)];
+    }
+
+    struct CodedIndexInfo
+    {
+        unsigned char tagBits;
+        unsigned char tablesCount;
+        Table tables[22];
+    };
+
+    static const CodedIndexInfo& codedIndex(const CodedIndex index) noexcept
+    {
+        constexpr auto k_unused = Table::count;
+
+        // ECMA-335, Partition II, 24.2.6: "#~ stream":
+        static const CodedIndexInfo k_codedIndices[static_cast<unsigned int>(CodedIndex::count)] =
+        {
+            /* TypeDefOrRef        */ { 2, 3, { Table::typeDef, Table::typeRef, Table::typeSpec } },
+            /* HasConstant         */ { 2, 3, { Table::field, Table::param, Table::property } },
+            /* HasCustomAttribute  */ { 5, 22, {
+                Table::methodDef, Table::field, Table::typeRef, Table::typeDef, Table::param, Table::interfaceImpl,
+                Table::memberRef, Table::module, Table::declSecurity, Table::property, Table::event, Table::standAloneSig,
+                Table::moduleRef, Table::typeSpec, Table::assembly, Table::assemblyRef, Table::file, Table::exportedType,
+                Table::manifestResource, Table::genericParam, Table::genericParamConstraint, Table::methodSpec
+            } },
+            /* HasFieldMarshal     */ { 1, 2, { Table::field, Table::param } },
+            /* HasDeclSecurity     */ { 2, 3, { Table::typeDef, Table::methodDef, Table::assembly } },
+            /* MemberRefParent     */ { 3, 5, { Table::typeDef, Table::typeRef, Table::moduleRef, Table::methodDef, Table::typeSpec } },
+            /* HasSemantics        */ { 1, 2, { Table::event, Table::property } },
+            /* MethodDefOrRef      */ { 1, 2, { Table::methodDef, Table::memberRef } },
+            /* MemberForwarded     */ { 1, 2, { Table::field, Table::methodDef } },
+            /* Implementation      */ { 2, 3, { Table::file, Table::assemblyRef, Table::exportedType } },
+            /* CustomAttributeType */ { 3, 5, { k_unused, k_unused, Table::methodDef, Table::memberRef, k_unused } },
+            /* ResolutionScope     */ { 2, 4, { Table::module, Table::moduleRef, Table::assemblyRef, Table::typeRef } },
+            /* TypeOrMethodDef     */ { 1, 2, { Table::typeDef, Table::methodDef } },
+        };
+
+        return k_codedIndices[static_cast<unsigned int>(index)];
+    }
+};
+
+} // namespace Cli
+
+
+
+template <Arch arch>
+class Clr
+{
+public:
+    struct Stream
+    {
+        const unsigned char* data;
+        unsigned int size;
+
+        bool valid() const noexcept
+        {
+            return data != nullptr;
+        }
+    };
+
+    struct Streams
+    {
+        Stream tables;  // "#~" or "#-"
+        Stream strings; // "#Strings"
+        Stream userStrings; // "#US"
+        Stream guids;   // "#GUID"
+        Stream blobs;   // "#Blob"
+    };
+
+    class TableInfo
+    {
+        friend Clr;
+
+    private:
+        const unsigned char* m_rows;
+        unsigned int m_count;
+        unsigned char m_columnOffsets[Cli::Schema::k_maxColumns + 1]; // The last one is the row size
+
+    public:
+        const unsigned char* rows() const noexcept
+        {
+            return m_rows;
+        }
+
+        unsigned int count() const noexcept
+        {
+            return m_count;
+        }
+
+        unsigned int rowSize() const noexcept
+        {
+            return m_columnOffsets[Cli::Schema::k_maxColumns];
+        }
+
+        unsigned int columnOffset(const unsigned int column) const noexcept
+        {
+            return m_columnOffsets[column];
+        }
+
+        unsigned int columnSize(const unsigned int column) const noexcept
+        {
+            return m_columnOffsets[column + 1] - m_columnOffsets[column];
+        }
+    };
+
+    // The table layout and the heaps that its rows refer to, taken by value,
+    // so the rows stay usable after the Clr is gone, e.g. in "for (const auto& t : pe.clr().typeDefs())":
+    struct TableView
+    {
+        TableInfo info; // Without rows if the metadata is invalid
+        Stream strings;
+        Stream blobs;
+    };
+
+    // Row accessors are views over the table stream: nothing is copied or materialized:
+    template <Cli::Table tableId>
+    class RowEntry
+    {
+    protected:
+        TableView m_view;
+        unsigned int m_index;
+
+    protected:
+        unsigned int column(const unsigned int col) const noexcept
+        {
+            return Clr::value(m_view.info, m_index, col);
+        }
+
+    public:
+        RowEntry(const TableView& view, const unsigned int index) noexcept : m_view(view), m_index(index)
+        {
+        }
+
+        unsigned int index() const noexcept
+        {
+            return m_index;
+        }
+
+        Cli::Token token() const noexcept
+        {
+            return Cli::Token{ tableId, m_index + 1 };
+        }
+
+        const unsigned char* row() const noexcept
+        {
+            return Clr::row(m_view.info, m_index);
+        }
+
+        bool valid() const noexcept
+        {
+            return m_index < m_view.info.count();
+        }
+
+        bool operator == (const RowEntry& entry) const noexcept
+        {
+            return m_index == entry.m_index;
+        }
+
+        RowEntry& operator ++ () noexcept
+        {
+            PE_COUNT(clrRowStep);
+            ++m_index;
+            return *this;
+        }
+    };
+
+    class TypeDefEntry : public RowEntry<Cli::Table::typeDef>
+    {
+    public:
+        using RowEntry<Cli::Table::typeDef>::RowEntry;
+
+        unsigned int flags() const noexcept
+        {
+            return this->column(0);
+        }
+
+        const char* name() const noexcept
+        {
+            return Clr::string(this->m_view.strings, this->column(1));
+        }
+
+        const char* namespaceName() const noexcept
+        {
+            return Clr::string(this->m_view.strings, this->column(2));
+        }
+
+        Cli::Token extends() const noexcept
+        {
+            return Clr::decode(Cli::CodedIndex::typeDefOrRef, this->column(3));
+        }
+
+        unsigned int fieldList() const noexcept // Row id in the Field table
+        {
+            return this->column(4);
+        }
+
+        unsigned int methodList() const noexcept // Row id in the MethodDef table
+        {
+            return this->column(5);
+        }
+    };
+
+    class MethodDefEntry : public RowEntry<Cli::Table::methodDef>
+    {
+    public:
+        using RowEntry<Cli::Table::methodDef>::RowEntry;
+
+        Rva rva() const noexcept
+        {
+            return this->column(0);
+        }
+
+        unsigned short implFlags() const noexcept
+        {
+            return static_cast<unsigned short>(this->column(1));
+        }
+
+        unsigned short flags() const noexcept
+        {
+            return static_cast<unsigned short>(this->column(2));
+        }
+
+        const char* name() const noexcept
+        {
+            return Clr::string(this->m_view.strings, this->column(3));
+        }
+
+        Cli::Blob signature() const noexcept
+        {
+            return Clr::blob(this->m_view.blobs, this->column(4));
+        }
+
+        unsigned int paramList() const noexcept // Row id in the Param table
+        {
+            return this->column(5);
+        }
+    };
+
+    class MemberRefEntry : public RowEntry<Cli::Table::memberRef>
+    {
+    public:
+        using RowEntry<Cli::Table::memberRef>::RowEntry;
+
+        Cli::Token parent() const noexcept
+        {
+            return Clr::decode(Cli::CodedIndex::memberRefParent, this->column(0));
+        }
+
+        const char* name() const noexcept
+        {
+            return Clr::string(this->m_view.strings, this->column(1));
+        }
+
+        Cli::Blob signature() const noexcept
+        {
+            return Clr::blob(this->m_view.blobs, this->column(2));
+        }
+    };
+
+    template <typename Entry>
+    class Rows
+    {
+    private:
+        TableView m_view;
+
+    public:
+        explicit Rows(const TableView& view) noexcept : m_view(view)
+        {
+        }
+
+        unsigned int count() const noexcept
+        {
+            return m_view.info.count();
+        }
+
+        bool empty() const noexcept
+        {
+            return !count();
+        }
+
+        Entry operator [] (const unsigned int index) const noexcept
+        {
+            return Entry(m_view, index);
+        }
+
+        Iterator<Entry> begin() const noexcept
+        {
+            return Iterator<Entry>(m_view, 0u);
+        }
+
+        Iterator<Entry> end() const noexcept
+        {
+            return Iterator<Entry>(m_view, count());
+        }
+    };
+
+private:
+    static constexpr unsigned int k_tablesCount = static_cast<unsigned int>(Cli::Table::count);
+    static constexpr unsigned int k_codedIndicesCount = static_cast<unsigned int>(Cli::CodedIndex::count);
+
+    static constexpr unsigned char k_heapStringsWide = 0x01;
+    static constexpr unsigned char k_heapGuidsWide = 0x02;
+    static constexpr unsigned char k_heapBlobsWide = 0x04;
+    static constexpr unsigned char k_heapExtraData = 0x40;
+
+private:
+    Pe<arch> m_pe;
+    DirectoryDescriptor<DirClr> m_descriptor;
+    const Cli::MetadataRoot* m_root;
+    Streams m_streams;
+    TableInfo m_tables[k_tablesCount];
+    bool m_valid;
+
+private:
+    static unsigned int readUnaligned(const unsigned char* const ptr, const unsigned int size) noexcept
+    {
+        switch (size)
+        {
+        case 1: return ptr[0];
+        case 2: return static_cast<unsigned int>(ptr[0]) | (static_cast<unsigned int>(ptr[1]) << 8u);
+        case 4: return static_cast<unsigned int>(ptr[0]) | (static_cast<unsigned int>(ptr[1]) << 8u) | (static_cast<unsigned int>(ptr[2]) << 16u) | (static_cast<unsigned int>(ptr[3]) << 24u);
+        default:
+            return 0;
+        }
     }
 
-    DebugIterator begin() const noexcept
+    static bool streamNameEquals(const char* const name, const char* const expected, const unsigned int maxLength) noexcept
     {
-        return DebugEntry(m_descriptor.ptr);
+        for (unsigned int i = 0; i < maxLength; ++i)
+        {
+            if (name[i] != expected[i])
+            {
+                return false;
+            }
+
+            if (!name[i])
+            {
+                return true;
+            }
+        }
+
+        return false;
     }
 
-    DebugIterator end() const noexcept
+    unsigned int codedIndexSize(const Cli::CodedIndex index) const noexcept
     {
-        return DebugEntry(m_descriptor.ptr + count());
+        const auto& info = Cli::Schema::codedIndex(index);
+        unsigned int maxRows = 0;
+        for (unsigned int i = 0; i < info.tablesCount; ++i)
+        {
+            if (info.tables[i] == Cli::Table::count)
+            {
+                continue;
+            }
+
+            const auto rows = m_tables[static_cast<unsigned int>(info.tables[i])].m_count;
+            maxRows = (rows > maxRows) ? rows : maxRows;
+        }
+
+        return (maxRows < (1u << (16u - info.tagBits))) ? 2u : 4u;
     }
 
-    const CodeView::DebugInfo* findPdbDebugInfo() const noexcept
+    bool parseStreams() noexcept
     {
-        for (const auto& entry : *this)
+        const auto metadataSize = m_descriptor.ptr->MetaData.Size;
+        if (metadataSize < sizeof(Cli::MetadataRoot))
+        {
+            return false;
+        }
+
+        const auto* const base = reinterpret_cast<const unsigned char*>(m_root);
+        unsigned int pos = offsetof(Cli::MetadataRoot, version) + m_root->versionLength;
+
+        // Flags (2 bytes) and the streams count (2 bytes):
+        if ((m_root->versionLength > metadataSize) || (pos + 2 * sizeof(unsigned short) > metadataSize))
+        {
+            return false;
+        }
+
+        const unsigned int streamsCount = readUnaligned(base + pos + sizeof(unsigned short), sizeof(unsigned short));
+        pos += 2 * sizeof(unsigned short);
+
+        constexpr unsigned int k_maxStreamName = 32;
+
+        for (unsigned int i = 0; i < streamsCount; ++i)
+        {
+            if (pos + offsetof(Cli::StreamHeader, name) + sizeof(unsigned int) > metadataSize)
+            {
+                return false;
+            }
+
+            const auto* const header = reinterpret_cast<const Cli::StreamHeader*>(base + pos);
+            if ((header->offset > metadataSize) || (header->size > metadataSize - header->offset))
+            {
+                return false;
+            }
+
+            const auto maxNameLength = metadataSize - pos - static_cast<unsigned int>(offsetof(Cli::StreamHeader, name));
+            const auto nameLimit = (maxNameLength < k_maxStreamName) ? maxNameLength : k_maxStreamName;
+
+            unsigned int nameLength = 0;
+            while ((nameLength < nameLimit) && header->name[nameLength])
+            {
+                ++nameLength;
+            }
+
+            if (nameLength == nameLimit)
+            {
+                return false;
+            }
+
+            const Stream stream{ base + header->offset, header->size };
+            if (streamNameEquals(header->name, "#~", nameLimit) || streamNameEquals(header->name, "#-", nameLimit))
+            {
+                m_streams.tables = stream;
+            }
+            else if (streamNameEquals(header->name, "#Strings", nameLimit))
+            {
+                // string() returns pointers into the heap, so the last string must end inside it:
+                if (stream.size && !stream.data[stream.size - 1])
+                {
+                    m_streams.strings = stream;
+                }
+            }
+            else if (streamNameEquals(header->name, "#US", nameLimit))
+            {
+                m_streams.userStrings = stream;
+            }
+            else if (streamNameEquals(header->name, "#GUID", nameLimit))
+            {
+                m_streams.guids = stream;
+            }
+            else if (streamNameEquals(header->name, "#Blob", nameLimit))
+            {
+                m_streams.blobs = stream;
+            }
+
+            pos += static_cast<unsigned int>(offsetof(Cli::StreamHeader, name)) + Align::alignUp(nameLength + 1, 4u);
+        }
+
+        return m_streams.tables.valid();
+    }
+
+    bool parseTables() noexcept
+    {
+        const auto& stream = m_streams.tables;
+        if (stream.size < offsetof(Cli::TablesHeader, rows))
+        {
+            return false;
+        }
+
+        const auto* const header = reinterpret_cast<const Cli::TablesHeader*>(stream.data);
+
+        unsigned int pos = offsetof(Cli::TablesHeader, rows);
+        for (unsigned int i = 0; i < 64; ++i)
         {
-            if (entry.debugEntry()->Type != IMAGE_DEBUG_TYPE_CODEVIEW)
+            if (!(header->valid & (1ull << i)))
             {
                 continue;
             }
 
-            const auto* const codeView = m_pe.byRva<CodeView::DebugInfo>(entry.debugEntry()->PointerToRawData);
-            switch (codeView->magic)
+            if (pos + sizeof(unsigned int) > stream.size)
             {
-            case CodeView::CodeViewMagic::pdb20:
-            case CodeView::CodeViewMagic::pdb70:
+                return false;
+            }
+
+            const auto rows = readUnaligned(stream.data + pos, sizeof(unsigned int));
+            pos += sizeof(unsigned int);
+
+            if (i < k_tablesCount)
             {
-                return codeView;
+                m_tables[i].m_count = rows;
             }
+            else if (rows)
+            {
+                return false; // Unknown table: we can't find out where the next ones begin
             }
         }
 
-        return nullptr;
+        if (header->heapSizes & k_heapExtraData)
+        {
+            pos += sizeof(unsigned int);
+        }
+
+        const unsigned int stringIndexSize = (header->heapSizes & k_heapStringsWide) ? 4 : 2;
+        const unsigned int guidIndexSize = (header->heapSizes & k_heapGuidsWide) ? 4 : 2;
+        const unsigned int blobIndexSize = (header->heapSizes & k_heapBlobsWide) ? 4 : 2;
+
+        unsigned int codedIndexSizes[k_codedIndicesCount]{};
+        for (unsigned int i = 0; i < k_codedIndicesCount; ++i)
+        {
+            codedIndexSizes[i] = codedIndexSize(static_cast<Cli::CodedIndex>(i));
+        }
+
+        for (unsigned int i = 0; i < k_tablesCount; ++i)
+        {
+            auto& table = m_tables[i];
+            const unsigned char* const columns = Cli::Schema::columns(static_cast<Cli::Table>(i));
+
+            unsigned int offset = 0;
+            unsigned int col = 0;
+            for (; columns[col] != Cli::Schema::k_end; ++col)
+            {
+                table.m_columnOffsets[col] = static_cast<unsigned char>(offset);
+
+                const unsigned char kind = columns[col];
+                switch (kind)
+                {
+                case Cli::Schema::k_u16   : offset += 2; break;
+                case Cli::Schema::k_u32   : offset += 4; break;
+                case Cli::Schema::k_string: offset += stringIndexSize; break;
+                case Cli::Schema::k_guid  : offset += guidIndexSize; break;
+                case Cli::Schema::k_blob  : offset += blobIndexSize; break;
+                default:
+                {
+                    if (kind >= Cli::Schema::k_coded)
+                    {
+                        offset += codedIndexSizes[kind - Cli::Schema::k_coded];
+                    }
+                    else
+                    {
+                        offset += (m_tables[kind].m_count < 0x10000u) ? 2 : 4;
+                    }
+                    break;
+                }
+                }
+            }
+
+            for (; col <= Cli::Schema::k_maxColumns; ++col)
+            {
+                table.m_columnOffsets[col] = static_cast<unsigned char>(offset);
+            }
+
+            const unsigned long long tableSize = static_cast<unsigned long long>(offset) * table.m_count;
+            if (pos + tableSize > stream.size)
+            {
+                return false;
+            }
+
+            table.m_rows = stream.data + pos;
+            pos += static_cast<unsigned int>(tableSize);
+        }
+
+        return true;
+    }
+
+public:
+    explicit Clr(const Pe<arch>& pe) noexcept
+        : m_pe(pe)
+        , m_descriptor(pe.template directory<DirClr>())
+        , m_root(nullptr)
+        , m_streams{}
+        , m_tables{}
+        , m_valid(false)
+    {
+        if (!m_descriptor.valid() || (m_descriptor.size < sizeof(typename DirClr::Type)))
+        {
+            return;
+        }
+
+        m_root = pe.template byRva<Cli::MetadataRoot>(m_descriptor.ptr->MetaData.VirtualAddress);
+        if (!m_root || (m_root->signature != Cli::MetadataRoot::k_signature))
+        {
+            return;
+        }
+
+        m_valid = parseStreams() && parseTables();
+    }
+
+    const Pe<arch>& pe() const noexcept
+    {
+        return m_pe;
+    }
+
+    const DirectoryDescriptor<DirClr>& descriptor() const noexcept
+    {
+        return m_descriptor;
+    }
+
+    const Cli::MetadataRoot* metadataRoot() const noexcept
+    {
+        return m_root;
+    }
+
+    const Streams& streams() const noexcept
+    {
+        return m_streams;
+    }
+
+    bool valid() const noexcept
+    {
+        return m_valid;
+    }
+
+    const char* runtimeVersion() const noexcept
+    {
+        return m_root ? m_root->version : nullptr;
+    }
+
+    const TableInfo& table(const Cli::Table table) const noexcept
+    {
+        return m_tables[static_cast<unsigned int>(table)];
+    }
+
+    // Zero if the metadata is invalid: the counts may be parsed while the rows aren't located:
+    unsigned int count(const Cli::Table table) const noexcept
+    {
+        return (m_valid && (table < Cli::Table::count)) ? m_tables[static_cast<unsigned int>(table)].m_count : 0;
+    }
+
+    // Rows and heaps of the table by value, empty if the metadata is invalid:
+    TableView view(const Cli::Table table) const noexcept
+    {
+        if (!count(table))
+        {
+            return TableView{};
+        }
+
+        return TableView{ m_tables[static_cast<unsigned int>(table)], m_streams.strings, m_streams.blobs };
+    }
+
+    // Zero-based row index:
+    static const unsigned char* row(const TableInfo& info, const unsigned int index) noexcept
+    {
+        if (!info.m_rows || (index >= info.m_count))
+        {
+            return nullptr;
+        }
+
+        return info.m_rows + static_cast<size_t>(index) * info.rowSize();
+    }
+
+    const unsigned char* row(const Cli::Table table, const unsigned int index) const noexcept
+    {
+        if (index >= count(table))
+        {
+            return nullptr;
+        }
+
+        return row(m_tables[static_cast<unsigned int>(table)], index);
+    }
+
+    static unsigned int value(const TableInfo& info, const unsigned int index, const unsigned int column) noexcept
+    {
+        const auto* const ptr = row(info, index);
+        if (!ptr || (column >= Cli::Schema::k_maxColumns))
+        {
+            return 0;
+        }
+
+        return readUnaligned(ptr + info.columnOffset(column), info.columnSize(column));
+    }
+
+    unsigned int value(const Cli::Table table, const unsigned int index, const unsigned int column) const noexcept
+    {
+        if (index >= count(table))
+        {
+            return 0;
+        }
+
+        return value(m_tables[static_cast<unsigned int>(table)], index, column);
+    }
+
+    static Cli::Token decode(const Cli::CodedIndex index, const unsigned int value) noexcept
+    {
+        const auto& info = Cli::Schema::codedIndex(index);
+        const unsigned int tag = value & ((1u << info.tagBits) - 1u);
+        if (tag >= info.tablesCount)
+        {
+            return Cli::Token{ Cli::Table::count, 0 };
+        }
+
+        return Cli::Token{ info.tables[tag], value >> info.tagBits };
+    }
+
+    static const char* string(const Stream& heap, const unsigned int index) noexcept
+    {
+        if (index >= heap.size)
+        {
+            return nullptr;
+        }
+
+        return reinterpret_cast<const char*>(heap.data + index);
+    }
+
+    const char* string(const unsigned int index) const noexcept
+    {
+        return string(m_streams.strings, index);
+    }
+
+    const GUID* guid(const unsigned int index) const noexcept // 1-based
+    {
+        if (!index || (index > m_streams.guids.size / sizeof(GUID)))
+        {
+            return nullptr;
+        }
+
+        return reinterpret_cast<const GUID*>(m_streams.guids.data) + (index - 1);
+    }
+
+    static Cli::Blob blob(const Stream& heap, const unsigned int index) noexcept
+    {
+        if (index >= heap.size)
+        {
+            return {};
+        }
+
+        // ECMA-335, Partition II, 24.2.4: compressed length prefix:
+        const unsigned char* const ptr = heap.data + index;
+        const unsigned int available = heap.size - index;
+        unsigned int prefix = 0;
+        unsigned int length = 0;
+        if ((ptr[0] & 0x80u) == 0)
+        {
+            prefix = 1;
+            length = ptr[0];
+        }
+        else if (((ptr[0] & 0xC0u) == 0x80u) && (available >= 2))
+        {
+            prefix = 2;
+            length = ((ptr[0] & 0x3Fu) << 8u) | ptr[1];
+        }
+        else if (((ptr[0] & 0xE0u) == 0xC0u) && (available >= 4))
+        {
+            prefix = 4;
+            length = ((ptr[0] & 0x1Fu) << 24u) | (ptr[1] << 16u) | (ptr[2] << 8u) | ptr[3];
+        }
+        else
+        {
+            return {};
+        }
+
+        if (length > available - prefix)
+        {
+            return {};
+        }
+
+        return Cli::Blob{ ptr + prefix, length };
+    }
+
+    Cli::Blob blob(const unsigned int index) const noexcept
+    {
+        return blob(m_streams.blobs, index);
+    }
+
+    Cli::UserString userString(const unsigned int index) const noexcept
+    {
+        const auto data = blob(m_streams.userStrings, index);
+        if (!data.data)
+        {
+            return {};
+        }
+
+        // The trailing byte is a flag that isn't a part of the string:
+        return Cli::UserString{ reinterpret_cast<const char16_t*>(data.data), data.size / sizeof(char16_t) };
+    }
+
+    TypeDefEntry typeDef(const unsigned int index) const noexcept
+    {
+        return TypeDefEntry(view(Cli::Table::typeDef), index);
+    }
+
+    MethodDefEntry methodDef(const unsigned int index) const noexcept
+    {
+        return MethodDefEntry(view(Cli::Table::methodDef), index);
+    }
+
+    MemberRefEntry memberRef(const unsigned int index) const noexcept
+    {
+        return MemberRefEntry(view(Cli::Table::memberRef), index);
+    }
+
+    Rows<TypeDefEntry> typeDefs() const noexcept
+    {
+        return Rows<TypeDefEntry>(view(Cli::Table::typeDef));
+    }
+
+    Rows<MethodDefEntry> methodDefs() const noexcept
+    {
+        return Rows<MethodDefEntry>(view(Cli::Table::methodDef));
+    }
+
+    Rows<MemberRefEntry> memberRefs() const noexcept
+    {
+        return Rows<MemberRefEntry>(view(Cli::Table::memberRef));
     }
 };
 
@@ -2238,6 +4569,12 @@ inline Debug<arch> Pe<arch>::debug() const noexcept
     return Debug<arch>(*this);
 }
 
+template <Arch arch>
+inline Clr<arch> Pe<arch>::clr() const noexcept
+{
+    return Clr<arch>(*this);
+}
+
 
 
 } // namespace Pe
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+//
+// SSE2 is a part of the x64 baseline and is enabled for x86 by /arch:SSE2 (default for MSVC) or -msse2.
+// Define PE_NO_SIMD to force the scalar code paths.
+//
+
+#if !defined(PE_NO_SIMD) && (defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || defined(__SSE2__))
+    #define PE_SIMD_SSE2
+    #include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+
+
+namespace Pe
+{
+namespace Simd
+{
+
+
+
+#ifdef PE_SIMD_SSE2
+constexpr bool k_sse2 = true;
+constexpr unsigned int k_width = sizeof(__m128i);
+#else
+constexpr bool k_sse2 = false;
+constexpr unsigned int k_width = 16;
+#endif
+
+// Index of the lowest set bit, the mask must be non-zero:
+inline unsigned int lowestBit(const unsigned int mask) noexcept
+{
+#ifdef _MSC_VER
+    unsigned long index = 0;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned int>(index);
+#else
+    return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+}
+
+// Calls the handler for each set bit of the mask from the lowest to the highest:
+template <typename Handler>
+inline void forEachBit(unsigned int mask, Handler&& handler)
+{
+    while (mask)
+    {
+        handler(lowestBit(mask));
+        mask &= mask - 1;
+    }
+}
+
+
+
+} // namespace Simd
+} // namespace Pe
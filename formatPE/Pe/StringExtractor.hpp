@@ -0,0 +1,284 @@
+#pragma once
+
+#include "Pe.hpp"
+#include "Simd.hpp"
+
+#include <vector>
+
+
+
+namespace Pe
+{
+
+
+
+//
+// "strings"-like extraction of printable ASCII and UTF-16LE runs from sections.
+// Printable characters are 0x20..0x7E and the tab.
+// Bytes are classified 16 at a time with SSE2 and runs are tracked on the resulting bitmasks,
+// the results point to the image, nothing is copied.
+// UTF-16LE strings are looked up at even RVAs only.
+//
+
+class StringExtractor
+{
+public:
+    enum class Encoding : unsigned char
+    {
+        ascii,
+        utf16le
+    };
+
+    struct Entry
+    {
+        Rva rva;
+        unsigned int length;  // In characters
+        unsigned int section; // Index of the section
+        Encoding encoding;
+        const void* data;     // Points to the section data, not null-terminated
+    };
+
+private:
+    static constexpr unsigned int k_blockUnits = 16; // Characters per classification block
+
+    unsigned int m_minLength;
+    bool m_ascii;
+    bool m_utf16;
+
+private:
+    static bool printable(const unsigned int unit) noexcept
+    {
+        return ((unit >= 0x20) && (unit <= 0x7E)) || (unit == '\t');
+    }
+
+    // Tracks runs of set bits across consecutive masks of the unit classification:
+    template <typename Emit>
+    class RunTracker
+    {
+    private:
+        Emit& m_emit;
+        unsigned int m_start;
+        bool m_inRun;
+
+    public:
+        explicit RunTracker(Emit& emit) noexcept : m_emit(emit), m_start(0), m_inRun(false)
+        {
+        }
+
+        void feed(const unsigned int mask, const unsigned int base, const unsigned int count)
+        {
+            const unsigned int valid = (count >= 32) ? ~0u : ((1u << count) - 1u);
+
+            // Fast paths for the whole block inside or outside of a run:
+            if (m_inRun && ((mask & valid) == valid))
+            {
+                return;
+            }
+
+            if (!m_inRun && !(mask & valid))
+            {
+                return;
+            }
+
+            unsigned int pos = 0;
+            while (pos < count)
+            {
+                const unsigned int from = ~0u << pos;
+                if (m_inRun)
+                {
+                    const unsigned int ends = ~mask & valid & from;
+                    if (!ends)
+                    {
+                        break;
+                    }
+
+                    pos = Simd::lowestBit(ends);
+                    m_emit(m_start, base + pos - m_start);
+                    m_inRun = false;
+                }
+                else
+                {
+                    const unsigned int starts = mask & valid & from;
+                    if (!starts)
+                    {
+                        break;
+                    }
+
+                    pos = Simd::lowestBit(starts);
+                    m_start = base + pos;
+                    m_inRun = true;
+                }
+            }
+        }
+
+        void finish(const unsigned int end)
+        {
+            if (m_inRun)
+            {
+                m_emit(m_start, end - m_start);
+                m_inRun = false;
+            }
+        }
+    };
+
+    template <typename Emit>
+    static void classifyAscii(const unsigned char* const data, const unsigned int size, Emit& emit)
+    {
+        RunTracker<Emit> tracker(emit);
+        unsigned int pos = 0;
+
+#ifdef PE_SIMD_SSE2
+        const __m128i lowerBound = _mm_set1_epi8(0x1F);
+        const __m128i upperBound = _mm_set1_epi8(0x7F);
+        const __m128i tab = _mm_set1_epi8('\t');
+
+        for (; pos + k_blockUnits <= size; pos += k_blockUnits)
+        {
+            // Signed comparisons: bytes above 0x7F are negative and fail the lower bound:
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+            const __m128i inRange = _mm_and_si128(_mm_cmpgt_epi8(chunk, lowerBound), _mm_cmplt_epi8(chunk, upperBound));
+            const __m128i isPrintable = _mm_or_si128(inRange, _mm_cmpeq_epi8(chunk, tab));
+            tracker.feed(static_cast<unsigned int>(_mm_movemask_epi8(isPrintable)), pos, k_blockUnits);
+        }
+#endif
+
+        for (; pos < size; pos += k_blockUnits)
+        {
+            const unsigned int count = (size - pos < k_blockUnits) ? (size - pos) : k_blockUnits;
+            unsigned int mask = 0;
+            for (unsigned int i = 0; i < count; ++i)
+            {
+                mask |= static_cast<unsigned int>(printable(data[pos + i])) << i;
+            }
+            tracker.feed(mask, pos, count);
+        }
+
+        tracker.finish(size);
+    }
+
+    template <typename Emit>
+    static void classifyUtf16(const unsigned char* const data, const unsigned int size, Emit& emit)
+    {
+        const unsigned int units = size / sizeof(char16_t);
+
+        RunTracker<Emit> tracker(emit);
+        unsigned int pos = 0;
+
+        const auto unitAt = [data](const unsigned int index) -> unsigned int
+        {
+            return static_cast<unsigned int>(data[index * 2]) | (static_cast<unsigned int>(data[index * 2 + 1]) << 8u);
+        };
+
+#ifdef PE_SIMD_SSE2
+        const __m128i lowerBound = _mm_set1_epi16(0x1F);
+        const __m128i upperBound = _mm_set1_epi16(0x7F);
+        const __m128i tab = _mm_set1_epi16('\t');
+
+        const auto classify = [&](const __m128i chunk) -> __m128i
+        {
+            const __m128i inRange = _mm_and_si128(_mm_cmpgt_epi16(chunk, lowerBound), _mm_cmplt_epi16(chunk, upperBound));
+            return _mm_or_si128(inRange, _mm_cmpeq_epi16(chunk, tab));
+        };
+
+        for (; pos + k_blockUnits <= units; pos += k_blockUnits)
+        {
+            // 16 characters in two registers, the 16-bit masks are packed to bytes to get one bit per character:
+            const __m128i low = classify(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos * 2)));
+            const __m128i high = classify(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos * 2 + sizeof(__m128i))));
+            tracker.feed(static_cast<unsigned int>(_mm_movemask_epi8(_mm_packs_epi16(low, high))), pos, k_blockUnits);
+        }
+#endif
+
+        for (; pos < units; pos += k_blockUnits)
+        {
+            const unsigned int count = (units - pos < k_blockUnits) ? (units - pos) : k_blockUnits;
+            unsigned int mask = 0;
+            for (unsigned int i = 0; i < count; ++i)
+            {
+                mask |= static_cast<unsigned int>(printable(unitAt(pos + i))) << i;
+            }
+            tracker.feed(mask, pos, count);
+        }
+
+        tracker.finish(units);
+    }
+
+public:
+    explicit StringExtractor(const unsigned int minLength = 4, const bool ascii = true, const bool utf16 = true) noexcept
+        : m_minLength(minLength ? minLength : 1)
+        , m_ascii(ascii)
+        , m_utf16(utf16)
+    {
+    }
+
+    unsigned int minLength() const noexcept
+    {
+        return m_minLength;
+    }
+
+    // Callback: void(const Entry& entry):
+    template <typename Callback>
+    void extract(const SectionData& section, const unsigned int sectionIndex, Callback&& callback) const
+    {
+        if (!section.valid())
+        {
+            return;
+        }
+
+        if (m_ascii)
+        {
+            auto emit = [&](const unsigned int start, const unsigned int length)
+            {
+                if (length >= m_minLength)
+                {
+                    callback(Entry{ section.rva + start, length, sectionIndex, Encoding::ascii, section.data + start });
+                }
+            };
+            classifyAscii(section.data, section.size, emit);
+        }
+
+        if (m_utf16)
+        {
+            // Keep the UTF-16 strings at even RVAs even if the section begins at an odd one:
+            const unsigned int skew = section.rva & 1u;
+            if (section.size > skew)
+            {
+                auto emit = [&](const unsigned int start, const unsigned int length)
+                {
+                    if (length >= m_minLength)
+                    {
+                        const unsigned int offset = skew + start * static_cast<unsigned int>(sizeof(char16_t));
+                        callback(Entry{ section.rva + offset, length, sectionIndex, Encoding::utf16le, section.data + offset });
+                    }
+                };
+                classifyUtf16(section.data + skew, section.size - skew, emit);
+            }
+        }
+    }
+
+    // Filter: bool(const SecHeader& section, unsigned int sectionIndex),
+    // Callback: void(const Entry& entry):
+    template <Arch arch, typename Filter, typename Callback>
+    void extract(const Pe<arch>& pe, Filter&& filter, Callback&& callback) const
+    {
+        unsigned int sectionIndex = 0;
+        for (const auto& sec : pe.sections())
+        {
+            if (filter(sec, sectionIndex))
+            {
+                extract(pe.sectionData(sec), sectionIndex, callback);
+            }
+            ++sectionIndex;
+        }
+    }
+
+    template <Arch arch, typename Callback>
+    void extract(const Pe<arch>& pe, Callback&& callback) const
+    {
+        extract(pe, [](const typename GenericTypes::SecHeader&, unsigned int) -> bool { return true; }, callback);
+    }
+};
+
+
+
+} // namespace Pe
@@ -0,0 +1,264 @@
+#pragma once
+
+#include "Pe.hpp"
+
+#include <string>
+#include <vector>
+
+
+
+namespace Pe
+{
+
+
+
+//
+// Self-contained copy of the metadata of an image that is usually needed for corpus processing:
+// headers, sections, imports, exports and the CodeView debug identity.
+// Doesn't refer to the image buffer, so it can outlive it.
+//
+
+struct Summary
+{
+    struct Section
+    {
+        std::string name;
+        Rva rva;
+        unsigned int virtualSize;
+        unsigned int rawOffset;
+        unsigned int rawSize;
+        unsigned int characteristics;
+    };
+
+    struct ImportFunction
+    {
+        std::string name; // Empty if imported by ordinal
+        Ordinal ordinal;  // Zero if imported by name
+    };
+
+    struct ImportModule
+    {
+        std::string name;
+        bool delayed;
+        std::vector<ImportFunction> functions;
+    };
+
+    struct Export
+    {
+        std::string name; // Empty if exported by ordinal only
+        unsigned int ordinal;
+        Rva rva;          // Zero for forwarders
+        std::string forwarder;
+    };
+
+    struct DebugIdentity
+    {
+        enum class Type : unsigned char
+        {
+            none,
+            pdb20,
+            pdb70
+        };
+
+        Type type;
+        GUID guid;              // PDB 7.0
+        unsigned int signature; // PDB 2.0
+        unsigned int age;
+        std::string pdbPath;
+    };
+
+    Arch arch;
+    unsigned short machine;
+    unsigned short characteristics;
+    unsigned int timestamp;
+    unsigned long long imageBase;
+    unsigned int imageSize;
+    Rva entryPoint;
+    unsigned short subsystem;
+    unsigned short dllCharacteristics;
+    unsigned int checksum;
+
+    std::vector<Section> sections;
+    std::vector<ImportModule> imports;
+    std::string exportModuleName;
+    std::vector<Export> exports;
+    DebugIdentity debug;
+
+private:
+    static std::string str(const char* const value)
+    {
+        return value ? std::string(value) : std::string();
+    }
+
+    static std::string str(const char* const value, const size_t maxLength)
+    {
+        if (!value)
+        {
+            return {};
+        }
+
+        size_t length = 0;
+        while ((length < maxLength) && value[length])
+        {
+            ++length;
+        }
+
+        return std::string(value, length);
+    }
+
+public:
+    // CodeView identity of the first PDB 2.0 or 7.0 record in the debug directory:
+    template <Arch arch>
+    static DebugIdentity debugIdentity(const Pe<arch>& pe)
+    {
+        DebugIdentity identity{};
+        identity.type = DebugIdentity::Type::none;
+
+        const auto pdb = pe.debug().pdbIdentity();
+        switch (pdb.magic)
+        {
+        case CodeView::CodeViewMagic::pdb20:
+        {
+            identity.type = DebugIdentity::Type::pdb20;
+            identity.signature = pdb.signature;
+            break;
+        }
+        case CodeView::CodeViewMagic::pdb70:
+        {
+            identity.type = DebugIdentity::Type::pdb70;
+            identity.guid = pdb.guid;
+            break;
+        }
+        default:
+        {
+            return identity;
+        }
+        }
+
+        identity.age = pdb.age;
+        identity.pdbPath.assign(pdb.pdbPath, pdb.pdbPathLength);
+
+        return identity;
+    }
+
+    template <Arch arch>
+    static Summary make(const Pe<arch>& pe)
+    {
+        Summary summary{};
+
+        const auto headers = pe.headers();
+        const auto* const fileHdr = &headers.nt()->FileHeader;
+        const auto* const optHdr = headers.opt();
+
+        summary.arch = arch;
+        summary.machine = fileHdr->Machine;
+        summary.characteristics = fileHdr->Characteristics;
+        summary.timestamp = fileHdr->TimeDateStamp;
+        summary.imageBase = optHdr->ImageBase;
+        summary.imageSize = optHdr->SizeOfImage;
+        summary.entryPoint = optHdr->AddressOfEntryPoint;
+        summary.subsystem = optHdr->Subsystem;
+        summary.dllCharacteristics = optHdr->DllCharacteristics;
+        summary.checksum = optHdr->CheckSum;
+
+        const auto sections = pe.sections();
+        summary.sections.reserve(sections.count());
+        for (const auto& sec : sections)
+        {
+            summary.sections.push_back(Section{
+                str(reinterpret_cast<const char*>(sec.Name), sizeof(sec.Name)),
+                sec.VirtualAddress,
+                sec.Misc.VirtualSize,
+                sec.PointerToRawData,
+                sec.SizeOfRawData,
+                sec.Characteristics
+            });
+        }
+
+        const auto addFunction = [](ImportModule& lib, const auto& fn)
+        {
+            switch (fn.type())
+            {
+            case ImportType::name:
+            {
+                const auto* const name = fn.name();
+                lib.functions.push_back(ImportFunction{ name ? str(name->Name) : std::string(), 0 });
+                break;
+            }
+            case ImportType::ordinal:
+            {
+                lib.functions.push_back(ImportFunction{ std::string(), static_cast<Ordinal>(fn.ordinal()) });
+                break;
+            }
+            default:
+            {
+                break;
+            }
+            }
+        };
+
+        for (const auto& lib : pe.imports())
+        {
+            summary.imports.push_back(ImportModule{ str(lib.libName()), false, {} });
+            for (const auto& fn : lib)
+            {
+                addFunction(summary.imports.back(), fn);
+            }
+        }
+
+        for (const auto& lib : pe.delayedImports())
+        {
+            summary.imports.push_back(ImportModule{ str(lib.moduleName()), true, {} });
+            for (const auto& fn : lib)
+            {
+                addFunction(summary.imports.back(), fn);
+            }
+        }
+
+        const auto exports = pe.exports();
+        if (exports.valid())
+        {
+            summary.exportModuleName = str(exports.moduleName());
+            summary.exports.reserve(exports.count());
+            for (const auto& exp : exports)
+            {
+                const auto type = exp.type();
+                if (type == ExportType::unknown)
+                {
+                    continue;
+                }
+
+                const auto* const entry = exp.exportAddressTableEntry();
+                if (!entry->address)
+                {
+                    continue; // Gap in the ordinals
+                }
+
+                summary.exports.push_back(Export{
+                    str(exp.name()),
+                    exp.ordinal(),
+                    (type == ExportType::exact) ? entry->address : 0,
+                    str(exp.forwarder())
+                });
+            }
+        }
+
+        summary.debug = debugIdentity(pe);
+
+        return summary;
+    }
+
+    // Classifies the architecture of a raw file and summarizes it:
+    static bool fromFile(const void* const buffer, Summary& summary)
+    {
+        return visit(buffer, [&summary](const auto& pe)
+        {
+            summary = make(pe);
+            return true;
+        });
+    }
+};
+
+
+
+} // namespace Pe
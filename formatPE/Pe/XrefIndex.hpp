@@ -0,0 +1,225 @@
+#pragma once
+
+#include "Pe.hpp"
+
+#include <vector>
+#include <algorithm>
+
+
+
+namespace Pe
+{
+
+
+
+//
+// Cross-reference index of the absolute pointers named by the base relocations:
+// maps each target RVA to the RVAs of the relocated pointers that point at it.
+// Stored in the compressed sparse row form: sorted unique targets,
+// offsets of their groups and the sites grouped by target.
+//
+
+template <Arch arch>
+class XrefIndex
+{
+public:
+    class Sites
+    {
+    private:
+        const Rva* m_begin;
+        const Rva* m_end;
+
+    public:
+        Sites() noexcept : m_begin(nullptr), m_end(nullptr)
+        {
+        }
+
+        Sites(const Rva* const begin, const Rva* const end) noexcept : m_begin(begin), m_end(end)
+        {
+        }
+
+        const Rva* begin() const noexcept
+        {
+            return m_begin;
+        }
+
+        const Rva* end() const noexcept
+        {
+            return m_end;
+        }
+
+        size_t size() const noexcept
+        {
+            return static_cast<size_t>(m_end - m_begin);
+        }
+
+        bool empty() const noexcept
+        {
+            return m_begin == m_end;
+        }
+
+        Rva operator [] (const size_t index) const noexcept
+        {
+            return m_begin[index];
+        }
+    };
+
+private:
+    std::vector<Rva> m_targets;          // Sorted, unique
+    std::vector<unsigned int> m_offsets; // m_targets.size() + 1 entries
+    std::vector<Rva> m_sites;            // Sorted within each target
+
+private:
+    static unsigned long long readPointer(const unsigned char* const ptr, const unsigned int size) noexcept
+    {
+        unsigned long long value = 0;
+        for (unsigned int i = 0; i < size; ++i)
+        {
+            value |= static_cast<unsigned long long>(ptr[i]) << (i * 8u);
+        }
+        return value;
+    }
+
+    // Base address that the relocated pointers are relative to:
+    static unsigned long long actualBase(const Pe<arch>& pe) noexcept
+    {
+        return (pe.type() == ImgType::module)
+            ? static_cast<unsigned long long>(reinterpret_cast<size_t>(pe.headers().mod()))
+            : pe.imageBase();
+    }
+
+public:
+    explicit XrefIndex(const Pe<arch>& pe)
+    {
+        const unsigned long long base = actualBase(pe);
+        const unsigned long long imageSize = pe.imageSize();
+
+        struct Xref
+        {
+            Rva target;
+            Rva site;
+        };
+
+        std::vector<Xref> xrefs;
+
+        for (const auto& page : pe.relocs())
+        {
+            if (!page.valid())
+            {
+                break;
+            }
+
+            const Rva pageRva = page.descriptor()->VirtualAddress;
+            const auto* const pageData = static_cast<const unsigned char*>(page.page());
+            if (!pageData)
+            {
+                continue;
+            }
+
+            for (const auto& entry : page)
+            {
+                const auto* const reloc = entry.reloc();
+
+                unsigned int pointerSize = 0;
+                switch (reloc->type())
+                {
+                case RelocType::highlow: pointerSize = sizeof(unsigned int); break;
+                case RelocType::dir64  : pointerSize = sizeof(unsigned long long); break;
+                default:
+                    continue; // Not a full pointer
+                }
+
+                const unsigned long long pointer = readPointer(pageData + reloc->offsetInPage, pointerSize);
+                if ((pointer < base) || (pointer - base >= imageSize))
+                {
+                    continue;
+                }
+
+                xrefs.push_back(Xref{ static_cast<Rva>(pointer - base), pageRva + reloc->offsetInPage });
+            }
+        }
+
+        std::sort(xrefs.begin(), xrefs.end(), [](const Xref& left, const Xref& right) -> bool
+        {
+            return (left.target < right.target) || ((left.target == right.target) && (left.site < right.site));
+        });
+
+        m_sites.reserve(xrefs.size());
+        for (const auto& xref : xrefs)
+        {
+            if (m_targets.empty() || (m_targets.back() != xref.target))
+            {
+                m_targets.push_back(xref.target);
+                m_offsets.push_back(static_cast<unsigned int>(m_sites.size()));
+            }
+            m_sites.push_back(xref.site);
+        }
+        m_offsets.push_back(static_cast<unsigned int>(m_sites.size()));
+    }
+
+    const std::vector<Rva>& targets() const noexcept
+    {
+        return m_targets;
+    }
+
+    size_t targetsCount() const noexcept
+    {
+        return m_targets.size();
+    }
+
+    size_t sitesCount() const noexcept
+    {
+        return m_sites.size();
+    }
+
+    bool empty() const noexcept
+    {
+        return m_sites.empty();
+    }
+
+    // Sites of the i-th target in the sorted order:
+    Sites sitesAt(const size_t targetIndex) const noexcept
+    {
+        if (targetIndex >= m_targets.size())
+        {
+            return {};
+        }
+
+        const Rva* const sites = m_sites.data();
+        return Sites(sites + m_offsets[targetIndex], sites + m_offsets[targetIndex + 1]);
+    }
+
+    // Who references this RVA:
+    Sites references(const Rva target) const noexcept
+    {
+        const auto it = std::lower_bound(m_targets.cbegin(), m_targets.cend(), target);
+        if ((it == m_targets.cend()) || (*it != target))
+        {
+            return {};
+        }
+
+        return sitesAt(static_cast<size_t>(it - m_targets.cbegin()));
+    }
+
+    // All sites that reference [begin, end), e.g. any slot of a vtable:
+    Sites references(const Rva begin, const Rva end) const noexcept
+    {
+        const auto first = std::lower_bound(m_targets.cbegin(), m_targets.cend(), begin);
+        const auto last = std::lower_bound(first, m_targets.cend(), end);
+        if (first == last)
+        {
+            return {};
+        }
+
+        const Rva* const sites = m_sites.data();
+        return Sites(sites + m_offsets[first - m_targets.cbegin()], sites + m_offsets[last - m_targets.cbegin()]);
+    }
+};
+
+using XrefIndex32 = XrefIndex<Arch::x32>;
+using XrefIndex64 = XrefIndex<Arch::x64>;
+using XrefIndexNative = XrefIndex<Arch::native>;
+
+
+
+} // namespace Pe
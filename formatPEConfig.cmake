@@ -19,6 +19,14 @@ target_include_directories("${formatPE_NAME}_Pe" INTERFACE
     "${CMAKE_CURRENT_LIST_DIR}/formatPE/"
 )
 
+# Hot-path counters change the inline bodies of Pe.hpp, so they are enabled for every consumer at once:
+option(formatPE_INSTRUMENTATION "Compile the Pe.hpp instrumentation counters in" OFF)
+if(formatPE_INSTRUMENTATION)
+    target_compile_definitions("${formatPE_NAME}_Pe" INTERFACE
+        PE_INSTRUMENTATION
+    )
+endif()
+
 add_library("${formatPE_NAME}::Pe" ALIAS "${formatPE_NAME}_Pe")
 
 
@@ -33,6 +41,10 @@ target_include_directories("${formatPE_NAME}_Pdb" PUBLIC
     "${CMAKE_CURRENT_LIST_DIR}/formatPE/"
 )
 
+target_link_libraries("${formatPE_NAME}_Pdb" PUBLIC
+    formatPE::Pe
+)
+
 add_library("${formatPE_NAME}::Pdb" ALIAS "${formatPE_NAME}_Pdb")
 
 
@@ -56,23 +68,83 @@ add_library("${formatPE_NAME}::SymLoader" ALIAS "${formatPE_NAME}_SymLoader")
 
 
 
+# formatPE::Corpus library:
+add_library("${formatPE_NAME}_Corpus"
+    "${CMAKE_CURRENT_LIST_DIR}/formatPE/Corpus/SummaryCache.h"
+    "${CMAKE_CURRENT_LIST_DIR}/formatPE/Corpus/SummaryCache.cpp"
+    "${CMAKE_CURRENT_LIST_DIR}/formatPE/Corpus/SummaryStore.h"
+    "${CMAKE_CURRENT_LIST_DIR}/formatPE/Corpus/SummaryStore.cpp"
+    "${CMAKE_CURRENT_LIST_DIR}/formatPE/Corpus/Columnar.h"
+    "${CMAKE_CURRENT_LIST_DIR}/formatPE/Corpus/Columnar.cpp"
+    "${CMAKE_CURRENT_LIST_DIR}/formatPE/Corpus/NegativeCache.h"
+    "${CMAKE_CURRENT_LIST_DIR}/formatPE/Corpus/NegativeCache.cpp"
+)
+
+target_include_directories("${formatPE_NAME}_Corpus" PUBLIC
+    "${CMAKE_CURRENT_LIST_DIR}/formatPE/"
+)
+
+target_link_libraries("${formatPE_NAME}_Corpus" PUBLIC
+    formatPE::Pe
+)
+
+if(CMAKE_SYSTEM_NAME STREQUAL "Linux")
+    # io_uring-based reader and the POSIX symbol ingestion are Linux-only:
+    find_package(Threads REQUIRED)
+
+    target_sources("${formatPE_NAME}_Corpus" PRIVATE
+        "${CMAKE_CURRENT_LIST_DIR}/formatPE/Corpus/UringReader.h"
+        "${CMAKE_CURRENT_LIST_DIR}/formatPE/Corpus/UringReader.cpp"
+        "${CMAKE_CURRENT_LIST_DIR}/formatPE/Corpus/SymbolStore.h"
+        "${CMAKE_CURRENT_LIST_DIR}/formatPE/Corpus/SymbolStore.cpp"
+        "${CMAKE_CURRENT_LIST_DIR}/formatPE/Corpus/DownloadPool.h"
+        "${CMAKE_CURRENT_LIST_DIR}/formatPE/Corpus/DownloadPool.cpp"
+        "${CMAKE_CURRENT_LIST_DIR}/formatPE/Corpus/HttpSession.h"
+        "${CMAKE_CURRENT_LIST_DIR}/formatPE/Corpus/HttpSession.cpp"
+    )
+
+    target_link_libraries("${formatPE_NAME}_Corpus" PUBLIC
+        Threads::Threads
+    )
+endif()
+
+add_library("${formatPE_NAME}::Corpus" ALIAS "${formatPE_NAME}_Corpus")
+
+
+
 # Tests:
 add_executable("PeTests" "${CMAKE_CURRENT_LIST_DIR}/PeTests/PeTests.cpp")
 target_link_libraries("PeTests" PUBLIC
     formatPE::Pe
     formatPE::Pdb
     formatPE::SymLoader
+    formatPE::Corpus
 )
 
 enable_testing()
 add_test("PeTests" "${CMAKE_BINARY_DIR}/${PLATFORM_DIR}/bin/PeTests.exe")
 
+if(CMAKE_SYSTEM_NAME STREQUAL "Linux")
+    # Linux-only parts of formatPE::Corpus over synthetic images:
+    add_executable("CorpusTests" "${CMAKE_CURRENT_LIST_DIR}/CorpusTests/CorpusTests.cpp")
+    target_link_libraries("CorpusTests" PUBLIC
+        formatPE::Corpus
+    )
+
+    set_target_properties("CorpusTests" PROPERTIES
+        RUNTIME_OUTPUT_DIRECTORY "${CMAKE_BINARY_DIR}/${PLATFORM_DIR}/bin"
+    )
+
+    add_test("CorpusTests" "${CMAKE_BINARY_DIR}/${PLATFORM_DIR}/bin/CorpusTests")
+endif()
+
 
 
 set_target_properties(
     "${formatPE_NAME}_Pe"
     "${formatPE_NAME}_Pdb"
     "${formatPE_NAME}_SymLoader"
+    "${formatPE_NAME}_Corpus"
     "PeTests"
     PROPERTIES 
     ARCHIVE_OUTPUT_DIRECTORY "${CMAKE_BINARY_DIR}/${PLATFORM_DIR}/lib"